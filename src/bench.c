@@ -0,0 +1,532 @@
+/*
+ * bench.c
+ *
+ * Defines the main function of cminesweeper-bench, which times the board,
+ * bitboard and savegame functions on boards of many sizes and mine densities,
+ * and reports the time per call, the cells handled per second, the peak memory
+ * use and the number of allocations per call, as a table and as JSON.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>	/* strcmp, strncmp */
+#include <time.h>	/* clock_gettime */
+#include <unistd.h>	/* getopt */
+#include <sys/stat.h>	/* mkdir */
+
+#include "board.h"
+#include "bitboard.h"
+#include "rng.h"
+#include "savegame.h"
+
+/* file written and read by the savegame benchmarks, in ~/.cminesweeper */
+#define BENCH_SAVEFILE "bench-savefile"
+
+/* calls made to allClear per run, since a single one is too quick to time */
+#define ALLCLEAR_BATCH 1000
+
+/* a measurement stops after this many times the minimum time, even when most
+   of it went into setting up the runs */
+#define WALL_FACTOR 10
+
+/* The benchmark is linked with --wrap=malloc and friends, so that every
+   allocation made by the engine goes through these and gets counted. */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static long allocations;
+
+void *__wrap_malloc(size_t size) {
+	allocations++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+	allocations++;
+	return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+	allocations++;
+	return __real_realloc(ptr, size);
+}
+
+/* the board every operation of one size and density runs on */
+typedef struct {
+	Board board;
+	long cells;			/* squares on the board */
+	int openX, openY;	/* square opened by the openSquares benchmark */
+	Savegame save;		/* the board as a savegame, for the savegame functions */
+	Savegame loaded;	/* where loadSaveFile reads it back into */
+	Bitboard bits;		/* the mines as a bitboard, for the bitboard functions */
+	unsigned char *counts;	/* a row of neighbor counts from bitboardCountRow */
+	long calls;			/* calls made by the last run */
+	long items;			/* cells handled by the last run */
+} Case;
+
+typedef struct {
+	const char *name;
+	void (*setup)(Case *);		/* run before every timed run, or NULL */
+	void (*run)(Case *);		/* the timed part */
+	void (*cleanup)(Case *);	/* run after every timed run, or NULL */
+} Operation;
+
+/* one line of the report */
+typedef struct {
+	const char *operation;
+	int width, height;
+	double density;			/* percentage of squares with a mine */
+	long mineCount;
+	long runs;
+	long calls;
+	double nsPerCall;
+	double cellsPerSecond;
+	long peakRss;			/* KiB */
+	double allocationsPerCall;
+} Result;
+
+/* keeps the compiler from dropping calls whose results aren't used */
+static volatile long sink;
+
+static uint64_t nanoseconds(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* resets the peak resident set size of the process to its current size, on
+   kernels that support it */
+static void resetPeakRss(void) {
+	FILE *file = fopen("/proc/self/clear_refs", "w");
+	if (file == NULL)
+		return;
+	fputs("5", file);
+	fclose(file);
+}
+
+/* returns the peak resident set size of the process in KiB, or -1 if it can't
+   be read */
+static long peakRss(void) {
+	char line[256];
+	long kib = -1;
+	FILE *file = fopen("/proc/self/status", "r");
+
+	if (file == NULL)
+		return -1;
+	while (fgets(line, sizeof(line), file) != NULL) {
+		if (strncmp(line, "VmHWM:", 6) == 0) {
+			kib = atol(line + 6);
+			break;
+		}
+	}
+	fclose(file);
+	return kib;
+}
+
+/* covers every square again, keeping the mines where they are */
+static void coverBoard(Case *c) {
+	Board *board = &c->board;
+	int x, y;
+
+	for (y = 1; y <= board->height; y++) {
+		for (x = 1; x <= board->width; x++)
+			CELL(*board, x, y) = (CELL(*board, x, y) & MASK_MINE) | '+';
+	}
+	recountCovered(board);
+	clearDirty(board);
+}
+
+/* reseeding puts the mines back where they were, so the later operations still
+   find the square they open free of mines */
+static void setupInitializeMines(Case *c) {
+	clearBoardArray(&c->board);
+	seedBoard(&c->board, c->board.seed);
+}
+
+static void runInitializeMines(Case *c) {
+	initializeMines(&c->board);
+	c->calls = 1;
+	c->items = c->cells;
+}
+
+static void runNumMines(Case *c) {
+	const Board *board = &c->board;
+	long total = 0;
+	int x, y;
+
+	for (y = 1; y <= board->height; y++) {
+		for (x = 1; x <= board->width; x++)
+			total += numMines(*board, x, y);
+	}
+	sink = total;
+	c->calls = c->cells;
+	c->items = c->cells;
+}
+
+static void runOpenSquares(Case *c) {
+	c->items = openSquares(&c->board, c->openX, c->openY);
+	c->calls = 1;
+}
+
+static void runAllClear(Case *c) {
+	long total = 0;
+	int i;
+
+	for (i = 0; i < ALLCLEAR_BATCH; i++)
+		total += allClear(c->board);
+	sink = total;
+	c->calls = ALLCLEAR_BATCH;
+	c->items = ALLCLEAR_BATCH * c->cells;
+}
+
+static void runBoardToBitboard(Case *c) {
+	boardToBitboard(&c->board, &c->bits);
+	c->calls = 1;
+	c->items = c->cells;
+}
+
+static void runBitboardCountRow(Case *c) {
+	int y;
+
+	for (y = 1; y <= c->bits.height; y++)
+		bitboardCountRow(&c->bits, y, c->counts);
+	sink = c->counts[0];
+	c->calls = c->bits.height;
+	c->items = c->cells;
+}
+
+static void runBitboardClicks(Case *c) {
+	sink = bitboardClicks(&c->bits);
+	c->calls = 1;
+	c->items = c->cells;
+}
+
+static void runOverlayMines(Case *c) {
+	overlayMines(&c->board);
+	c->calls = 1;
+	c->items = c->cells;
+}
+
+static void runSetGameData(Case *c) {
+	setGameData(c->board, &c->loaded);
+	c->calls = 1;
+	c->items = c->cells;
+}
+
+static void freeLoaded(Case *c) {
+	freeGameData(&c->loaded);
+}
+
+static void runGetGameData(Case *c) {
+	getGameData(&c->board, c->save);
+	c->calls = 1;
+	c->items = c->cells;
+}
+
+static void runWriteSaveFile(Case *c) {
+	writeSaveFile(BENCH_SAVEFILE, c->save);
+	c->calls = 1;
+	c->items = c->cells;
+}
+
+static void runWriteSaveBoard(Case *c) {
+	writeSaveBoard(BENCH_SAVEFILE, c->save, &c->board);
+	c->calls = 1;
+	c->items = c->cells;
+}
+
+static void runLoadSaveFile(Case *c) {
+	loadSaveFile(BENCH_SAVEFILE, &c->loaded);
+	c->calls = 1;
+	c->items = c->cells;
+}
+
+/* in order: the board has to be converted before the other bitboard
+   functions, and a save file has to be written before loadSaveFile */
+static const Operation operations[] = {
+	{ "initializeMines", setupInitializeMines, runInitializeMines, NULL },
+	{ "numMines",        NULL,                 runNumMines,        NULL },
+	{ "openSquares",     coverBoard,           runOpenSquares,     NULL },
+	{ "allClear",        NULL,                 runAllClear,        NULL },
+	{ "boardToBitboard", NULL,                 runBoardToBitboard, NULL },
+	{ "bitboardCountRow", NULL,                runBitboardCountRow, NULL },
+	{ "bitboardClicks",  NULL,                 runBitboardClicks,  NULL },
+	{ "overlayMines",    coverBoard,           runOverlayMines,    NULL },
+	{ "setGameData",     NULL,                 runSetGameData,     freeLoaded },
+	{ "getGameData",     NULL,                 runGetGameData,     NULL },
+	{ "writeSaveFile",   NULL,                 runWriteSaveFile,   NULL },
+	{ "writeSaveBoard",  NULL,                 runWriteSaveBoard,  NULL },
+	{ "loadSaveFile",    NULL,                 runLoadSaveFile,    freeLoaded },
+};
+
+#define OPERATION_COUNT ((int) (sizeof(operations) / sizeof(operations[0])))
+
+/* allocates the board for a case and places its mines; returns -1 if memory
+   runs out */
+static int initCase(Case *c, int width, int height, long mineCount, uint64_t seed) {
+	Board *board = &c->board;
+	int x, y;
+
+	board->width = width;
+	board->height = height;
+	board->mineCount = mineCount;
+	if (initBoardArray(board) == -1)
+		return -1;
+	c->counts = (unsigned char *) malloc(width);
+	if (c->counts == NULL) {
+		freeBoardArray(board);
+		return -1;
+	}
+	if (initBitboard(&c->bits, width, height) == -1) {
+		free(c->counts);
+		freeBoardArray(board);
+		return -1;
+	}
+	seedBoard(board, seed);
+	initializeMines(board);
+	c->cells = (long) width * height;
+
+	/* open a square without neighboring mines if there is one, so that
+	   openSquares floods the largest area it can */
+	c->openX = c->openY = 0;
+	for (y = 1; y <= height && c->openX == 0; y++) {
+		for (x = 1; x <= width; x++) {
+			if (!(CELL(*board, x, y) & MASK_MINE) && COUNT(*board, x, y) == 0) {
+				c->openX = x;
+				c->openY = y;
+				break;
+			}
+		}
+	}
+	for (y = 1; y <= height && c->openX == 0; y++) {
+		for (x = 1; x <= width; x++) {
+			if (!(CELL(*board, x, y) & MASK_MINE)) {
+				c->openX = x;
+				c->openY = y;
+				break;
+			}
+		}
+	}
+
+	memset(&c->save, 0, sizeof(c->save));
+	c->save.width = width;
+	c->save.height = height;
+	c->save.qtyMines = mineCount;
+	c->save.cy = 1;
+	c->save.cx = 1;
+	c->save.seed = seed;
+	setGameData(*board, &c->save);
+	c->loaded.gameData = NULL;
+	c->loaded.mapping = NULL;
+	if (c->save.gameData == NULL) {
+		freeBitboard(&c->bits);
+		free(c->counts);
+		freeBoardArray(board);
+		return -1;
+	}
+	return 0;
+}
+
+static void freeCase(Case *c) {
+	freeGameData(&c->save);
+	freeGameData(&c->loaded);
+	freeBitboard(&c->bits);
+	free(c->counts);
+	freeBoardArray(&c->board);
+}
+
+/* runs op until it has been timed for at least minTime nanoseconds */
+static void measure(Case *c, const Operation *op, uint64_t minTime, Result *result) {
+	uint64_t timed = 0, start, wallStart = nanoseconds();
+	long allocated = 0, before;
+	long runs = 0, calls = 0, items = 0;
+
+	resetPeakRss();
+	do {
+		if (op->setup != NULL)
+			op->setup(c);
+
+		before = allocations;
+		start = nanoseconds();
+		op->run(c);
+		timed += nanoseconds() - start;
+		allocated += allocations - before;
+
+		runs++;
+		calls += c->calls;
+		items += c->items;
+		if (op->cleanup != NULL)
+			op->cleanup(c);
+	} while (timed < minTime && nanoseconds() - wallStart < WALL_FACTOR * minTime);
+
+	result->operation = op->name;
+	result->runs = runs;
+	result->calls = calls;
+	result->nsPerCall = (double) timed / calls;
+	result->cellsPerSecond = items / (timed / 1e9);
+	result->peakRss = peakRss();
+	result->allocationsPerCall = (double) allocated / calls;
+}
+
+static void printRow(FILE *out, const Result *r) {
+	char board[32];
+	snprintf(board, sizeof(board), "%dx%d", r->width, r->height);
+	fprintf(out, "%-16s %12s %7.1f%% %8ld %14.1f %14.4g %12ld %10.2f\n",
+		r->operation, board, r->density, r->runs,
+		r->nsPerCall, r->cellsPerSecond, r->peakRss, r->allocationsPerCall);
+	fflush(out);
+}
+
+static void writeJson(FILE *out, const Result *results, int count, uint64_t seed) {
+	int i;
+
+	fprintf(out, "{\n  \"seed\": %llu,\n  \"results\": [\n", (unsigned long long) seed);
+	for (i = 0; i < count; i++) {
+		const Result *r = &results[i];
+		fprintf(out, "    {\"operation\": \"%s\", \"width\": %d, \"height\": %d, "
+			"\"density\": %g, \"mines\": %ld, \"runs\": %ld, \"calls\": %ld, "
+			"\"ns_per_op\": %.3f, \"cells_per_sec\": %.6g, \"peak_rss_kib\": %ld, "
+			"\"allocs_per_op\": %.4f}%s\n",
+			r->operation, r->width, r->height, r->density, r->mineCount,
+			r->runs, r->calls, r->nsPerCall, r->cellsPerSecond, r->peakRss,
+			r->allocationsPerCall, (i + 1 < count) ? "," : "");
+	}
+	fprintf(out, "  ]\n}\n");
+}
+
+static void usage(const char *name) {
+	fprintf(stderr,
+		"usage: %s [-w WxH]... [-d density]... [-t ms] [-s seed] [-j file]\n"
+		"\n"
+		"  -w WxH      board size; may be repeated (default: 9x9, 16x16, 30x24,\n"
+		"              100x100, 1000x1000 and 10000x10000)\n"
+		"  -d density  percentage of squares with a mine; may be repeated\n"
+		"              (default: 1, 10, 20, 50 and 90)\n"
+		"  -t ms       minimum time measured per operation (default 100)\n"
+		"  -s seed     seed of the mine layouts (default 1)\n"
+		"  -j file     also write the results as JSON to file, or to the\n"
+		"              standard output if file is -, moving the table to the\n"
+		"              standard error\n",
+		name);
+}
+
+int main(int argc, char *argv[]) {
+	int widths[32] = { 9, 16, 30, 100, 1000, 10000 };
+	int heights[32] = { 9, 16, 24, 100, 1000, 10000 };
+	int sizeCount = 6;
+	double densities[32] = { 1, 10, 20, 50, 90 };
+	int densityCount = 5;
+	bool defaultSizes = true, defaultDensities = true;
+	uint64_t minTime = 100000000;
+	uint64_t seed = 1;
+	const char *jsonName = NULL;
+	FILE *table = stdout, *json = NULL;
+	Result *results;
+	int resultCount = 0;
+	int opt, i, j, k;
+
+	while ((opt = getopt(argc, argv, "w:d:t:s:j:h")) != -1) {
+		switch (opt) {
+		case 'w':
+			if (defaultSizes) {
+				sizeCount = 0;
+				defaultSizes = false;
+			}
+			if (sizeCount == 32)
+				break;
+			if (sscanf(optarg, "%dx%d", &widths[sizeCount], &heights[sizeCount]) != 2
+					|| widths[sizeCount] < 2 || heights[sizeCount] < 2) {
+				fprintf(stderr, "%s: invalid board size '%s'\n", argv[0], optarg);
+				return 1;
+			}
+			sizeCount++;
+			break;
+		case 'd':
+			if (defaultDensities) {
+				densityCount = 0;
+				defaultDensities = false;
+			}
+			if (densityCount == 32)
+				break;
+			densities[densityCount] = atof(optarg);
+			if (densities[densityCount] < 0 || densities[densityCount] >= 100) {
+				fprintf(stderr, "%s: invalid density '%s'\n", argv[0], optarg);
+				return 1;
+			}
+			densityCount++;
+			break;
+		case 't':
+			minTime = (uint64_t) atol(optarg) * 1000000;
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'j':
+			jsonName = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (jsonName != NULL) {
+		if (strcmp(jsonName, "-") == 0) {
+			json = stdout;
+			table = stderr;
+		} else if ((json = fopen(jsonName, "w")) == NULL) {
+			fprintf(stderr, "%s: can't open '%s'\n", argv[0], jsonName);
+			return 1;
+		}
+	}
+
+	/* the savegame functions write to ~/.cminesweeper */
+	if (getenv("HOME") != NULL) {
+		char dir[4096];
+		snprintf(dir, sizeof(dir), "%s/.cminesweeper", getenv("HOME"));
+		mkdir(dir, 0755);
+	}
+
+	results = (Result *) malloc(sizeCount * densityCount * OPERATION_COUNT * sizeof(Result));
+	if (results == NULL) {
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		return 1;
+	}
+
+	fprintf(table, "%-16s %12s %8s %8s %14s %14s %12s %10s\n",
+		"operation", "board", "density", "runs", "ns/op", "cells/s", "peak KiB", "allocs/op");
+	for (i = 0; i < sizeCount; i++) {
+		for (j = 0; j < densityCount; j++) {
+			long cells = (long) widths[i] * heights[i];
+			long mineCount = (long) (cells * densities[j] / 100);
+			Case c;
+
+			if (initCase(&c, widths[i], heights[i], mineCount, seed) == -1) {
+				fprintf(stderr, "%s: out of memory for %dx%d\n", argv[0], widths[i], heights[i]);
+				continue;
+			}
+			for (k = 0; k < OPERATION_COUNT; k++) {
+				Result *r = &results[resultCount++];
+				r->width = widths[i];
+				r->height = heights[i];
+				r->density = densities[j];
+				r->mineCount = mineCount;
+				measure(&c, &operations[k], minTime, r);
+				printRow(table, r);
+			}
+			freeCase(&c);
+		}
+	}
+	removeSaveFile(BENCH_SAVEFILE);
+
+	if (json != NULL) {
+		writeJson(json, results, resultCount, seed);
+		if (json != stdout)
+			fclose(json);
+	}
+	free(results);
+	return 0;
+}
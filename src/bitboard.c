@@ -0,0 +1,241 @@
+/*
+ * bitboard.c
+ *
+ * Defines functions for managing the Bitboard struct and analyzing the mine
+ * layout it holds
+ */
+
+#include <stdlib.h>
+#include <string.h>	/* memset */
+
+#include "bitboard.h"
+
+#define POPCOUNT(w) __builtin_popcountll(w)
+
+/* mask of the valid bits in word w of a row */
+static inline uint64_t wordMask(const Bitboard *bb, int w) {
+	int rest = bb->width - 64 * w;
+	return (rest >= 64)
+		? ~(uint64_t) 0
+		: ((uint64_t) 1 << rest) - 1;
+}
+
+static inline void setBit(uint64_t *row, int x) {
+	row[(x - 1) >> 6] |= (uint64_t) 1 << ((x - 1) & 63);
+}
+
+/* adds the 1-bit values in b to the bit-sliced 4-bit counters in s */
+static inline void addPlane(uint64_t s[4], uint64_t b) {
+	uint64_t carry;
+
+	carry = s[0] & b; s[0] ^= b;
+	b = carry; carry = s[1] & b; s[1] ^= b;
+	b = carry; carry = s[2] & b; s[2] ^= b;
+	/* a 3x3 block holds at most 9 mines, so s[3] can never overflow */
+	s[3] |= carry;
+}
+
+int initBitboard(Bitboard *bb, int width, int height) {
+	size_t words;
+
+	bb->width = width;
+	bb->height = height;
+	bb->words = (width + 63) / 64;
+	words = (size_t) bb->words * (height + 2);
+
+	bb->mines = (uint64_t *) calloc(words, sizeof(uint64_t));
+	if (bb->mines == NULL)
+		return -1;
+	return 0;
+}
+
+int freeBitboard(Bitboard *bb) {
+	free(bb->mines);
+	bb->mines = NULL;
+	return 0;
+}
+
+int boardToBitboard(const Board *board, Bitboard *bb) {
+	int x, y;
+
+	memset(bb->mines, 0, (size_t) bb->words * (bb->height + 2) * sizeof(uint64_t));
+	for (y = 1; y <= board->height; y++) {
+		for (x = 1; x <= board->width; x++) {
+			if (CELL(*board, x, y) & MASK_MINE)
+				setBit(BITROW(*bb, mines, y), x);
+		}
+	}
+	return 0;
+}
+
+/* counts the mines in the 3x3 block around each of the 64 squares in word w of
+   row y, the square itself included, into the bit-sliced counters s; bit i of
+   s[k] is bit k of the count for the i-th square in the word */
+static inline void countWord(const Bitboard *bb, int y, int w, uint64_t s[4]) {
+	int r;
+
+	s[0] = s[1] = s[2] = s[3] = 0;
+	for (r = y - 1; r <= y + 1; r++) {
+		const uint64_t *row = BITROW(*bb, mines, r);
+		uint64_t cur = row[w];
+		uint64_t prev = (w > 0) ? row[w - 1] : 0;
+		uint64_t next = (w + 1 < bb->words) ? row[w + 1] : 0;
+
+		addPlane(s, cur);
+		addPlane(s, (cur << 1) | (prev >> 63));	/* left neighbors */
+		addPlane(s, (cur >> 1) | (next << 63));	/* right neighbors */
+	}
+}
+
+/* returns the column of the first square at or after x whose bit in row is
+   set, or clear if set is false; returns width + 1 if there is none */
+static int nextBit(const Bitboard *bb, const uint64_t *row, int x, bool set) {
+	int w = (x - 1) >> 6;
+	uint64_t word;
+
+	if (x > bb->width)
+		return bb->width + 1;
+	word = (set ? row[w] : ~row[w]) & (~(uint64_t) 0 << ((x - 1) & 63));
+	while (word == 0) {
+		if (++w == bb->words)
+			return bb->width + 1;
+		word = set ? row[w] : ~row[w];
+	}
+	x = 64 * w + __builtin_ctzll(word) + 1;
+	return (x <= bb->width) ? x : bb->width + 1;
+}
+
+/* returns the root of the run i, halving the path to it on the way */
+static long findRun(long *parent, long i) {
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];
+		i = parent[i];
+	}
+	return i;
+}
+
+int bitboardCountRow(const Bitboard *bb, int y, unsigned char *out) {
+	int w, i, n;
+
+	for (w = 0; w < bb->words; w++) {
+		uint64_t s[4];
+
+		countWord(bb, y, w, s);
+		n = bb->width - 64 * w;
+		if (n > 64) n = 64;
+		for (i = 0; i < n; i++) {
+			out[64 * w + i] = ((s[0] >> i) & 1)
+				| ((s[1] >> i) & 1) << 1
+				| ((s[2] >> i) & 1) << 2
+				| ((s[3] >> i) & 1) << 3;
+		}
+	}
+	return 0;
+}
+
+long bitboardClicks(const Bitboard *bb) {
+	size_t words = (size_t) bb->words * (bb->height + 2);
+	uint64_t *zero;
+	int *start = NULL, *end = NULL;
+	long *parent = NULL;
+	long runs = 0, capacity = 0, openings, rowStart = 0, prevStart = 0;
+	long clicks = 0;
+	int w, x, y;
+
+	/* squares with no mine in the 3x3 block around them; rows 0 and
+	   height + 1 stay empty, like in the mine plane */
+	zero = (uint64_t *) calloc(words, sizeof(uint64_t));
+	if (zero == NULL)
+		return -1;
+	for (y = 1; y <= bb->height; y++) {
+		uint64_t *row = zero + (long) y * bb->words;
+		for (w = 0; w < bb->words; w++) {
+			uint64_t s[4];
+			countWord(bb, y, w, s);
+			row[w] = ~(s[0] | s[1] | s[2] | s[3]) & wordMask(bb, w);
+		}
+	}
+
+	/* every square without a mine that isn't in or next to an opening takes
+	   a click of its own */
+	for (y = 1; y <= bb->height; y++) {
+		const uint64_t *mines = BITROW(*bb, mines, y);
+		for (w = 0; w < bb->words; w++) {
+			uint64_t near = 0;
+			int r;
+			for (r = y - 1; r <= y + 1; r++) {
+				const uint64_t *row = zero + (long) r * bb->words;
+				uint64_t cur = row[w];
+				uint64_t prev = (w > 0) ? row[w - 1] : 0;
+				uint64_t next = (w + 1 < bb->words) ? row[w + 1] : 0;
+				near |= cur | (cur << 1) | (prev >> 63) | (cur >> 1) | (next << 63);
+			}
+			clicks += POPCOUNT(~(mines[w] | near) & wordMask(bb, w));
+		}
+	}
+
+	/* every opening takes one click. They are counted as the runs of zero
+	   squares in each row, less the runs that touch a run of the row above
+	   that isn't already part of the same opening */
+	for (y = 1; y <= bb->height; y++) {
+		const uint64_t *row = zero + (long) y * bb->words;
+		long i, j;
+
+		prevStart = rowStart;
+		rowStart = runs;
+		for (x = nextBit(bb, row, 1, true); x <= bb->width; x = nextBit(bb, row, x, true)) {
+			if (runs == capacity) {
+				long grown = (capacity > 0) ? 2 * capacity : 256;
+				int *newStart = (int *) realloc(start, grown * sizeof(int));
+				int *newEnd = (newStart != NULL) ? (int *) realloc(end, grown * sizeof(int)) : NULL;
+				long *newParent = (newEnd != NULL) ? (long *) realloc(parent, grown * sizeof(long)) : NULL;
+				if (newStart != NULL)
+					start = newStart;
+				if (newEnd != NULL)
+					end = newEnd;
+				if (newParent == NULL) {
+					free(start);
+					free(end);
+					free(parent);
+					free(zero);
+					return -1;
+				}
+				parent = newParent;
+				capacity = grown;
+			}
+			start[runs] = x;
+			x = nextBit(bb, row, x, false);
+			end[runs] = x - 1;
+			parent[runs] = runs;
+			runs++;
+		}
+
+		/* runs of consecutive rows touch if they overlap once the lower
+		   one is widened by a square on either side */
+		i = prevStart;
+		j = rowStart;
+		while (i < rowStart && j < runs) {
+			if (start[i] <= end[j] + 1 && start[j] - 1 <= end[i]) {
+				long a = findRun(parent, i), b = findRun(parent, j);
+				if (a != b)
+					parent[b] = a;
+			}
+			if (end[i] < end[j] + 1)
+				i++;
+			else
+				j++;
+		}
+	}
+
+	openings = 0;
+	for (runs--; runs >= 0; runs--) {
+		if (parent[runs] == runs)
+			openings++;
+	}
+
+	free(start);
+	free(end);
+	free(parent);
+	free(zero);
+	return clicks + openings;
+}
@@ -0,0 +1,51 @@
+/*
+ * bitboard.h
+ *
+ * Contains declarations of the Bitboard struct, a copy of the mine layout of a
+ * board packed into 64-bit words, and of the word-parallel functions that
+ * analyze layouts on it, such as the 3BV the simulator reports.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "board.h"
+
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+typedef struct {
+	int width;
+	int height;
+	int words;			/* 64-bit words per row */
+	/* The plane holds height + 2 rows of words words; rows 0 and height + 1
+	   are always empty so that neighbor lookups never need a bounds check.
+	   Bit (x - 1) % 64 of word (x - 1) / 64 holds column x, and the bits past
+	   the width in the last word of every row are always clear. */
+	uint64_t *mines;
+} Bitboard;
+
+/* access the first word of row y in a plane of bb */
+#define BITROW(bb, plane, y) ((bb).plane + (long) (y) * (bb).words)
+
+/* allocate a zeroed plane for a board of the given dimensions; returns -1 if
+   the allocation fails */
+int initBitboard(Bitboard *bb, int width, int height);
+
+/* free the memory allocated for the plane */
+int freeBitboard(Bitboard *bb);
+
+/* copies the mines of board into bb, which must have the same dimensions */
+int boardToBitboard(const Board *board, Bitboard *bb);
+
+/* writes the neighbor count of every square in row y to out[0..width - 1],
+   counting 64 squares at a time */
+int bitboardCountRow(const Bitboard *bb, int y, unsigned char *out);
+
+/* returns the 3BV of the layout of bb: the fewest clicks that clear it without
+   flags, one for every opening (an area of squares without neighboring mines)
+   and one for every other square without a mine that doesn't border one;
+   returns -1 if memory runs out */
+long bitboardClicks(const Bitboard *bb);
+
+#endif /* BITBOARD_H */
@@ -5,233 +5,489 @@
  */
 
 #include <stdlib.h>
-#include <stdio.h>
-#include <ctype.h>
-#include <string.h> /* memset */
+#include <string.h> /* memset, memcmp */
 
-#include "util.h"
 #include "board.h"
+#include "perf.h"
 
 int initBoardArray(Board *board) {
-    board->array = (unsigned char **) malloc((board->width + 2) * sizeof(unsigned char *));
-	for (int i = 0; i < board->width + 2; i++) {
-		board->array[i] = (unsigned char *) malloc(board->height + 2);
-        memset(board->array[i], '+', board->height + 2);
-    }
-    return 0;
+	size_t cells = (size_t) (board->width + 2) * (board->height + 2);
+
+	/* one block for the whole board, including the sentinel border */
+	board->array = (unsigned char *) malloc(cells);
+	board->counts = (unsigned char *) malloc(cells);
+
+	/* the change list only has to cover small updates; anything bigger is
+	   cheaper to handle as a full redraw */
+	board->dirtyCapacity = (cells < DIRTY_CAPACITY) ? cells : DIRTY_CAPACITY;
+	board->dirty = (long *) malloc(board->dirtyCapacity * sizeof(long));
+
+	/* show the whole board until told otherwise */
+	board->view.x = 1;
+	board->view.y = 1;
+	board->view.width = board->width;
+	board->view.height = board->height;
+
+	if (board->array == NULL || board->counts == NULL || board->dirty == NULL) {
+		freeBoardArray(board);
+		return -1;
+	}
+
+	seedBoard(board, 0);
+	return clearBoardArray(board);
+}
+
+int clearBoardArray(Board *board) {
+	size_t cells = (size_t) (board->width + 2) * (board->height + 2);
+
+	memset(board->array, '+', cells);
+	memset(board->counts, 0, cells);
+	board->dirtyCount = 0;
+	markAllChanged(board);
+	board->seeded = false;
+	board->firstX = board->firstY = 0;
+
+	/* every square starts out covered, and none holds a mine until they are
+	   placed or set */
+	board->coveredSafe = (long) board->width * board->height;
+	return 0;
 }
 
 int freeBoardArray(Board *board) {
-    for (int i = 0; i < board->width + 2; i++)
-        free(board->array[i]);
-    free(board->array);
-    return 0;
+	free(board->array);
+	free(board->counts);
+	free(board->dirty);
+	board->array = NULL;
+	board->counts = NULL;
+	board->dirty = NULL;
+	return 0;
 }
 
-int printBoardCustom(Board board, bool hide, chtype mineAttr) {
-	int chars = 0;
-	int x, y;
+/* moves the viewport so that its top left corner is at (x, y), keeping it
+   inside the board; returns true if it moved */
+static bool moveView(Board *board, int x, int y) {
+	Viewport *view = &board->view;
 
-	/* for every element in the array */
-	for (y = 1; y <= board.height; y++) {
-		mvaddch(y, 0, '|');
-		for (x = 1; x <= board.width; x++) {
-			if (hide) {
-				/* to print hidden board */
-				addch('[' | COLOR_PAIR(0));
-				addch(']' | COLOR_PAIR(0));
-			} else {
-				if (isdigit(board.array[x][y] & MASK_CHAR)) {
-					/* if character is a number, then print space and number */
-					addch(' ' | COLOR_PAIR(5));
-					addch((board.array[x][y] & MASK_CHAR) | COLOR_PAIR(5));
-					chars++;
-				} else {
-					switch (board.array[x][y] & MASK_CHAR) {
-					case '+':
-						addch('[' | COLOR_PAIR(0));
-						addch(']' | COLOR_PAIR(0));
-						break;
-					case 'X':
-						if (mineAttr == 0) {
-							/* if no custom attributes were provided */
-							addch('>' | COLOR_PAIR(3) | A_BOLD);
-							addch('<' | COLOR_PAIR(3) | A_BOLD);
-						} else {
-							addch('|' | mineAttr);
-							addch('>' | mineAttr);
-						}
-						break;
-					case '#':
-						addch('@' | COLOR_PAIR(3) | A_BOLD);
-						addch('@' | COLOR_PAIR(3) | A_BOLD);
-						break;
-					case 'P':
-						addch('|' | COLOR_PAIR(3) | A_BOLD);
-						addch('>' | COLOR_PAIR(3) | A_BOLD);
-						break;
-					case 'F':
-						addch('|' | COLOR_PAIR(4) | A_BOLD);
-						addch('>' | COLOR_PAIR(4) | A_BOLD);
-						break;
-					default:
-						addstr("  ");
-					}
-				}
-			}
-			chars += 2;
-		}
-		if (board.width < 7) {
-			addch(' ');
-			for(x = 0; x < (7 - board.width); x++) printw("  ");
-		}
-		addch('|' | COLOR_PAIR(1));
-	}
-	
-	refresh();
-	return chars;
-}
+	if (x > board->width - view->width + 1) x = board->width - view->width + 1;
+	if (y > board->height - view->height + 1) y = board->height - view->height + 1;
+	if (x < 1) x = 1;
+	if (y < 1) y = 1;
 
-int printBoard(Board board) {
-	return printBoardCustom(board, false, (chtype) 0);
+	if (x == view->x && y == view->y)
+		return false;
+
+	view->x = x;
+	view->y = y;
+	markAllDirty(board);
+	return true;
 }
 
-int printFrame(Board board) {
-	int x;
+int setViewSize(Board *board, int width, int height) {
+	Viewport *view = &board->view;
 
-	mvaddstr(0, 0, "+= Minesweeper ");
-	for (x = 8; x < board.width; x++) addstr("==");
-	if (board.width > 7) addch('=');
-	addstr("=+");
+	if (width > board->width) width = board->width;
+	if (height > board->height) height = board->height;
+	if (width < 1) width = 1;
+	if (height < 1) height = 1;
 
-	mvaddstr(board.height + 1, 0, "+==============");
-	for (x = 8; x < board.width; x++) addstr("==");
-	if (board.width > 7) addch('=');
-	addstr("=+");
+	view->width = width;
+	view->height = height;
+	moveView(board, view->x, view->y);
+	markAllDirty(board);
 	return 0;
 }
 
-int initializeMines(Board *board) {
-	int mineCount = 0;
-	int x, y;
+bool scrollView(Board *board, int dx, int dy) {
+	return moveView(board, board->view.x + dx, board->view.y + dy);
+}
+
+bool scrollToSquare(Board *board, int x, int y) {
+	const Viewport *view = &board->view;
+	int vx = view->x, vy = view->y;
+
+	if (x < vx) vx = x;
+	if (x >= vx + view->width) vx = x - view->width + 1;
+	if (y < vy) vy = y;
+	if (y >= vy + view->height) vy = y - view->height + 1;
+
+	return moveView(board, vx, vy);
+}
+
+bool inView(Board board, int x, int y) {
+	return board.view.x <= x && x < board.view.x + board.view.width
+		&& board.view.y <= y && y < board.view.y + board.view.height;
+}
+
+/* adds delta to the neighbor counts of the 3x3 block centered on (x, y) */
+static void addToCounts(Board *board, int x, int y, int delta) {
+	int h, k;
+
+	for (k = -1; k <= 1; k++) {
+		for (h = -1; h <= 1; h++) {
+			COUNT(*board, x + h, y + k) += delta;
+		}
+	}
+}
+
+void seedBoard(Board *board, uint64_t seed) {
+	board->seed = seed;
+	seedRng(&board->rng, seed);
+}
+
+/* places board->mineCount mines on squares other than the ones listed in
+   excluded, which must be sorted indices into the unpadded width * height grid */
+static int placeMines(Board *board, const long *excluded, int excludedCount) {
+	long cells = (long) board->width * board->height;
+	long allowed = cells - excludedCount;
+	long mineCount = board->mineCount;
+	long i, j;
+	int k, x, y;
+	Rng fresh;
+
+	/* the layout only follows from the seed if nothing has been drawn from
+	   the generator since it was seeded */
+	seedRng(&fresh, board->seed);
+	board->seeded = memcmp(&fresh, &board->rng, sizeof(Rng)) == 0;
 
 	for (y = 1; y < board->height + 1; y++) {
 		for (x = 1; x < board->width + 1; x++) {
 			/* unset mine bit */
-			board->array[x][y] &= ~MASK_MINE;
+			CELL(*board, x, y) &= ~MASK_MINE;
 		}
 	}
+	memset(board->counts, 0, (size_t) (board->width + 2) * (board->height + 2));
+
+	/* always leave at least one square free */
+	if (mineCount > allowed) mineCount = allowed;
+	if (mineCount > cells - 1) mineCount = cells - 1;
+	if (mineCount < 0) mineCount = 0;
+
+	/* Floyd's sampling algorithm: pick mineCount distinct squares out of the
+	   allowed ones using exactly one random number each, whatever the density.
+	   The mine bits themselves serve as the set of squares already chosen. */
+	for (j = allowed - mineCount; j < allowed; j++) {
+		i = boundedRandom(&board->rng, j + 1);
+		for (k = 0; k < excludedCount; k++) {
+			/* skip over the excluded squares */
+			if (i >= excluded[k]) i++;
+		}
+		x = i % board->width + 1;
+		y = i / board->width + 1;
 
-	while (mineCount < board->mineCount) {
-		x = rand() % (board->width) + 1;
-		y = rand() % (board->height) + 1;
-		if (!(board->array[x][y] & MASK_MINE)) {
-			board->array[x][y] |= MASK_MINE;
-			mineCount++;
+		if (CELL(*board, x, y) & MASK_MINE) {
+			/* square i was already taken, so square j is guaranteed free */
+			i = j;
+			for (k = 0; k < excludedCount; k++) {
+				if (i >= excluded[k]) i++;
+			}
+			x = i % board->width + 1;
+			y = i / board->width + 1;
 		}
-		if (mineCount > (board->width * board->height) - 2) break;
+		CELL(*board, x, y) |= MASK_MINE;
+		addToCounts(board, x, y, 1);
 	}
 
+	recountCovered(board);
 	return mineCount;
 }
 
+int initializeMines(Board *board) {
+	board->firstX = board->firstY = 0;
+	return placeMines(board, NULL, 0);
+}
+
+int initializeMinesAround(Board *board, int x, int y) {
+	long excluded[9];
+	int count = 0;
+	int h, k;
+
+	/* keep the whole 3x3 block clear, as long as that leaves enough room */
+	for (k = -1; k <= 1; k++) {
+		for (h = -1; h <= 1; h++) {
+			if (x + h < 1 || board->width < x + h || y + k < 1 || board->height < y + k)
+				continue;
+			excluded[count++] = (long) (y + k - 1) * board->width + (x + h - 1);
+		}
+	}
+
+	/* otherwise, only keep the square itself clear */
+	if (board->mineCount > (long) board->width * board->height - count) {
+		excluded[0] = (long) (y - 1) * board->width + (x - 1);
+		count = 1;
+	}
+
+	board->firstX = x;
+	board->firstY = y;
+	return placeMines(board, excluded, count);
+}
+
 int overlayMines(Board *board) {
 	int x, y;
 	for (y = 1; y < board->height + 2; y++) {
 		for (x = 1; x < board->width + 2; x++) {
-			if (board->array[x][y] & MASK_MINE) {
-				if ((board->array[x][y] & MASK_CHAR) == 'P') {
-					board->array[x][y] &= ~MASK_CHAR;	/* clear char */
-					board->array[x][y] |= 'F';			/* assign char */
-				} else if ((board->array[x][y] & MASK_CHAR) != '#') {
-					board->array[x][y] &= ~MASK_CHAR;	/* clear char */
-					board->array[x][y] |= 'X';			/* assign char */
-				}
+			if (CELL(*board, x, y) & MASK_MINE) {
+				if ((CELL(*board, x, y) & MASK_CHAR) == 'P')
+					setSquare(board, x, y, 'F');
+				else if ((CELL(*board, x, y) & MASK_CHAR) != '#')
+					setSquare(board, x, y, 'X');
 			}
 		}
 	}
 	return 0;
 }
 
-int numMines(Board board, int x, int y) {
-	int numOfMines = 0;
-	int h, k;
+void markDirty(Board *board, int x, int y) {
+	if (board->allChanged)
+		return;
+	if (board->dirtyCount == board->dirtyCapacity) {
+		markAllChanged(board);
+		return;
+	}
+	board->dirty[board->dirtyCount++] = (long) y * (board->width + 2) + x;
+}
+
+void markAllDirty(Board *board) {
+	board->allDirty = true;
+}
+
+void markAllChanged(Board *board) {
+	board->allDirty = true;
+	board->allChanged = true;
+}
+
+void clearDirty(Board *board) {
+	board->dirtyCount = 0;
+	board->allDirty = false;
+	board->allChanged = false;
+}
+
+void setSquare(Board *board, int x, int y, unsigned char c) {
+	CELL(*board, x, y) &= ~MASK_CHAR;	/* clear char */
+	CELL(*board, x, y) |= c;			/* assign char */
+	markDirty(board, x, y);
+}
+
+int computeCounts(Board *board) {
+	const long stride = board->width + 2;
+	int x, y;
+
+	/* mines that were set directly don't follow from the seed */
+	board->seeded = false;
+	memset(board->counts, 0, (size_t) stride * (board->height + 2));
+	for (y = 1; y <= board->height; y++) {
+		for (x = 1; x <= board->width; x++) {
+			if (CELL(*board, x, y) & MASK_MINE)
+				addToCounts(board, x, y, 1);
+		}
+	}
+	return 0;
+}
+
+int setMine(Board *board, int x, int y, bool mine) {
+	unsigned char c;
 
+	if (x < 1 || board->width < x || y < 1 || board->height < y)
+		return -1;
+	if (((CELL(*board, x, y) & MASK_MINE) != 0) == mine)
+		return 0;
+	board->seeded = false;
+
+	/* a covered square that gains or loses a mine changes the number of
+	   squares left to clear */
+	c = CELL(*board, x, y) & MASK_CHAR;
+	if (mine) {
+		CELL(*board, x, y) |= MASK_MINE;
+		addToCounts(board, x, y, 1);
+		if (c == '+' || c == 'P') board->coveredSafe--;
+	} else {
+		CELL(*board, x, y) &= ~MASK_MINE;
+		addToCounts(board, x, y, -1);
+		if (c == '+' || c == 'P') board->coveredSafe++;
+	}
+	return 0;
+}
+
+int numMines(Board board, int x, int y) {
 	/* return 0 if the coordinate being read is outside the printable board region */
 	if (x < 1 || board.width < x || y < 1 || board.height < y)
 		return 0;
 
+	return COUNT(board, x, y);
+}
 
-	for (k = -1; k <= 1; k++) {
-		for (h = -1; h <= 1; h++) {
-			if (board.array[x + h][y + k] & MASK_MINE) numOfMines++;
+/* uncovers the square at (x, y), assuming it is covered and holds no mine, and
+   returns its number of neighboring mines */
+static int openSquare(Board *board, int x, int y) {
+	int neighbors = COUNT(*board, x, y);
+
+	setSquare(board, x, y, (neighbors > 0)
+		? '0' + neighbors
+		: ' ');
+	board->coveredSafe--;
+	return neighbors;
+}
+
+/* the squares openSquares still has to fill from; every seed is an empty
+   square that was opened when it was pushed, so each square is pushed at most
+   once */
+typedef struct {
+	long *seeds;
+	size_t top, capacity;
+	bool missed;	/* a seed was dropped because the stack couldn't grow */
+} Fill;
+
+/* opens the covered square at (x, y), and pushes it if it is empty; returns 1 */
+static int fillSquare(Board *board, Fill *fill, int x, int y) {
+	long *grown;
+
+	if (openSquare(board, x, y) > 0)
+		return 1;
+
+	if (fill->top == fill->capacity) {
+		grown = (long *) realloc(fill->seeds, 2 * fill->capacity * sizeof(long));
+		if (grown == NULL) {
+			/* the square is open, so a sweep of the board finds it again */
+			fill->missed = true;
+			return 1;
 		}
+		fill->seeds = grown;
+		fill->capacity *= 2;
+	}
+	fill->seeds[fill->top++] = (long) y * (board->width + 2) + x;
+	return 1;
+}
+
+/* opens the span of covered empty squares through the seed at (x, y) and
+   everything around it. Of each run of covered empty squares in the rows
+   above and below, only the first is opened and pushed, since the span
+   through it takes in the rest. Returns the number of squares opened. */
+static int fillSpan(Board *board, Fill *fill, int x, int y) {
+	int left = x, right = x;
+	int opened = 0;
+	int h, k;
+	bool inRun;
+
+	while (left > 1 && (CELL(*board, left - 1, y) & MASK_CHAR) == '+' && COUNT(*board, left - 1, y) == 0) {
+		openSquare(board, --left, y);
+		opened++;
 	}
+	while (right < board->width && (CELL(*board, right + 1, y) & MASK_CHAR) == '+' && COUNT(*board, right + 1, y) == 0) {
+		openSquare(board, ++right, y);
+		opened++;
+	}
+
+	/* the numbers at either end of the span */
+	if (left > 1 && (CELL(*board, left - 1, y) & MASK_CHAR) == '+')
+		opened += fillSquare(board, fill, left - 1, y);
+	if (right < board->width && (CELL(*board, right + 1, y) & MASK_CHAR) == '+')
+		opened += fillSquare(board, fill, right + 1, y);
 
-	return numOfMines;
+	for (k = -1; k <= 1; k += 2) {
+		if (y + k < 1 || board->height < y + k)
+			continue;
+		inRun = false;
+		for (h = (left > 1) ? left - 1 : 1; h <= right + 1 && h <= board->width; h++) {
+			if ((CELL(*board, h, y + k) & MASK_CHAR) != '+') {
+				inRun = false;
+			} else if (COUNT(*board, h, y + k) > 0) {
+				opened += fillSquare(board, fill, h, y + k);
+				inRun = false;
+			} else if (!inRun) {
+				opened += fillSquare(board, fill, h, y + k);
+				inRun = true;
+			}
+		}
+	}
+	return opened;
 }
 
 int openSquares(Board *board, int x, int y) {
-	/* used for relative navigation of the board array */
+	const long stride = board->width + 2;
+	Fill fill;
+	int opened = 1;
 	int h, k;
-	int neighbors = 0;
-	
+	PERF_START(start);
+
 	/* return if either index is outside the printable board boundaries */
 	if (x < 1 || board->width < x || y < 1 || board->height < y)
 		return -1;
 
-	/* return if this coordinate is flagged */
-	if ((board->array[x][y] & MASK_CHAR) == 'P')
-		return 0;
-
-	/* now that all is well, count the number of neighbors.
-	   note that this function assumes that there is not a mine at (x, y), 
+	/* only covered squares can be opened; this also skips flags.
+	   note that this function assumes that there is not a mine at (x, y),
 	   since the game function is responsible for handling that first */
-	neighbors = numMines(*board, x, y);
-	if (neighbors > 0) {
-		board->array[x][y] &= ~MASK_CHAR;		/* clear char */
-		board->array[x][y] |= '0' + neighbors;	/* assign char */
+	if ((CELL(*board, x, y) & MASK_CHAR) != '+')
 		return 0;
-	} else {
-		/* if this coordinate has already been marked as opened by the openSquares 
-		   function, then return, to avoid infinite recursion. Otherwise, mark it. */
-		if ((board->array[x][y] & MASK_CHAR) == ' ') {
-			return 0;
-		} else {
-			board->array[x][y] &= ~MASK_CHAR;	/* clear char */
-			board->array[x][y] |= ' ';			/* assign char */
+
+	if (COUNT(*board, x, y) > 0) {
+		openSquare(board, x, y);
+		PERF_STOP(PERF_OPEN, start, 1);
+		return 1;
+	}
+
+	fill.top = 0;
+	fill.capacity = 64;
+	fill.missed = false;
+	fill.seeds = (long *) malloc(fill.capacity * sizeof(long));
+	if (fill.seeds == NULL)
+		return -1;
+	fillSquare(board, &fill, x, y);
+
+	for (;;) {
+		while (fill.top > 0) {
+			long i = fill.seeds[--fill.top];
+			opened += fillSpan(board, &fill, i % stride, i / stride);
 		}
-		/* at this point, we know there are no mines nearby, so we will recursively
-		   keep opening squares until all the necessary squares are open. */
-		for (k = -1; k <= 1; k++) {
-			for (h = -1; h <= 1; h++) {
-				openSquares(board, x + h, y + k);
+		if (!fill.missed)
+			break;
+
+		/* Memory ran out for some seeds, so find them again as the empty
+		   squares that still have covered neighbors. Every round fills from at
+		   least one of them, so this finishes the area, if slowly. */
+		fill.missed = false;
+		for (y = 1; y <= board->height; y++) {
+			for (x = 1; x <= board->width; x++) {
+				if ((CELL(*board, x, y) & MASK_CHAR) != ' ')
+					continue;
+				for (k = -1; k <= 1; k++) {
+					for (h = -1; h <= 1; h++) {
+						if (x + h < 1 || board->width < x + h || y + k < 1 || board->height < y + k
+								|| (CELL(*board, x + h, y + k) & MASK_CHAR) != '+')
+							continue;
+						if (fill.top == fill.capacity)
+							fill.missed = true;
+						else
+							fill.seeds[fill.top++] = y * stride + x;
+						h = k = 2;
+					}
+				}
 			}
 		}
 	}
 
-	
-
-	return 0;
+	free(fill.seeds);
+	PERF_STOP(PERF_OPEN, start, opened);
+	return opened;
 }
 
-bool allClear(Board board) {
+long recountCovered(Board *board) {
 	int x, y;
-	char buf;
-
-	for (y = 1; y <= board.height; y++) {
-		for (x = 1; x <= board.width; x++) {
-			buf = board.array[x][y];
-			if (!(buf & MASK_MINE) && ((buf & MASK_CHAR) == '+' || (buf & MASK_CHAR) == 'P')) {
-				/* return false if a square has no mine but is still covered */
-				return false;
-			}
+	unsigned char buf;
+	PERF_START(start);
+
+	board->coveredSafe = 0;
+	for (y = 1; y <= board->height; y++) {
+		for (x = 1; x <= board->width; x++) {
+			buf = CELL(*board, x, y);
+			if (!(buf & MASK_MINE) && ((buf & MASK_CHAR) == '+' || (buf & MASK_CHAR) == 'P'))
+				board->coveredSafe++;
 		}
 	}
 
-	return true;
+	PERF_STOP(PERF_RECOUNT, start, (uint64_t) board->width * board->height);
+	return board->coveredSafe;
 }
 
-int printBlank(Board board) {
-	return printBoardCustom(board, true, (chtype) 0);
+bool allClear(Board board) {
+	PERF_COUNT(PERF_ALL_CLEAR, 0);
+	return board.coveredSafe == 0;
 }
@@ -1,55 +1,145 @@
 /* 
  * board.h
  * 
- * Contains declarations of the Board struct, and functions to manage, manipulate,
- * and print the struct.
+ * Contains declarations of the Board struct, and functions to manage and
+ * manipulate the struct. Nothing in here depends on curses; the functions that
+ * print a Board are declared in render.h.
  */
 
-#include <curses.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+#include "rng.h"
 
 #ifndef BOARD_H
 #define BOARD_H
 
+/* masks for accessing mine data */
+#define MASK_MINE	0x80
+#define MASK_CHAR	0x7F
+
+/* the part of the board that is drawn on screen */
+typedef struct {
+    int x, y;				/* board coordinates of the top left square shown */
+    int width, height;		/* number of squares shown in each direction */
+} Viewport;
+
 typedef struct {
     int width;
     int height;
     long mineCount;
-    unsigned char ** array;
+    long coveredSafe;		/* squares without a mine that are still covered */
+    unsigned char *array;	/* row-major cells, with a one-cell border on all sides */
+    unsigned char *counts;	/* mines in the 3x3 block around each cell, same layout */
+    uint64_t seed;			/* seed last given to seedBoard */
+    Rng rng;				/* generator used to place the mines */
+    bool seeded;			/* the mines were placed straight from seed, so seedBoard and
+							   initializeMinesAround(firstX, firstY) place them again */
+    int firstX, firstY;		/* the square kept clear of mines, or 0 for initializeMines */
+    long *dirty;			/* array indices of squares changed since the last redraw */
+    long dirtyCount;
+    long dirtyCapacity;
+    bool allDirty;			/* too much has changed to list, redraw everything */
+    bool allChanged;		/* squares changed without being listed, so anything
+							   worked out from the list is stale */
+    Viewport view;			/* visible part of the board, the whole board by default */
 } Board;
 
-/* allocate memory for array member based on value of dimension members */
+/* the most changed squares tracked individually before falling back to a full
+   redraw */
+#define DIRTY_CAPACITY 4096
+
+/* the largest width or height the custom dimensions prompt accepts; the
+   largest such board takes a few hundred MB */
+#define BOARD_MAX_SIDE 10000
+
+/* access the cell at (x, y); the printable region is 1 <= x <= width and
+   1 <= y <= height, while row and column 0 and width/height + 1 are the
+   sentinel border */
+#define CELL(board, x, y) \
+	((board).array[(long) (y) * ((board).width + 2) + (x)])
+
+/* access the cached neighbor count of the cell at (x, y) */
+#define COUNT(board, x, y) \
+	((board).counts[(long) (y) * ((board).width + 2) + (x)])
+
+/* allocate memory for array member based on value of dimension members;
+   returns -1 if the allocation fails */
 int initBoardArray(Board *board);
 
+/* cover every square and remove all mines, reusing the memory that is already
+   allocated */
+int clearBoardArray(Board *board);
+
 /* free the memory allocated for the array member */
 int freeBoardArray(Board *board);
 
-/* Prints a graphical representation of board, displaying mines as mineChar.
-   If hide is true, all squared will be printed as "[]" */
-int printBoardCustom(Board board, bool hide, chtype mineAttr);
+/* records that the square at (x, y) has to be redrawn */
+void markDirty(Board *board, int x, int y);
+
+/* records that the whole board has to be redrawn; the list of changed squares
+   is still kept, since it isn't only used for drawing */
+void markAllDirty(Board *board);
 
-/* printBoard with default arguments for hide and mineChar */
-int printBoard(Board board);
+/* records that any square may have changed without being listed, which also
+   means the whole board has to be redrawn */
+void markAllChanged(Board *board);
 
-/* randomize locations of mines on the board */
+/* empties the list of changed squares once they have all been handled */
+void clearDirty(Board *board);
+
+/* replaces the character of the square at (x, y), keeping its mine bit, and
+   marks it for redrawing */
+void setSquare(Board *board, int x, int y, unsigned char c);
+
+/* reseed the generator used by initializeMines; the same seed always produces
+   the same sequence of boards. Mines placed by initializeMines or
+   initializeMinesAround right after seedBoard are marked as seeded, so that
+   they can be stored as the seed and the square kept clear. */
+void seedBoard(Board *board, uint64_t seed);
+
+/* randomize locations of mines on the board, returning the number placed */
 int initializeMines(Board *board);
 
+/* randomize locations of mines on the board, keeping (x, y) and, when there is
+   room for it, its neighbors free of mines; returns the number placed */
+int initializeMinesAround(Board *board, int x, int y);
+
 /* overlay the locations of mines onto the game board */
 int overlayMines(Board *board);
 
+/* rebuilds the neighbor counts from the mine bits in the array; call this after
+   setting mine bits directly */
+int computeCounts(Board *board);
+
+/* adds or removes the mine at (x, y), updating the neighbor counts around it */
+int setMine(Board *board, int x, int y, bool mine);
+
 /* returns number of mines adjacent to (x, y) */
 int numMines(Board board, int x, int y);
 
-/* recursively uncovers squares on board starting at (x, y) */
+/* uncovers squares on board starting at (x, y), flood filling through squares
+   with no neighboring mines; returns the number of squares opened, or -1 if
+   (x, y) is out of bounds */
 int openSquares(Board *board, int x, int y);
 
+/* recounts the covered squares without a mine, storing the result in
+   board->coveredSafe; call this after modifying the array directly */
+long recountCovered(Board *board);
+
 /* returns true if the minefield has been cleared */
 bool allClear(Board board);
 
-/* print a blank game board of dimensions defined in board */
-int printBlank(Board board);
+/* sets the number of squares shown on screen, clamped to the board size */
+int setViewSize(Board *board, int width, int height);
+
+/* moves the viewport by (dx, dy) squares; returns true if it moved */
+bool scrollView(Board *board, int dx, int dy);
+
+/* moves the viewport just enough to show (x, y); returns true if it moved */
+bool scrollToSquare(Board *board, int x, int y);
 
-/* prints the top and bottom of the board frame for convenience */
-int printFrame(Board board);
+/* returns true if (x, y) is inside the viewport */
+bool inView(Board board, int x, int y);
 
 #endif /* BOARD_H */
\ No newline at end of file
@@ -0,0 +1,177 @@
+/*
+ * challenge.c
+ *
+ * Defines the functions that turn a board into a challenge code and back
+ */
+
+#include <ctype.h>	/* toupper */
+#include <string.h>	/* memset, strchr */
+
+#include "challenge.h"
+#include "engine.h"
+
+static const char alphabet[] = "0123456789ABCDEFGHJKMNPQRSTVWXYZ";
+
+/* the most bytes a challenge takes before it is written in base 32 */
+#define CHALLENGE_BYTES_MAX	40
+
+static int putVarint(unsigned char *data, int size, uint64_t value) {
+	while (value >= 0x80) {
+		data[size++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	data[size++] = value;
+	return size;
+}
+
+/* reads a varint at *position, moving past it; returns -1 if it runs past the
+   end of the data or is too long */
+static int getVarint(const unsigned char *data, int size, int *position, uint64_t *value) {
+	int shift;
+
+	*value = 0;
+	for (shift = 0; shift < 64 && *position < size; shift += 7) {
+		unsigned char byte = data[(*position)++];
+		*value |= (uint64_t) (byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return 0;
+	}
+	return -1;
+}
+
+/* the value of a base 32 character, or -1 if it isn't one */
+static int digitValue(char c) {
+	const char *p;
+
+	c = toupper((unsigned char) c);
+	if (c == 'O')
+		c = '0';
+	else if (c == 'I' || c == 'L')
+		c = '1';
+	p = strchr(alphabet, c);
+	return (p != NULL && c != '\0') ? p - alphabet : -1;
+}
+
+int boardChallenge(const Board *board, Challenge *challenge) {
+	if (!board->seeded || board->firstX == 0)
+		return -1;
+	challenge->width = board->width;
+	challenge->height = board->height;
+	challenge->qtyMines = board->mineCount;
+	challenge->seed = board->seed;
+	challenge->firstX = board->firstX;
+	challenge->firstY = board->firstY;
+	return 0;
+}
+
+void encodeChallenge(const Challenge *challenge, char *code) {
+	unsigned char data[CHALLENGE_BYTES_MAX];
+	uint32_t crc, bits = 0;
+	int size = 0, count = 0, length = 0, i;
+
+	data[size++] = CHALLENGE_VERSION;
+	size = putVarint(data, size, challenge->width);
+	size = putVarint(data, size, challenge->height);
+	size = putVarint(data, size, challenge->qtyMines);
+	size = putVarint(data, size, challenge->firstX);
+	size = putVarint(data, size, challenge->firstY);
+	for (i = 0; i < 8; i++)
+		data[size++] = (challenge->seed >> (8 * i)) & 0xFF;
+	crc = crc32(0, data, size);
+	data[size++] = crc & 0xFF;
+	data[size++] = (crc >> 8) & 0xFF;
+
+	/* 5 bits at a time, padding the last character with zeros */
+	for (i = 0; i < size; i++) {
+		bits = (bits << 8) | data[i];
+		count += 8;
+		while (count >= 5) {
+			count -= 5;
+			code[length++] = alphabet[(bits >> count) & 0x1F];
+		}
+	}
+	if (count > 0)
+		code[length++] = alphabet[(bits << (5 - count)) & 0x1F];
+	code[length] = '\0';
+}
+
+int decodeChallenge(const char *code, Challenge *challenge) {
+	unsigned char data[CHALLENGE_BYTES_MAX];
+	uint64_t width, height, qtyMines, firstX, firstY;
+	uint32_t crc, bits = 0;
+	int size = 0, count = 0, position = 1, i;
+
+	for (; *code != '\0'; code++) {
+		int value;
+		if (*code == '-')
+			continue;
+		value = digitValue(*code);
+		if (value == -1)
+			return -1;
+		bits = (bits << 5) | value;
+		count += 5;
+		if (count >= 8) {
+			if (size == CHALLENGE_BYTES_MAX)
+				return -1;
+			count -= 8;
+			data[size++] = (bits >> count) & 0xFF;
+		}
+	}
+	/* whatever is left over is padding */
+	if (count >= 5 || (bits & ((1u << count) - 1)) != 0 || size < 3)
+		return -1;
+
+	crc = crc32(0, data, size - 2);
+	if (data[0] != CHALLENGE_VERSION
+			|| data[size - 2] != (crc & 0xFF) || data[size - 1] != ((crc >> 8) & 0xFF))
+		return -1;
+	size -= 2;
+
+	if (getVarint(data, size, &position, &width) == -1
+			|| getVarint(data, size, &position, &height) == -1
+			|| getVarint(data, size, &position, &qtyMines) == -1
+			|| getVarint(data, size, &position, &firstX) == -1
+			|| getVarint(data, size, &position, &firstY) == -1
+			|| position + 8 != size)
+		return -1;
+	if (width < 1 || CHALLENGE_MAX_SIDE < width || height < 1 || CHALLENGE_MAX_SIDE < height
+			|| qtyMines >= width * height
+			|| firstX < 1 || width < firstX || firstY < 1 || height < firstY)
+		return -1;
+
+	challenge->width = width;
+	challenge->height = height;
+	challenge->qtyMines = qtyMines;
+	challenge->firstX = firstX;
+	challenge->firstY = firstY;
+	challenge->seed = 0;
+	for (i = 7; i >= 0; i--)
+		challenge->seed = (challenge->seed << 8) | data[position + i];
+	return 0;
+}
+
+int challengeSave(const Challenge *challenge, Savegame *save) {
+	Engine engine;
+
+	if (initEngine(&engine, challenge->width, challenge->height, challenge->qtyMines, challenge->seed) == -1)
+		return -1;
+	/* opening the first square places the mines around it from the seed,
+	   just like in the game the code came from */
+	engineOpen(&engine, challenge->firstX, challenge->firstY);
+
+	memset(save, 0, sizeof(Savegame));
+	save->width = challenge->width;
+	save->height = challenge->height;
+	save->qtyMines = challenge->qtyMines;
+	save->gameBools = MASK_FIRST_CLICK;
+	save->cy = challenge->firstY;
+	save->cx = 2 * challenge->firstX - 1;
+	save->seed = challenge->seed;
+	save->slot = -1;
+	if (setGameData(engine.board, save) == -1) {
+		freeEngine(&engine);
+		return -1;
+	}
+	freeEngine(&engine);
+	return 0;
+}
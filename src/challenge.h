@@ -0,0 +1,61 @@
+/*
+ * challenge.h
+ *
+ * Contains declarations of the Challenge struct, which names one exact board
+ * by the seed its mines were placed from and the square they were placed
+ * around, and of the functions that turn it into a short code that can be
+ * shared and played from.
+ */
+
+#include <stdint.h>
+
+#include "board.h"
+#include "savegame.h"
+
+#ifndef CHALLENGE_H
+#define CHALLENGE_H
+
+/* A code is the bytes below written in Crockford's base 32, 5 bits per
+   character, most significant first:
+
+	size	field
+	1		format version, CHALLENGE_VERSION
+	varint	width
+	varint	height
+	varint	qtyMines
+	varint	firstX
+	varint	firstY
+	8		seed, little-endian
+	2		low bytes of the CRC-32 of everything before, little-endian
+
+   Decoding ignores case and dashes, and reads O as 0 and I and L as 1. */
+#define CHALLENGE_VERSION	1
+#define CHALLENGE_CODE_MAX	64	/* room for the longest code and its '\0' */
+
+/* the largest boards a code is accepted for */
+#define CHALLENGE_MAX_SIDE	65535
+
+typedef struct {
+	int32_t width, height;
+	int32_t qtyMines;
+	uint64_t seed;
+	int32_t firstX, firstY;	/* the square that is opened to start with */
+} Challenge;
+
+/* fills in the challenge of the board; returns -1 if its mines weren't placed
+   around a square straight from its seed */
+int boardChallenge(const Board *board, Challenge *challenge);
+
+/* writes the code of challenge into code, which has room for
+   CHALLENGE_CODE_MAX bytes */
+void encodeChallenge(const Challenge *challenge, char *code);
+
+/* reads a code into challenge; returns -1 if it isn't a valid code */
+int decodeChallenge(const char *code, Challenge *challenge);
+
+/* sets up save as the board of challenge with its first square opened, ready
+   to be played by game(); returns -1 if memory runs out.
+   REMEMBER TO CALL freeGameData */
+int challengeSave(const Challenge *challenge, Savegame *save);
+
+#endif /* CHALLENGE_H */
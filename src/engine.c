@@ -0,0 +1,165 @@
+/*
+ * engine.c
+ *
+ * Defines the rules of the game on top of the Board functions
+ */
+
+#include <ctype.h>	/* isdigit */
+
+#include "engine.h"
+#include "generator.h"
+
+/* records a win once every square without a mine has been opened */
+static void updateStatus(Engine *engine) {
+	if (engine->status == STATUS_PLAYING && allClear(engine->board))
+		engine->status = STATUS_WON;
+}
+
+int initEngine(Engine *engine, int width, int height, long mineCount, uint64_t seed) {
+	engine->board.width = width;
+	engine->board.height = height;
+	engine->board.mineCount = mineCount;
+	engine->noGuess = false;
+	engine->fellBack = false;
+	if (initBoardArray(&engine->board) == -1)
+		return -1;
+	return resetEngine(engine, seed);
+}
+
+int resetEngine(Engine *engine, uint64_t seed) {
+	clearBoardArray(&engine->board);
+	seedBoard(&engine->board, seed);
+
+	/* a fallback only lasts for the game it happened in */
+	if (engine->fellBack)
+		engine->noGuess = true;
+	engine->fellBack = false;
+	engine->flagsPlaced = 0;
+	engine->firstClick = false;
+	engine->status = STATUS_PLAYING;
+	return 0;
+}
+
+int freeEngine(Engine *engine) {
+	return freeBoardArray(&engine->board);
+}
+
+int engineOpen(Engine *engine, int x, int y) {
+	Board *board = &engine->board;
+	int opened;
+
+	if (x < 1 || board->width < x || y < 1 || board->height < y)
+		return -1;
+
+	/* flagged squares can't be opened */
+	if (engine->status != STATUS_PLAYING || (CELL(*board, x, y) & MASK_CHAR) == 'P')
+		return 0;
+
+	/* Mines are only placed once the first square is opened, and never next
+	   to it, so the player can't die on the first move and the first click
+	   always opens an area when the density allows it. */
+	if (!engine->firstClick) {
+		if (!engine->noGuess)
+			initializeMinesAround(board, x, y);
+		else if (generateNoGuess(board, x, y, 0, GENERATOR_BUDGET) != GENERATOR_FOUND) {
+			/* the board might need a guess after all, so don't claim otherwise */
+			engine->noGuess = false;
+			engine->fellBack = true;
+		}
+		engine->firstClick = true;
+	}
+
+	if (CELL(*board, x, y) & MASK_MINE) {
+		setSquare(board, x, y, '#');
+		engine->status = STATUS_LOST;
+		return 0;
+	}
+
+	opened = openSquares(board, x, y);
+	updateStatus(engine);
+	return opened;
+}
+
+int engineFlag(Engine *engine, int x, int y) {
+	Board *board = &engine->board;
+
+	if (x < 1 || board->width < x || y < 1 || board->height < y)
+		return 0;
+	if (engine->status != STATUS_PLAYING)
+		return 0;
+
+	if ((CELL(*board, x, y) & MASK_CHAR) == '+') {
+		setSquare(board, x, y, 'P');
+		engine->flagsPlaced++;
+		return 1;
+	} else if ((CELL(*board, x, y) & MASK_CHAR) == 'P') {
+		setSquare(board, x, y, '+');
+		engine->flagsPlaced--;
+		return -1;
+	}
+	return 0;
+}
+
+int engineChord(Engine *engine, int x, int y) {
+	Board *board = &engine->board;
+	unsigned char c;
+	int adjacent = 0;
+	int opened = 0;
+	int h, k;
+
+	if (x < 1 || board->width < x || y < 1 || board->height < y)
+		return 0;
+	c = CELL(*board, x, y) & MASK_CHAR;
+	if (engine->status != STATUS_PLAYING || !isdigit(c))
+		return 0;
+
+	/* count number of adjacent flags */
+	for (k = -1; k <= 1; k++) {
+		for (h = -1; h <= 1; h++) {
+			if ((CELL(*board, x + h, y + k) & MASK_CHAR) == 'P')
+				adjacent++;
+		}
+	}
+	/* the number of adjacent flags has to match the number on the square */
+	if (adjacent != c - '0')
+		return -1;
+
+	for (k = -1; k <= 1; k++) {
+		for (h = -1; h <= 1; h++) {
+			/* for each adjacent square */
+			if ((CELL(*board, x + h, y + k) & MASK_CHAR) != '+')
+				continue;
+			if (!(CELL(*board, x + h, y + k) & MASK_MINE)) {
+				/* if the square is not a mine */
+				opened += openSquares(board, x + h, y + k);
+			} else {
+				/* if the square is a mine */
+				setSquare(board, x + h, y + k, '#');
+				engine->status = STATUS_LOST;
+			}
+		}
+	}
+
+	updateStatus(engine);
+	return opened;
+}
+
+int engineAct(Engine *engine, int action, int x, int y) {
+	Board *board = &engine->board;
+
+	/* opening or flagging a number chords it */
+	if ((action == ACTION_OPEN || action == ACTION_FLAG)
+			&& 1 <= x && x <= board->width && 1 <= y && y <= board->height
+			&& isdigit(CELL(*board, x, y) & MASK_CHAR))
+		action = ACTION_AUTO;
+
+	switch (action) {
+	case ACTION_OPEN:
+		return engineOpen(engine, x, y);
+	case ACTION_FLAG:
+		return engineFlag(engine, x, y);
+	case ACTION_AUTO:
+		return engineChord(engine, x, y);
+	}
+	return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * engine.h
+ *
+ * Contains declarations of the Engine struct, which holds everything needed to
+ * play one game of Minesweeper, and of the functions that apply the rules of
+ * the game to it. The engine never touches the terminal and keeps no global
+ * state, so any number of games can be played side by side.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "board.h"
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+/* macros for game actions */
+#define ACTION_NONE		0	/* no action */
+#define ACTION_OPEN		1	/* open the current square */
+#define ACTION_FLAG		2	/* place a flag on the current square */
+#define ACTION_AUTO		3	/* automatically open adjacent squares */
+#define ACTION_ESCAPE	4	/* open the pause menu */
+#define ACTION_SAVE		5	
+
+/* macros for the status of a game */
+#define STATUS_PLAYING	0
+#define STATUS_WON		1
+#define STATUS_LOST		2
+
+typedef struct {
+	Board board;		/* the minefield */
+	int flagsPlaced;	/* number of flags placed */
+	bool firstClick;	/* the first square has been opened and the mines placed */
+	int status;			/* one of the STATUS_ macros */
+	bool noGuess;		/* place the mines so that the game never needs a guess */
+	bool fellBack;		/* noGuess was set, but an ordinary board had to be placed */
+} Engine;
+
+/* set up a new game with no mines placed yet; the mines are placed by the
+   first call to engineOpen, using the generator seeded with seed. Returns -1 if
+   the board can't be allocated. noGuess starts out false, and is kept by
+   resetEngine, which also restores it after a fallback. */
+int initEngine(Engine *engine, int width, int height, long mineCount, uint64_t seed);
+
+/* start a new game on the board that is already allocated, with the mines to
+   be placed using the generator seeded with seed */
+int resetEngine(Engine *engine, uint64_t seed);
+
+/* free the memory allocated for the board */
+int freeEngine(Engine *engine);
+
+/* opens the square at (x, y), placing the mines first if this is the first
+   square opened, with generateNoGuess if noGuess is set. If no layout without
+   guesses turns up, noGuess is cleared and fellBack set. Returns the number
+   of squares opened, or -1 if (x, y) is out of bounds */
+int engineOpen(Engine *engine, int x, int y);
+
+/* toggles the flag on the square at (x, y); returns 1 if a flag was placed,
+   -1 if one was removed and 0 if the square can't be flagged */
+int engineFlag(Engine *engine, int x, int y);
+
+/* opens the covered neighbors of the number at (x, y) if it is surrounded by
+   as many flags as it shows; returns the number of squares opened, or -1 if
+   the number of flags doesn't match */
+int engineChord(Engine *engine, int x, int y);
+
+/* performs ACTION_OPEN, ACTION_FLAG or ACTION_AUTO on (x, y). Opening or
+   flagging a number chords it instead, just like clicking it in the game.
+   Returns the result of the function that was called. */
+int engineAct(Engine *engine, int action, int x, int y);
+
+#endif /* ENGINE_H */
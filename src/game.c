@@ -13,26 +13,130 @@
 #include <curses.h>
 #include <math.h>	/* floorf */
 #include <ctype.h>	/* toupper */
-#include <time.h>	/* timespec, usleep */
+#include <time.h>	/* timespec, strftime */
+#include <stdio.h>	/* snprintf */
+#include <string.h>	/* strlen, strcat */
+#include <limits.h>	/* PATH_MAX */
+#include <sys/stat.h>	/* mkdir */
 
 #include "util.h"
 #include "board.h"
+#include "engine.h"
+#include "render.h"
 #include "savegame.h"
 #include "menu.h"
+#include "solver.h"
+#include "probability.h"
+#include "journal.h"
+#include "recording.h"
+#include "slots.h"
+#include "saver.h"
+#include "stats.h"
+#include "challenge.h"
+#include "perf.h"
+#include "game.h"
 
-#include <unistd.h>	/* usleep */
-/* use a define statement because usleep isn't portable to windows */
-#define Sleep(ms) usleep((ms * 1000))
+
+/* the directory in ~/.cminesweeper that finished games are recorded in */
+#define RECORDING_DIR "recordings"
 
 /* timespec utility functions */
 void subtractTimespec(struct timespec *dest, struct timespec *src);	/* adds src to dest */
 void addTimespec(struct timespec *dest, struct timespec *src);		/* subtracts src from dest */
 double timespecToDouble(struct timespec spec);						/* converts a timespec interval to a float value */
+int64_t timespecToNanoseconds(struct timespec spec);				/* converts a timespec interval to nanoseconds */
+
+/* the journal kept next to the save file of slot in journal mode */
+static void journalFilename(char *filename, int slot) {
+	slotFilename(filename, slot);
+	strcat(filename, ".journal");
+}
+
+/* the saves of a game that fell back on an ordinary board don't have
+   MASK_NO_GUESS, but the next game played from *state should still try for a
+   board without guesses; call once no more saves are pending */
+static void keepNoGuess(Savegame *state, const Engine *engine) {
+	if (engine->fellBack)
+		state->gameBools |= MASK_NO_GUESS;
+}
+
+/* stores the state of the game in *state and hands it to the saver to be
+   written to its save slot, picking a free one the first time; returns -1 if
+   there is no free slot or memory runs out */
+static int saveGame(Saver *saver, Savegame *state, const Engine *engine, bool isFlagMode, int cy, int cx,
+		struct timespec duration) {
+	state->width = engine->board.width;
+	state->height = engine->board.height;
+	state->qtyMines = engine->board.mineCount;
+	state->flagsPlaced = engine->flagsPlaced;
+	state->gameBools = 0;
+	if (isFlagMode)
+		state->gameBools |= MASK_FLAG_MODE;
+	if (engine->firstClick)
+		state->gameBools |= MASK_FIRST_CLICK;
+	if (engine->noGuess)
+		state->gameBools |= MASK_NO_GUESS;
+	state->seed = engine->board.seed;
+	state->cy = cy;
+	state->cx = cx;
+	state->timeOffset = duration;
+	if (state->slot == -1)
+		state->slot = unusedSlot();
+	if (state->slot == -1)
+		return -1;
+	return queueSave(saver, *state, &engine->board);
+}
+
+/* saves the game as a new checkpoint and starts the journal over after it.
+   The old journal is only replaced once the checkpoint is on disk, so this
+   waits for the saver. */
+static int checkpoint(Saver *saver, Journal *journal, Savegame *state, const Engine *engine, bool isFlagMode,
+		int cy, int cx, struct timespec duration) {
+	char filename[SLOT_NAME_MAX + 8];
+	if (saveGame(saver, state, engine, isFlagMode, cy, cx, duration) == -1 || waitSaver(saver) == -1)
+		return -1;
+	journalFilename(filename, state->slot);
+	return startJournal(journal, filename, state->seed, timespecToNanoseconds(duration));
+}
+
+/* writes the recording of a finished game to RECORDING_DIR, named after the
+   time it ended and its seed; returns -1 if the file can't be written */
+static int saveRecording(const Recording *recording, const Engine *engine, struct timespec duration) {
+	char path[PATH_MAX];
+	time_t now = time(NULL);
+	size_t length;
+
+	snprintf(path, sizeof(path), "%s/.cminesweeper/" RECORDING_DIR, getenv("HOME"));
+	mkdir(path, 0755);
+	length = strlen(path);
+	length += strftime(path + length, sizeof(path) - length, "/%Y%m%d-%H%M%S", localtime(&now));
+	snprintf(path + length, sizeof(path) - length, "-%016llx.cmsr",
+		(unsigned long long) engine->board.seed);
+
+	/* the final time comes from the game clock rather than the moves, so
+	   that a replay can check one against the other */
+	return writeRecording(path, recording, engine, timespecToNanoseconds(duration));
+}
+
+/* adds the result of a finished game to the statistics; returns -1 if it
+   can't be written */
+static int saveResult(const Engine *engine, struct timespec duration) {
+	GameResult result;
+
+	result.width = engine->board.width;
+	result.height = engine->board.height;
+	result.qtyMines = engine->board.mineCount;
+	result.won = engine->status == STATUS_WON;
+	result.noGuess = engine->noGuess;
+	result.duration = (int64_t) duration.tv_sec * 1000000 + duration.tv_nsec / 1000;
+	result.finished = time(NULL);
+	return recordResult(&result);
+}
 
 /* game() will always work beginning from a saved state. When the game is saved,
    it is saved in *state. game() expects that *state be fully initialized when
    it is called. */
-int game(Savegame *state) {
+int game(Savegame *state, const GameOptions *options) {
 	/* not quite sure which scope this one should go in yet, so I'll leave it
 	   here for now */
 	MEVENT m_event;	/* mouse event */
@@ -55,40 +159,99 @@ int game(Savegame *state) {
 	clock_gettime(CLOCK_MONOTONIC, &timeOffset);		/* set offset to current time */
 	subtractTimespec(&timeOffset, &state->timeOffset);	/* subtract the game duration */
 
-	Board board;	/* stores the state of the game board */
-	board.width = xDim;
-	board.height = yDim;
-	board.mineCount = qtyMines;
-	initBoardArray(&board);
+	Engine engine;	/* applies the rules of the game */
+	if (initEngine(&engine, xDim, yDim, qtyMines, timeSeed()) == -1)
+		return GAME_FAILURE;
+	Board *board = &engine.board;	/* stores the state of the game board */
+
+	Solver solver;	/* keeps track of the squares that are safe, for hints */
+	Probability probability;	/* finds the best guess when nothing is safe */
+	if (initSolver(&solver, board) == -1) {
+		freeEngine(&engine);
+		return GAME_FAILURE;
+	}
+	if (initProbability(&probability, board) == -1) {
+		freeSolver(&solver);
+		freeEngine(&engine);
+		return GAME_FAILURE;
+	}
+
+	Saver saver;	/* writes the save slot without holding up the game */
+	if (initSaver(&saver) == -1) {
+		freeProbability(&probability);
+		freeSolver(&solver);
+		freeEngine(&engine);
+		return GAME_FAILURE;
+	}
 
 	int cy, cx;			/* cursor coordinates */
 	bool isFlagMode;	/* flag mode is enabled */
-	bool firstClick;	/* the first click of the game has been made */
-	int flagsPlaced;	/* number of flags placed */
-	if (state->gameData == NULL) {
+	bool isLoaded = (state->gameData != NULL);	/* the game comes from the save file */
+	engine.noGuess = ((state->gameBools & MASK_NO_GUESS) != 0);
+	if (!isLoaded) {
 		/* defaults for new games */
 		isFlagMode = false;
-		firstClick = false;
-		flagsPlaced = 0;
 		cy = 1;
 		cx = 1;
-		initializeMines(&board);
 	} else {
 		/* only do this if gameData was initialized from a previous save file */
 		isFlagMode = ((state->gameBools & MASK_FLAG_MODE) != 0);
-		firstClick = ((state->gameBools & MASK_FIRST_CLICK) != 0);
-		flagsPlaced = state->flagsPlaced;
+		engine.firstClick = ((state->gameBools & MASK_FIRST_CLICK) != 0);
+		engine.flagsPlaced = state->flagsPlaced;
+		seedBoard(board, state->seed);
 		cy = state->cy;
 		cx = state->cx;
-		getGameData(&board, *state);
-		free(state->gameData);
-		state->gameData = NULL;
+		getGameData(board, *state);
+		freeGameData(state);
+	}
+
+	/* in journal mode, the moves made since the save file was written are
+	   played again, and the result becomes the new checkpoint */
+	Journal journal;
+	initJournal(&journal);
+	if (options->journal && isLoaded && engine.firstClick) {
+		JournalMove last;
+		char filename[SLOT_NAME_MAX + 8];
+		journalFilename(filename, state->slot);
+		if (replayJournal(filename, state->seed, timespecToNanoseconds(state->timeOffset),
+				&engine, &last) > 0) {
+			cx = 2 * last.x - 1;
+			cy = last.y;
+			state->timeOffset.tv_sec = last.time / 1000000000;
+			state->timeOffset.tv_nsec = last.time % 1000000000;
+			clock_gettime(CLOCK_MONOTONIC, &timeOffset);
+			subtractTimespec(&timeOffset, &state->timeOffset);
+		}
+		if (engine.status == STATUS_PLAYING)
+			checkpoint(&saver, &journal, state, &engine, isFlagMode, cy, cx, state->timeOffset);
 	}
 
-	/* set the hudOffset */
+	/* a journal ends with the move that ended the game when the game was
+	   left before its save could be removed; the result was recorded by
+	   then, so all that is left to do is remove the save */
+	bool isOver = (engine.status != STATUS_PLAYING);
+	if (isOver && state->slot != -1) {
+		char filename[SLOT_NAME_MAX + 8];
+		journalFilename(filename, state->slot);
+		removeJournal(filename);
+		removeSlot(state->slot);
+		state->slot = -1;
+	}
+
+	/* new games are recorded from the first move, so that the recording can
+	   be played back from the seed alone */
+	Recording recording;
+	bool isRecorded = options->record && !isLoaded && initRecording(&recording) == 0;
+
+	/* show as much of the board as fits on the terminal, and put the HUD
+	   right next to it */
+	fitViewToScreen(board);
+	scrollToSquare(board, cx / 2 + 1, cy);
 	int hudOffset;
-	hudOffset = 2 * board.width + 3;
-	if (hudOffset < 18) hudOffset = 18;
+	hudOffset = hudOffsetFor(board->width);
+
+	/* where the first mouse button was pressed, for dragging the view */
+	int dragX = -1, dragY = -1;
 
 	/*** BEGIN GAMEPLAY ***/
 
@@ -96,42 +259,111 @@ int game(Savegame *state) {
 	curs_set(0);	/* cursor invisible */
 	clear();
 	
-	bool isAlive = true;
+	bool isAlive = (engine.status != STATUS_LOST);
 	bool exitGameThruMenu = false;
+
+	/* what is currently on screen, so that only the parts that changed get
+	   drawn again */
+	bool redrawAll = true;		/* the screen was cleared */
+	int shownFlags = -1;		/* flag counter in the HUD */
+	int shownSeconds = -1;		/* timer in the HUD */
+	bool shownFlagMode = false;	/* mode indicator in the HUD */
+	int shownX = 0, shownY = 0;	/* square under the virtual cursor */
+	long savesReported = 0;		/* saves finished whose errors have been shown */
+
+	/* the game is saved every options->autosave seconds of play while it
+	   changes; in journal mode every move is kept anyway */
+	bool isAutosaved = options->autosave > 0 && !options->journal;
+	bool isChanged = false;		/* moves were made since the last save */
+	struct timespec timeSaved = { 0, 0 };	/* game duration at the last save */
+	if (isLoaded)
+		timeSaved = state->timeOffset;
+
+#ifdef CMINESWEEPER_PERF
+	bool showPerf = false;		/* the performance box is shown below the HUD */
+#endif
+	/* a frame lasts from a keystroke to the screen showing its effect */
+	PERF_START(frameStart);
+
+	/* the duration so far, which is all there is if the game is already over */
+	timeBuffer = state->timeOffset;
+
 	while (isAlive) {
-		int x = 1, y = 1;	/* absolute array indices */
-		int h, k;			/* relative array indices */
+		int x = cx / 2 + 1, y = cy;	/* absolute array indices */
 		
-		if (!firstClick)
+		if (engine.status == STATUS_WON) {
+			/* Break if player has won; note that isAlive is still set to true.
+			   The clock stopped with the winning move, whose time is still in
+			   timeBuffer, rather than after the wait for the next key. */
+			break;
+		}
+
+		if (!engine.firstClick)
 			clock_gettime(CLOCK_MONOTONIC, &timeOffset);
 		
 		/* calculate duration of the game */
 		clock_gettime(CLOCK_MONOTONIC, &timeBuffer);
 		subtractTimespec(&timeBuffer, &timeOffset);	/* duration is now stored in timeBuffer */
-		
-		printFrame(board);
-		printCtrlsyx(0, hudOffset);
-		/* TODO:
-		   Find some method of optimization that avoids calling allClear() if no
-		   changes have been made to the state of the game */
-		if (allClear(board)) {
-			/* Break if player has won; note that isAlive is still set to true */
-			break;
-		} else {
-			/* player hasn't won yet */
-			mvprintw(7, hudOffset, "[ %02d/%02d ][ %03d ]", flagsPlaced, qtyMines, (int) floorf(timespecToDouble(timeBuffer)));
-			printBoard(board);
+
+		if (isAutosaved && isChanged && engine.firstClick
+				&& timeBuffer.tv_sec - timeSaved.tv_sec >= options->autosave) {
+			saveGame(&saver, state, &engine, isFlagMode, cy, cx, timeBuffer);
+			timeSaved = timeBuffer;
+			isChanged = false;
+		}
+
+		/* saves are written in the background, so they can only fail after
+		   the game has moved on */
+		int saveStatus;
+		if (saverFinished(&saver, &saveStatus) != savesReported) {
+			savesReported = saverFinished(&saver, &saveStatus);
+			if (saveStatus == -1) {
+				mvmenu(7, hudOffset, 1, "Error saving game!", "I understand");
+				clear();
+				redrawAll = true;
+			}
+		}
+
+		/* player hasn't won yet */
+		if (redrawAll) {
+			printFrame(*board);
+			printCtrlsyx(0, hudOffset);
+			markAllDirty(board);
+			shownFlags = shownSeconds = -1;
+			shownFlagMode = !isFlagMode;
+			redrawAll = false;
+		}
+		int seconds = (int) floorf(timespecToDouble(timeBuffer));
+		if (engine.flagsPlaced != shownFlags || seconds != shownSeconds) {
+			mvprintw(7, hudOffset, "[ %02d/%02d ][ %03d ]", engine.flagsPlaced, qtyMines, seconds);
+			shownFlags = engine.flagsPlaced;
+			shownSeconds = seconds;
+		}
+		if (isFlagMode != shownFlagMode) {
 			mvaddstr(8, hudOffset,
 				isFlagMode
 				? "[ Flag mode    ]"
 				: "[ Normal mode  ]"
 			);
-			move(cy, cx);
+			shownFlagMode = isFlagMode;
+		}
+
+		/* the square the cursor left has to lose its highlight, and the one
+		   it moved onto has to be drawn without a stale one */
+		if (x != shownX || y != shownY) {
+			if (shownX > 0)
+				markDirty(board, shownX, shownY);
+			markDirty(board, x, y);
+			shownX = x;
+			shownY = y;
 		}
+		solverSyncDirty(&solver);	/* has to see the changes before they're drawn */
+		printBoardChanges(board);
 
 		/* draw virtual cursor, colored based on the character under it */
-		{
-			unsigned char c = board.array[x][y] & MASK_CHAR;
+		if (inView(*board, x, y)) {
+			unsigned char c = CELL(*board, x, y) & MASK_CHAR;
+			move(y - board->view.y + 1, 2 * (x - board->view.x) + 1);
 			if (isdigit(c)) {
 				/* color for numbers */
 				chgat(2, A_REVERSE, 5, NULL);
@@ -143,13 +375,25 @@ int game(Savegame *state) {
 				chgat(2, A_REVERSE, 1, NULL);
 			}
 		}
+#ifdef CMINESWEEPER_PERF
+		if (showPerf)
+			printPerfyx(10, hudOffset);
+#endif
+		PERF_START(refreshStart);
 		refresh();
-
-		/* get input */
-		nodelay(stdscr, true);
+		PERF_STOP(PERF_REFRESH, refreshStart, 0);
+		PERF_FRAME_END(frameStart);
+
+		/* Block until there is input. While the clock is running, also wake up
+		   when the second shown in the HUD is due to change, so an idle game
+		   only redraws once a second and keystrokes are handled at once. */
+		if (engine.firstClick)
+			timeout(1000 - timeBuffer.tv_nsec / 1000000);
+		else
+			timeout(-1);
 		int input = getch();
-		nodelay(stdscr, false);
-		Sleep(16); /* sleep 1/60th of a second */
+		timeout(-1);
+		PERF_RESTART(frameStart);
 
 		/* TODO:
 		   Reorder switch cases in an order closer to descending probability */
@@ -168,9 +412,30 @@ int game(Savegame *state) {
 			action = ACTION_SAVE;
 			break;
 		case KEY_MOUSE:
-			getmouse(&m_event);
-			cx = m_event.x;
-			cy = m_event.y;
+			if (getmouse(&m_event) != OK)
+				break;
+
+			/* dragging with the first button held down pans the view */
+			if (m_event.bstate & BUTTON1_PRESSED) {
+				dragX = m_event.x;
+				dragY = m_event.y;
+				break;
+			}
+			if (m_event.bstate & BUTTON1_RELEASED) {
+				if (dragX >= 0)
+					scrollView(board, (dragX - m_event.x) / 2, dragY - m_event.y);
+				dragX = dragY = -1;
+				break;
+			}
+
+			/* ignore clicks outside of the visible part of the board */
+			if (m_event.y < 1 || board->view.height < m_event.y
+					|| m_event.x < 1 || 2 * board->view.width < m_event.x)
+				break;
+
+			/* translate screen coordinates to cursor coordinates */
+			cx = m_event.x + 2 * (board->view.x - 1);
+			cy = m_event.y + board->view.y - 1;
 
 			if (m_event.bstate & BUTTON1_CLICKED) {
 				action = isFlagMode
@@ -202,8 +467,39 @@ int game(Savegame *state) {
 				? ACTION_OPEN
 				: ACTION_FLAG;
 			break;
+		case 'h':
+			/* move the cursor to a square that is certainly safe, or else to
+			   the one least likely to be a mine */
+			{
+				int hx, hy;
+				solverRun(&solver);
+				if (solverNextSafe(&solver, &hx, &hy)
+						|| (computeProbabilities(&probability, qtyMines - engine.flagsPlaced) == 0
+							&& safestSquare(&probability, &hx, &hy))) {
+					cx = 2 * hx - 1;
+					cy = hy;
+				} else {
+					beep();
+				}
+			}
+			break;
+#ifdef CMINESWEEPER_PERF
+		case 'p':
+			/* toggle the performance box */
+			showPerf = !showPerf;
+			clear();
+			redrawAll = true;
+			break;
+#endif
 		case 'r':
-			freeBoardArray(&board);
+			freeSaver(&saver);
+			keepNoGuess(state, &engine);
+			if (isRecorded)
+				freeRecording(&recording);
+			closeJournal(&journal);
+			freeProbability(&probability);
+			freeSolver(&solver);
+			freeEngine(&engine);
 			return GAME_RESTART;
 		case KEY_UP:
 		case 'w':
@@ -235,6 +531,14 @@ int game(Savegame *state) {
 		case 'D':
 			cx += 4;
 			break;
+		case KEY_RESIZE:
+			/* refit the view to the new terminal size */
+			fitViewToScreen(board);
+			scrollToSquare(board, x, y);
+			hudOffset = hudOffsetFor(board->width);
+			clear();
+			redrawAll = true;
+			break;
 		}
 
 		/* Round the cursor position down to nearest grid coordinate.
@@ -253,93 +557,59 @@ int game(Savegame *state) {
 		if (cx > 2 * xDim - 1)
 			cx = 2 * xDim - 1;
 
-		/* translate cursor coordinates to array coordinates */
-		x = cx / 2 + 1;
-		y = cy;
+		/* translate cursor coordinates to array coordinates, and scroll the
+		   view along if the cursor moved */
+		if (x != cx / 2 + 1 || y != cy) {
+			x = cx / 2 + 1;
+			y = cy;
+			scrollToSquare(board, x, y);
+		}
 
-		/* check whether player clicked a number */
-		if (isdigit(board.array[x][y]) && (action == ACTION_OPEN || action == ACTION_FLAG))
-			action = ACTION_AUTO;
-		
 		/* switch to do board operations or open menu */
 		switch (action) {
 		case ACTION_OPEN:
-			/* make sure that the player does not die on the first move */
-			if (!firstClick) {
-				int count = 0;
-				while (numMines(board, x, y) > 0 || (board.array[x][y] & MASK_MINE)) {
-					/* Re-randomize the mines until the current square has 0 neighbors.
-					   This also guarantees that the first square chosen is not a mine. */
-					initializeMines(&board);
-					count++;
-					if (count > 100) {
-						/* After 100 tries, simply give up and instead remove the mine at
-						   the current coordinate, to avoid locking up the game. This is
-						   done because in some circumstances, it is not possible for the
-						   first square to have 0 neighbors, such as if there are too many
-						   mines in too small a field */
-						board.mineCount--;
-						initializeMines(&board);
-						board.array[x][y] &= ~MASK_MINE;
-						break;
-					}
-				}
-			}
-			
-			/* if player selects a MINE square to uncover */
-			if ((board.array[x][y] & MASK_MINE) && ((board.array[x][y] & MASK_CHAR) != 'P')) {
-				/* clear character and assign new value */
-				board.array[x][y] &= MASK_MINE; board.array[x][y] |= '#';
-				isAlive = false;
-			} else {
-				openSquares(&board, x, y);
-				firstClick = true;
-			}
-			break;
 		case ACTION_FLAG:
-			/* flag the current square */
-			if ((board.array[x][y] & MASK_CHAR) == '+') {
-				board.array[x][y] &= ~MASK_CHAR;	/* clear char */
-				board.array[x][y] |= 'P';		/* assign char */
-				flagsPlaced++;
-			} else if ((board.array[x][y] & MASK_CHAR) == 'P') {
-				board.array[x][y] &= ~MASK_CHAR;	/* clear char */
-				board.array[x][y] |= '+';		/* assign char */
-				flagsPlaced--;
-			}
-			break;
 		case ACTION_AUTO:
-			/* user selected a square holding a number */
+			/* opening or flagging a number is turned into ACTION_AUTO, which
+			   fails if the flags around it don't add up */
 			{
-				/* something something, labels can only precede statements... */
-				int adjacent = 0;
-				/* count number of adjacent flags */
-				for (k = -1; k <= 1; k++) {
-					for (h = -1; h <= 1; h++) {
-						if ((board.array[x + h][y + k] & MASK_CHAR) == 'P')
-							adjacent++;
-					}
-				}
-				/* if number of adjacent flags == number displayed on square */
-				if (adjacent == ((board.array[x][y] & MASK_CHAR) - '0')) {
-					for (k = -1; k <= 1; k++) {
-						for (h = -1; h <= 1; h++) {
-							/* for each adjacent square */
-							if ((board.array[x + h][y + k] & MASK_CHAR) == '+') {
-								if (!(board.array[x + h][y + k] & MASK_MINE)) {
-									/* if the square is not a mine */
-									openSquares(&board, x + h, y + k);
-								} else {
-									/* if the square is a mine */
-									isAlive = false;
-									board.array[x + h][y + k] &= ~MASK_CHAR;
-									board.array[x + h][y + k] |= '#';
-								}
-							}
-						}
-					}
-				} else {
+				bool minesPlaced = engine.firstClick;
+				if (engineAct(&engine, action, x, y) == -1)
 					beep();
+				isAlive = (engine.status != STATUS_LOST);
+				isChanged = true;
+
+				/* the clock only starts once the mines are placed, not when
+				   the frame the first click was waited for began */
+				if (!minesPlaced)
+					clock_gettime(CLOCK_MONOTONIC, &timeOffset);
+				clock_gettime(CLOCK_MONOTONIC, &timeBuffer);
+				subtractTimespec(&timeBuffer, &timeOffset);
+				if (isRecorded)
+					recordMove(&recording, action, x, y, minesPlaced ? timespecToNanoseconds(timeBuffer) : 0);
+
+				/* in journal mode, the move is appended to the journal; the
+				   whole board is only written once the mines are placed and
+				   then every so often */
+				if (options->journal && engine.firstClick) {
+					if (!minesPlaced || journal.fd == -1
+							|| journal.sequence >= JOURNAL_CHECKPOINT_INTERVAL)
+						checkpoint(&saver, &journal, state, &engine, isFlagMode, cy, cx, timeBuffer);
+					else
+						appendJournal(&journal, action, x, y, timespecToNanoseconds(timeBuffer));
+				}
+
+				/* the player asked for a board without guesses, so they are
+				   told when they didn't get one; saves no longer claim it */
+				if (!minesPlaced && engine.fellBack) {
+					clock_gettime(CLOCK_MONOTONIC, &timeMenu);
+					mvmenu(7, hudOffset, 1, "No guess-free board", "Play this one");
+					clear();
+					redrawAll = true;
+
+					clock_gettime(CLOCK_MONOTONIC, &timeBuffer);
+					subtractTimespec(&timeBuffer, &timeMenu);
+					addTimespec(&timeOffset, &timeBuffer);
 				}
 			}
 			break;
@@ -348,7 +618,7 @@ int game(Savegame *state) {
 			clock_gettime(CLOCK_MONOTONIC, &timeMenu);
 			
 			int pauseMenuOption;
-			printBlank(board);
+			printBlank(*board);
 			pauseMenuOption = menu(5, "Paused",
 				"Return to game ",
 				"Restart",
@@ -357,9 +627,10 @@ int game(Savegame *state) {
 				"View tutorial");
 
 			clear();
-			printFrame(board);
-			printBlank(board);
+			printFrame(*board);
+			printBlank(*board);
 			printCtrlsyx(0, hudOffset);
+			redrawAll = true;
 
 			/* increment the time offset by the amount of time spent in menu */
 			clock_gettime(CLOCK_MONOTONIC, &timeBuffer);
@@ -386,7 +657,14 @@ int game(Savegame *state) {
 					clear();
 					if (restartMenuOption == 1) break;
 
-					freeBoardArray(&board);
+					freeSaver(&saver);
+					keepNoGuess(state, &engine);
+					if (isRecorded)
+						freeRecording(&recording);
+					closeJournal(&journal);
+					freeProbability(&probability);
+					freeSolver(&solver);
+					freeEngine(&engine);
 					return GAME_RESTART;
 				}
 			case 3:
@@ -430,48 +708,46 @@ int game(Savegame *state) {
 				break;
 		case ACTION_SAVE:
 			/* save the game */
-			state->size = xDim * yDim;
-			state->width = xDim;
-			state->height = yDim;
-			state->qtyMines = qtyMines;
-			state->flagsPlaced = flagsPlaced;
-			state->gameBools = 0;
-			if (isFlagMode)
-				state->gameBools |= MASK_FLAG_MODE;
-			if (firstClick)
-				state->gameBools |= MASK_FIRST_CLICK;
-			state->cy = cy;
-			state->cx = cx;
 			clock_gettime(CLOCK_MONOTONIC, &timeBuffer);
 			subtractTimespec(&timeBuffer, &timeOffset);
-			state->timeOffset = timeBuffer;
-			setGameData(board, state);
 
-			int saveStatus;
-			saveStatus = writeSaveFile("savefile", *state);
+			if (options->journal && engine.firstClick)
+				saveStatus = checkpoint(&saver, &journal, state, &engine, isFlagMode, cy, cx, timeBuffer);
+			else
+				saveStatus = saveGame(&saver, state, &engine, isFlagMode, cy, cx, timeBuffer);
+			timeSaved = timeBuffer;
+			isChanged = false;
 			if (saveStatus == -1) {
-				/* save error */
+				/* save error, which has been shown once and for all */
+				savesReported = saverFinished(&saver, &saveStatus);
 				mvmenu(7, hudOffset, 1, "Error saving game!", "I understand");
 				clear();
+				redrawAll = true;
 			}
-			free(state->gameData);
 			break;
 		}
 		if (exitGameThruMenu) break;
 		refresh();
 	}
 	
+	/* the recording ends with the board the last move left, before the
+	   mines are shown */
+	if (isRecorded && !exitGameThruMenu)
+		saveRecording(&recording, &engine, timeBuffer);
+	if (!exitGameThruMenu && !isOver)
+		saveResult(&engine, timeBuffer);
+
 	if (isAlive) {
-		overlayMines(&board);
-		printBoardCustom(board, false, COLOR_PAIR(4) | A_BOLD);
-		mvprintw(7, hudOffset, "[ %02d/%02d ][ %3.3f ]" , flagsPlaced, qtyMines, timespecToDouble(timeBuffer));
+		overlayMines(board);
+		printBoardCustom(*board, false, COLOR_PAIR(4) | A_BOLD);
+		mvprintw(7, hudOffset, "[ %02d/%02d ][ %3.3f ]" , engine.flagsPlaced, qtyMines, timespecToDouble(timeBuffer));
 		mvprintw(8, hudOffset, "[ You won!        ]");
 		refresh();
 	} else {
 		clear();
-		overlayMines(&board);
-		printBoard(board);
-		printFrame(board);
+		overlayMines(board);
+		printBoard(*board);
+		printFrame(*board);
 		printCtrlsyx(0, hudOffset);
 		mvaddstr(8, hudOffset, "You died! Game over.\n");
 		refresh();
@@ -487,7 +763,37 @@ int game(Savegame *state) {
 		}
 	}
 
-	freeBoardArray(&board);
+	/* a board whose mines follow from its seed can be shared as a code, and
+	   played again with -c from the same first square */
+	Challenge challenge;
+	if (!exitGameThruMenu && boardChallenge(board, &challenge) == 0) {
+		char code[CHALLENGE_CODE_MAX];
+		encodeChallenge(&challenge, code);
+		mvaddstr(16, hudOffset, "Board code:");
+		mvaddstr(17, hudOffset, code);
+		refresh();
+	}
+
+	/* every save has to be on disk before the game is left */
+	freeSaver(&saver);
+	keepNoGuess(state, &engine);
+
+	/* in journal mode, and with autosaves, the save file always holds the
+	   game being played, so once it is over there is nothing left to
+	   resume */
+	closeJournal(&journal);
+	if ((options->journal || isAutosaved) && !exitGameThruMenu && state->slot != -1) {
+		char filename[SLOT_NAME_MAX + 8];
+		journalFilename(filename, state->slot);
+		removeJournal(filename);
+		removeSlot(state->slot);
+	}
+	if (isRecorded)
+		freeRecording(&recording);
+
+	freeProbability(&probability);
+	freeSolver(&solver);
+	freeEngine(&engine);
 	/* if player exited through menu */
 	if (exitGameThruMenu) return GAME_EXIT;
 	/* GAME_FAILURE and GAME_SUCCESS are set to 0 and 1 respectively, hence why
@@ -526,4 +832,8 @@ double timespecToDouble(struct timespec spec) {
 	result += spec.tv_sec;
 	result += spec.tv_nsec / 1.0e9;
 	return result;
-}
\ No newline at end of file
+}
+
+int64_t timespecToNanoseconds(struct timespec spec) {
+	return (int64_t) spec.tv_sec * 1000000000 + spec.tv_nsec;
+}
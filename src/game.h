@@ -3,14 +3,23 @@
  *
  * Contains the declaration of the game function.
  */
+#include <stdbool.h>
+
 #include "savegame.h"
 
 #ifndef GAME_H
 #define GAME_H
 
+/* settings given on the command line, which apply to every game */
+typedef struct {
+	bool journal;	/* append every move to a journal next to the save file */
+	bool record;	/* write a recording of every new game that is finished */
+	int autosave;	/* seconds of play between autosaves, or 0 for none */
+} GameOptions;
+
 /* returns 0 on game loss, 1 on success, 2 on manual exit, 3 on restart.
    *state is expected to be a fully initialized Savegame object. *state will be
    modified during normal operation if the save file is overwritten. */
-int game(Savegame *state);
+int game(Savegame *state, const GameOptions *options);
 
 #endif /* GAME_H */
\ No newline at end of file
@@ -0,0 +1,149 @@
+/*
+ * generator.c
+ *
+ * Defines the search for mine layouts that can be cleared without guessing
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <time.h>	/* clock_gettime */
+#include <unistd.h>	/* sysconf */
+#include <pthread.h>
+
+#include "generator.h"
+#include "solver.h"
+
+/* squares opened while playing a candidate between checks of the clock */
+#define CHECK_INTERVAL 256
+
+/* the search for a layout, shared by all threads */
+typedef struct {
+	const Board *board;		/* the board the mines are for; only read until the end */
+	int x, y;				/* the first square opened */
+	uint64_t deadline;		/* time at which the search gives up */
+	long next;				/* index of the next candidate to try */
+	long winner;			/* index of the first candidate that worked, or -1 */
+} Search;
+
+static uint64_t nanoseconds(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* returns the seed of candidate k. The index is mixed in rather than added,
+   because generators seeded with nearby values produce overlapping sequences. */
+static uint64_t candidateSeed(uint64_t base, long k) {
+	uint64_t z = base ^ ((uint64_t) k * 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 33)) * 0xff51afd7ed558ccdULL;
+	z = (z ^ (z >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+	return z ^ (z >> 33);
+}
+
+/* returns true once some thread has found a layout or the time is up */
+static bool searchOver(const Search *search) {
+	return __atomic_load_n(&search->winner, __ATOMIC_ACQUIRE) != -1
+		|| nanoseconds() >= search->deadline;
+}
+
+/* opens (x, y) and then only squares the solver proves to be safe; returns
+   true if that clears the board */
+static bool playThrough(Board *board, Solver *solver, int x, int y, const Search *search) {
+	long moves = 0;
+
+	openSquares(board, x, y);
+	while (board->coveredSafe > 0) {
+		if (++moves % CHECK_INTERVAL == 0 && searchOver(search))
+			return false;
+
+		solverSyncDirty(solver);
+		clearDirty(board);
+		solverRun(solver);
+		if (!solverNextSafe(solver, &x, &y))
+			return false;
+		openSquares(board, x, y);
+	}
+	return true;
+}
+
+/* tries candidates on a private board until the search is over; returns -1 if
+   the board can't be allocated */
+static int searchCandidates(Search *search) {
+	Board board;
+	Solver solver;
+	long k, none;
+
+	board.width = search->board->width;
+	board.height = search->board->height;
+	board.mineCount = search->board->mineCount;
+	if (initBoardArray(&board) == -1)
+		return -1;
+	if (initSolver(&solver, &board) == -1) {
+		freeBoardArray(&board);
+		return -1;
+	}
+
+	while (!searchOver(search)) {
+		k = __atomic_fetch_add(&search->next, 1, __ATOMIC_RELAXED);
+
+		clearBoardArray(&board);
+		seedBoard(&board, candidateSeed(search->board->seed, k));
+		initializeMinesAround(&board, search->x, search->y);
+		if (playThrough(&board, &solver, search->x, search->y, search)) {
+			/* the first thread to get here wins */
+			none = -1;
+			__atomic_compare_exchange_n(&search->winner, &none, k, false,
+				__ATOMIC_RELEASE, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+
+	freeSolver(&solver);
+	freeBoardArray(&board);
+	return 0;
+}
+
+static void *searchThread(void *arg) {
+	searchCandidates((Search *) arg);
+	return NULL;
+}
+
+int generateNoGuess(Board *board, int x, int y, int threads, uint64_t budget) {
+	Search search;
+	pthread_t *ids;
+	int started = 0;
+	int status, t;
+
+	if (threads <= 0)
+		threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads < 1)
+		threads = 1;
+
+	search.board = board;
+	search.x = x;
+	search.y = y;
+	search.deadline = nanoseconds() + budget;
+	search.next = 0;
+	search.winner = -1;
+
+	/* the calling thread searches too, so it only has to start the others */
+	ids = (pthread_t *) malloc(threads * sizeof(pthread_t));
+	for (t = 0; ids != NULL && t < threads - 1; t++) {
+		if (pthread_create(&ids[started], NULL, searchThread, &search) == 0)
+			started++;
+	}
+	status = searchCandidates(&search);
+	for (t = 0; t < started; t++)
+		pthread_join(ids[t], NULL);
+	free(ids);
+
+	if (search.winner != -1) {
+		seedBoard(board, candidateSeed(board->seed, search.winner));
+		initializeMinesAround(board, x, y);
+		return GENERATOR_FOUND;
+	}
+
+	/* no luck, so fall back on the layout the board would have had anyway */
+	initializeMinesAround(board, x, y);
+	return (status == -1) ? -1 : GENERATOR_FELL_BACK;
+}
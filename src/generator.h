@@ -0,0 +1,36 @@
+/*
+ * generator.h
+ *
+ * Contains declarations of the functions that place mines so that a game can be
+ * won without ever having to guess. Candidate boards are tried on several
+ * threads at once and checked by playing them through with the solver.
+ */
+
+#include <stdint.h>
+
+#include "board.h"
+
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+/* how long generateNoGuess searches before settling for an ordinary board, in
+   nanoseconds */
+#define GENERATOR_BUDGET 50000000
+
+/* what generateNoGuess returns, besides -1 */
+#define GENERATOR_FOUND		1	/* a layout without guesses was placed */
+#define GENERATOR_FELL_BACK	0	/* none turned up, so an ordinary one was placed */
+
+/* places the mines on board, which must be fully covered, like
+   initializeMinesAround(board, x, y), but tries layouts generated from
+   different seeds on threads threads (or one per core if threads is 0) until
+   one of them can be cleared from (x, y) by the solver alone. The seed of the
+   layout that was picked is left in board->seed, so seedBoard followed by
+   initializeMinesAround reproduces it. Returns GENERATOR_FOUND if such a
+   layout was found, and GENERATOR_FELL_BACK if none turned up within budget
+   nanoseconds, in which case the mines are placed as usual from the board's
+   own seed; -1 is returned, also after placing the mines as usual, if memory
+   runs out. */
+int generateNoGuess(Board *board, int x, int y, int threads, uint64_t budget);
+
+#endif /* GENERATOR_H */
@@ -0,0 +1,167 @@
+/*
+ * journal.c
+ *
+ * Defines functions for writing and replaying the move journal
+ */
+
+#include <stdio.h>
+#include <stdlib.h>	/* getenv */
+#include <string.h>	/* memcpy, memcmp, memset, strcpy, strcat */
+#include <limits.h>	/* NAME_MAX */
+#include <fcntl.h>	/* open */
+#include <unistd.h>	/* write, fdatasync, close */
+
+#include "journal.h"
+#include "savegame.h"	/* crc32 */
+
+/* the full name of the journal file, which lives next to the save file */
+static void journalPath(char *longname, const char *filename) {
+	memset(longname, 0, NAME_MAX + 1);
+	strcpy(longname, getenv("HOME"));
+	strcat(longname, "/.cminesweeper/");
+	strcat(longname, filename);
+}
+
+static void putLittleEndian(unsigned char *p, uint64_t value, int bytes) {
+	int i;
+	for (i = 0; i < bytes; i++)
+		p[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static uint64_t getLittleEndian(const unsigned char *p, int bytes) {
+	uint64_t value = 0;
+	int i;
+	for (i = bytes - 1; i >= 0; i--)
+		value = (value << 8) | p[i];
+	return value;
+}
+
+/* writes all of data, carrying on after partial writes; returns -1 on error */
+static int writeAll(int fd, const unsigned char *data, size_t size) {
+	while (size > 0) {
+		ssize_t written = write(fd, data, size);
+		if (written <= 0)
+			return -1;
+		data += written;
+		size -= written;
+	}
+	return 0;
+}
+
+/* fills in the header tying a journal to a checkpoint */
+static void putHeader(unsigned char *header, uint64_t seed, int64_t time) {
+	memcpy(header, JOURNAL_MAGIC, 4);
+	putLittleEndian(header + 4, JOURNAL_VERSION, 2);
+	putLittleEndian(header + 6, JOURNAL_MOVE_SIZE, 2);
+	putLittleEndian(header + 8, seed, 8);
+	putLittleEndian(header + 16, time, 8);
+	putLittleEndian(header + 24, crc32(0, header, JOURNAL_HEADER_SIZE - 4), 4);
+}
+
+int initJournal(Journal *journal) {
+	journal->fd = -1;
+	journal->sequence = 0;
+	return 0;
+}
+
+int startJournal(Journal *journal, const char *filename, uint64_t seed, int64_t time) {
+	char longname[NAME_MAX + 1];
+	unsigned char header[JOURNAL_HEADER_SIZE];
+
+	closeJournal(journal);
+	journalPath(longname, filename);
+
+	/* O_APPEND keeps every move at the end even if the file is shared */
+	journal->fd = open(longname, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	if (journal->fd == -1)
+		return -1;
+
+	/* the file has to be on disk before moves are appended to it */
+	putHeader(header, seed, time);
+	if (writeAll(journal->fd, header, JOURNAL_HEADER_SIZE) == -1
+			|| fdatasync(journal->fd) == -1 || syncDirectory(longname) == -1) {
+		closeJournal(journal);
+		return -1;
+	}
+	return 0;
+}
+
+int appendJournal(Journal *journal, int action, int x, int y, int64_t time) {
+	unsigned char move[JOURNAL_MOVE_SIZE];
+
+	if (journal->fd == -1)
+		return -1;
+
+	/* a move goes out in a single write, so a crash leaves either all of it
+	   or a piece that fails its check, and it is synced before the game goes
+	   on; moves come at the pace of the player, so that costs little */
+	memset(move, 0, JOURNAL_MOVE_SIZE);
+	putLittleEndian(move, journal->sequence + 1, 4);
+	move[4] = action;
+	putLittleEndian(move + 8, (uint32_t) x, 4);
+	putLittleEndian(move + 12, (uint32_t) y, 4);
+	putLittleEndian(move + 16, time, 8);
+	putLittleEndian(move + 24, crc32(0, move, JOURNAL_MOVE_SIZE - 4), 4);
+	if (writeAll(journal->fd, move, JOURNAL_MOVE_SIZE) == -1 || fdatasync(journal->fd) == -1)
+		return -1;
+
+	journal->sequence++;
+	return 0;
+}
+
+int closeJournal(Journal *journal) {
+	int status = 0;
+	if (journal->fd != -1)
+		status = close(journal->fd);
+	journal->fd = -1;
+	journal->sequence = 0;
+	return status;
+}
+
+long replayJournal(const char *filename, uint64_t seed, int64_t time, Engine *engine, JournalMove *last) {
+	char longname[NAME_MAX + 1];
+	unsigned char header[JOURNAL_HEADER_SIZE], expected[JOURNAL_HEADER_SIZE];
+	unsigned char move[JOURNAL_MOVE_SIZE];
+	JournalMove m;
+	long replayed = 0;
+	FILE *file;
+
+	journalPath(longname, filename);
+	file = fopen(longname, "rb");
+	if (file == NULL)
+		return 0;
+
+	/* the header has to match the one written for this checkpoint */
+	putHeader(expected, seed, time);
+	if (fread(header, JOURNAL_HEADER_SIZE, 1, file) != 1
+			|| memcmp(header, expected, JOURNAL_HEADER_SIZE) != 0) {
+		fclose(file);
+		return 0;
+	}
+
+	while (fread(move, JOURNAL_MOVE_SIZE, 1, file) == 1) {
+		if (getLittleEndian(move + 24, 4) != crc32(0, move, JOURNAL_MOVE_SIZE - 4))
+			break;
+		m.sequence = getLittleEndian(move, 4);
+		m.action = move[4];
+		m.x = (int32_t) getLittleEndian(move + 8, 4);
+		m.y = (int32_t) getLittleEndian(move + 12, 4);
+		m.time = getLittleEndian(move + 16, 8);
+		if (m.sequence != (uint32_t) replayed + 1
+				|| (m.action != ACTION_OPEN && m.action != ACTION_FLAG && m.action != ACTION_AUTO))
+			break;
+
+		engineAct(engine, m.action, m.x, m.y);
+		*last = m;
+		replayed++;
+	}
+
+	fclose(file);
+	return replayed;
+}
+
+int removeJournal(const char *filename) {
+	char longname[NAME_MAX + 1];
+	journalPath(longname, filename);
+	return remove(longname);
+}
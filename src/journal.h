@@ -0,0 +1,86 @@
+/*
+ * journal.h
+ *
+ * Contains declarations of the Journal struct, an append-only log of the moves
+ * made since the save file was last written in full, and of the functions that
+ * write it and replay it. Together with the save file, which serves as the
+ * checkpoint, it keeps every move on disk for a few bytes of I/O: a move is
+ * synced before appendJournal returns, so it survives the process, the
+ * operating system or the power going down.
+ */
+
+#include <stdint.h>
+
+#include "engine.h"
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+/* A journal file starts with a header of little-endian fields:
+
+	offset	size	field
+	0		4		magic, "CMSJ"
+	4		2		format version, JOURNAL_VERSION
+	6		2		size of a move, JOURNAL_MOVE_SIZE
+	8		8		seed of the checkpoint
+	16		8		duration of the game at the checkpoint, in nanoseconds
+	24		4		CRC-32 of the header up to here
+
+   The seed and duration tie the journal to the save file it continues; a
+   journal that doesn't match the save file is ignored. Every move after that is
+
+	0		4		sequence number, counting up from 1
+	4		1		action, one of ACTION_OPEN, ACTION_FLAG and ACTION_AUTO
+	5		3		zero
+	8		4		x
+	12		4		y
+	16		8		duration of the game when the move was made, in nanoseconds
+	24		4		CRC-32 of the move up to here
+
+   Replaying stops at the first move that is cut short or damaged. */
+#define JOURNAL_MAGIC		"CMSJ"
+#define JOURNAL_VERSION		1
+#define JOURNAL_HEADER_SIZE	28
+#define JOURNAL_MOVE_SIZE	28
+
+/* moves journaled before the game writes the whole board again */
+#define JOURNAL_CHECKPOINT_INTERVAL 1024
+
+typedef struct {
+	int fd;				/* the open journal file, or -1 */
+	uint32_t sequence;	/* sequence number of the last move written */
+} Journal;
+
+/* a move read back from a journal */
+typedef struct {
+	uint32_t sequence;
+	int action;
+	int x, y;
+	int64_t time;		/* duration of the game when the move was made, in nanoseconds */
+} JournalMove;
+
+/* set up a journal that isn't writing to any file yet */
+int initJournal(Journal *journal);
+
+/* start the journal filename in ~/.cminesweeper over, for the checkpoint
+   just written with the given seed and game duration, and wait for it to
+   reach the disk; returns -1 if the file can't be written */
+int startJournal(Journal *journal, const char *filename, uint64_t seed, int64_t time);
+
+/* add a move to the end of the journal and wait for it to reach the disk;
+   returns -1 if it can't be written or the journal isn't open */
+int appendJournal(Journal *journal, int action, int x, int y, int64_t time);
+
+/* close the journal file, if it is open */
+int closeJournal(Journal *journal);
+
+/* plays the moves in the journal filename in ~/.cminesweeper on engine with
+   engineAct, if the journal continues the checkpoint with the given seed and
+   game duration, storing the last move replayed in *last. Returns the number
+   of moves replayed, which is 0 if there is no matching journal. */
+long replayJournal(const char *filename, uint64_t seed, int64_t time, Engine *engine, JournalMove *last);
+
+/* removes a journal from disk */
+int removeJournal(const char *filename);
+
+#endif /* JOURNAL_H */
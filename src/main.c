@@ -5,17 +5,225 @@
 #include <stdbool.h>
 #include <curses.h>
 #include <string.h>	/* strcmp */
-#include <time.h>	/* time */
+#include <time.h>	/* strftime */
+#include <unistd.h>	/* getopt */
 
 #include "util.h"
 #include "savegame.h"
+#include "slots.h"
 #include "splash.h"
 #include "menu.h"
 #include "game.h"
+#include "review.h"
+#include "stats.h"
+#include "challenge.h"
+#include "perf.h"
+
+#ifdef CMINESWEEPER_PERF
+/* writes the performance counters gathered over the session to
+   ~/.cminesweeper/perf.txt */
+static void dumpPerf(void) {
+	char filename[4096];
+	FILE *file;
+
+	snprintf(filename, sizeof(filename), "%s/.cminesweeper/perf.txt", getenv("HOME"));
+	file = fopen(filename, "w");
+	if (file == NULL)
+		return;
+	perfDump(file);
+	fclose(file);
+}
+#endif
+
+/* lets the user pick a saved game from the index; returns the slot chosen, or
+   -1 if there are none or the user backs out */
+static int chooseSlot(const char *title) {
+	SlotIndex index;
+	char (*labels)[96];	/* room for the widest label the format allows */
+	const char **options;
+	int i, choice, rows;
+
+	if (loadSlotIndex(&index) == -1 || index.count == 0) {
+		freeSlotIndex(&index);
+		mvmenu(0, 0, 1, "No save file exists", "I understand");
+		return -1;
+	}
+
+	/* every label comes from the index, so no save file is opened */
+	labels = malloc(index.count * sizeof(*labels));
+	options = malloc(index.count * sizeof(char *));
+	if (labels == NULL || options == NULL) {
+		free(labels);
+		free(options);
+		freeSlotIndex(&index);
+		return -1;
+	}
+	for (i = 0; i < index.count; i++) {
+		const SlotSummary *summary = &index.slots[i];
+		time_t modified = summary->modified;
+		char date[20];
+		strftime(date, sizeof(date), "%Y-%m-%d %H:%M", localtime(&modified));
+		snprintf(labels[i], sizeof(labels[i]), "%3dx%-3d %4d mines %4d flags %3ld:%02ld  %s%s",
+			summary->width, summary->height, summary->qtyMines, summary->flagsPlaced,
+			(long) summary->timeOffset.tv_sec / 60, (long) summary->timeOffset.tv_sec % 60, date,
+			(summary->gameBools & MASK_NO_GUESS) ? "  no guessing" : "");
+		options[i] = labels[i];
+	}
+
+	clear();
+	rows = LINES - 4;
+	choice = mvlistMenu(0, 0, rows, title, index.count, options);
+	if (choice != -1)
+		choice = index.slots[choice].slot;
+
+	free(labels);
+	free(options);
+	freeSlotIndex(&index);
+	return choice;
+}
+
+/* the name of a board size in the statistics */
+static void sizeLabel(char *label, size_t size, const StatsEntry *entry) {
+	if (entry->width == 9 && entry->height == 9 && entry->qtyMines == 10)
+		snprintf(label, size, "Beginner");
+	else if (entry->width == 16 && entry->height == 16 && entry->qtyMines == 40)
+		snprintf(label, size, "Intermediate");
+	else if (entry->width == 30 && entry->height == 24 && entry->qtyMines == 99)
+		snprintf(label, size, "Advanced");
+	else
+		snprintf(label, size, "%dx%d, %d", entry->width, entry->height, entry->qtyMines);
+}
+
+/* prints a time of the statistics in seconds, or a dash if there is none */
+static void printStatsTime(double seconds) {
+	if (seconds > 0)
+		printw(" %9.2f", seconds);
+	else
+		printw(" %9s", "-");
+}
+
+/* shows the totals for every board size played, which are read from the
+   statistics file without going through the results log */
+static void showStats(void) {
+	Stats stats;
+	int top = 0, rows, input, i, k;
+
+	if (loadStats(&stats) == -1) {
+		mvmenu(0, 0, 1, "Error reading statistics", "I understand");
+		return;
+	}
+
+	do {
+		rows = LINES - 6;
+		if (rows < 1) rows = 1;
+		if (top > stats.count - rows) top = stats.count - rows;
+		if (top < 0) top = 0;
+
+		clear();
+		mvaddstr(0, 0, "+= Statistics ");
+		for (k = 14; k < 79; k++)
+			addch('=');
+		addch('+');
+		mvprintw(1, 0, "| %-14s %7s %7s %5s %9s %9s %9s %9s |",
+			"Board", "Games", "Won", "Won%", "Best", "Median", "90%", "Mean");
+		for (i = 0; i < rows; i++) {
+			mvaddstr(2 + i, 0, "|");
+			mvaddstr(2 + i, 79, "|");
+			if (top + i >= stats.count)
+				continue;
+
+			const StatsEntry *entry = &stats.entries[top + i];
+			char label[32];
+			sizeLabel(label, sizeof(label), entry);
+			mvprintw(2 + i, 2, "%-14.14s %7lld %7lld %4.0f%%", label,
+				(long long) entry->games, (long long) entry->wins,
+				(entry->games > 0) ? 100.0 * entry->wins / entry->games : 0.0);
+			printStatsTime(entry->best / 1e6);
+			printStatsTime(statsPercentile(entry, 0.5));
+			printStatsTime(statsPercentile(entry, 0.9));
+			printStatsTime((entry->wins > 0) ? entry->wonTime / 1e6 / entry->wins : 0);
+		}
+		if (stats.count == 0)
+			mvaddstr(2, 2, "No games played yet");
+		mvaddstr(2 + rows, 0, "+");
+		for (k = 1; k < 79; k++)
+			addch('=');
+		addch('+');
+		mvaddstr(3 + rows, 0, "W S: scroll   R: rebuild from the results log   Q: back");
+		refresh();
+
+		input = getch();
+		switch (input) {
+		case KEY_UP:
+		case 'w':
+			top--;
+			break;
+		case KEY_DOWN:
+		case 's':
+			top++;
+			break;
+		case 'r':
+			freeStats(&stats);
+			if (rebuildStats(&stats) == -1) {
+				mvmenu(0, 0, 1, "Error reading statistics", "I understand");
+				return;
+			}
+			break;
+		}
+	} while (input != 'q' && input != 27);
+
+	freeStats(&stats);
+	clear();
+}
+
+/* not an option of the main menu, but what is played instead of showing it
+   when a board code is given with -c */
+#define MAIN_CHALLENGE	-2
 
 /* home of the main menu (TM) */
 int main(int argc, char* argv[]) {
-	srand(time(NULL));
+	/* command line options */
+	GameOptions options = { false, false, 0 };
+	const char *reviewFile = NULL;	/* recording to play back instead of playing */
+	Challenge challenge;			/* board to play before the main menu */
+	bool isChallenge = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "ja:rv:c:")) != -1) {
+		switch (opt) {
+		case 'j':
+			/* journal every move, so that no move is lost if the game is
+			   interrupted */
+			options.journal = true;
+			break;
+		case 'a':
+			/* save the game in the background every so often */
+			options.autosave = atoi(optarg);
+			if (options.autosave < 1) {
+				fprintf(stderr, "%s: -a needs a number of seconds\n", argv[0]);
+				return 1;
+			}
+			break;
+		case 'r':
+			/* record every finished game in ~/.cminesweeper/recordings */
+			options.record = true;
+			break;
+		case 'v':
+			reviewFile = optarg;
+			break;
+		case 'c':
+			/* play the board of a code shown at the end of a game */
+			if (decodeChallenge(optarg, &challenge) == -1) {
+				fprintf(stderr, "%s: %s is not a valid board code\n", argv[0], optarg);
+				return 1;
+			}
+			isChallenge = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-j] [-a seconds] [-r] [-v recording] [-c code]\n", argv[0]);
+			return 1;
+		}
+	}
+
 	initscr();
 	keypad(stdscr, true);
 	noecho();
@@ -25,12 +233,14 @@ int main(int argc, char* argv[]) {
 	mousemask(ALL_MOUSE_EVENTS, &old);
 
 	/* display splash screen */
-	addstr(SPLASH);
 	curs_set(0);
-	/* press any key to continue */
-	getch();
-	clear();
-	refresh();
+	if (reviewFile == NULL && !isChallenge) {
+		addstr(SPLASH);
+		/* press any key to continue */
+		getch();
+		clear();
+		refresh();
+	}
 
 	/* initialize colors */
 	start_color();
@@ -40,6 +250,18 @@ int main(int argc, char* argv[]) {
 	init_pair(4, COLOR_GREEN,	COLOR_BLACK);	/* for correct flags and unexploded mines */
 	init_pair(5, COLOR_CYAN,	COLOR_BLACK);	/* for numbers */
 
+	/* a recording is played back instead of the main menu */
+	if (reviewFile != NULL) {
+		int status = review(reviewFile);
+		echo();
+		endwin();
+		if (status == -1) {
+			fprintf(stderr, "%s: %s is not a valid recording\n", argv[0], reviewFile);
+			return 1;
+		}
+		return 0;
+	}
+
 	/*** PLAY THE GAME ***/
 
 	int mainMenuOption;
@@ -50,20 +272,27 @@ int main(int argc, char* argv[]) {
 
 		clear();
 
+		if (isChallenge) {
+			mainMenuOption = MAIN_CHALLENGE;
+			isChallenge = false;
+		} else {
 #ifndef CMINESWEEPER_DEBUG
-		mainMenuOption = menu(4, "Main menu",
-			"New game...",
-			"Load game",
-			"Clear saved game...",
-			"Exit");
+			mainMenuOption = menu(5, "Main menu",
+				"New game...",
+				"Load game",
+				"Clear saved game...",
+				"Statistics",
+				"Exit");
 #else
-		mainMenuOption = menu(5, "Main menu",
-			"New game...",
-			"Load game",
-			"Clear saved game...",
-			"Exit",
-			"Debug menu...");
+			mainMenuOption = menu(6, "Main menu",
+				"New game...",
+				"Load game",
+				"Clear saved game...",
+				"Statistics",
+				"Exit",
+				"Debug menu...");
 #endif	/* CMINESWEEPER_DEBUG */
+		}
 
 		switch (mainMenuOption) {
 		case 0:
@@ -99,20 +328,20 @@ int main(int argc, char* argv[]) {
 				case 3:
 					/* custom dimensions */
 					{
-						int termWidth, termHeight;
-						getmaxyx(stdscr, termHeight, termWidth);
+						/* boards larger than the terminal are scrolled, so
+						   the dimensions are only limited by BOARD_MAX_SIDE */
 						int useDimensions;
 						do {
 							clear();
 							do savegame.width = mvpromptInt(0, 0, "Width:         ");
-							while (savegame.width < 2 || savegame.width > (termWidth - 41) / 2);
+							while (savegame.width < 2 || BOARD_MAX_SIDE < savegame.width);
 
 							do savegame.height = mvpromptInt(4, 0, "Height         ");
-							while (savegame.height < 2 || savegame.height > (termHeight - 2));
+							while (savegame.height < 2 || BOARD_MAX_SIDE < savegame.height);
 
 							do savegame.qtyMines = mvpromptInt(8, 0, "Number of mines");
 							while ( savegame.qtyMines < 0		/* the - 2 below is arbitrary */
-									|| savegame.qtyMines > savegame.height * savegame.width - 2 );
+									|| savegame.qtyMines > (long long) savegame.height * savegame.width - 2 );
 
 							useDimensions = mvmenu(0, 20, 3, "Use these dimensions?",
 								"Yes",
@@ -122,29 +351,48 @@ int main(int argc, char* argv[]) {
 						if (useDimensions == 2) continue;
 					}
 				}
+				/* boards that never need a guess take a moment to find */
+				int generation;
+				generation = menu(2, "Choose board generation",
+					"Random",
+					"No guessing");
+				if (generation == -1) continue;
+				savegame.gameBools = (generation == 1) ? MASK_NO_GUESS : 0;
+
 				/* gameData should always be set to NULL when a new game is to
 				   be initialized */
 				savegame.gameData = NULL;
+				savegame.slot = -1;
 			}
 			break;
 		case 1:
 			/* load game */
-			/* loadSaveFile returns -1 if error opening file */
-
-			if (loadSaveFile("savefile", &savegame) == -1) {
-				mvmenu(0, 0, 1, "No save file exists", "I understand");
-				continue;
+			{
+				int slot = chooseSlot("Load game");
+				if (slot == -1)
+					continue;
+				/* loadSlot returns -1 if error opening file */
+				clear();
+				if (loadSlot(slot, &savegame) == -1) {
+					mvmenu(0, 0, 1, "Saved game can't be read", "I understand");
+					continue;
+				}
+				/* otherwise, loading was successful and we can continue */
+				savegame.slot = slot;
 			}
-			/* otherwise, loading was successful and we can continue */
 			break;
 		case 2:
-			/* clear savefile */
+			/* clear a save slot */
 			{
+				int slot = chooseSlot("Clear saved game");
+				if (slot == -1)
+					continue;
+				clear();
 				int clearSaveFile;
 				clearSaveFile = menu(2, "Really clear saved game?", "Yes", "No");
 				if (clearSaveFile == 0) {
 					/* delete it ! */
-					int status = removeSaveFile("savefile");
+					int status = removeSlot(slot);
 					if (status != 0)
 						mvmenu(6, 0, 1, "No save file exists", "I understand");
 					else
@@ -152,9 +400,20 @@ int main(int argc, char* argv[]) {
 				}
 			}
 			continue;
+		case 3:
+			/* statistics */
+			showStats();
+			continue;
+		case MAIN_CHALLENGE:
+			/* the board of a code, with its first square already opened */
+			if (challengeSave(&challenge, &savegame) == -1) {
+				mvmenu(0, 0, 1, "Error setting up the board", "I understand");
+				continue;
+			}
+			break;
 
 #ifdef CMINESWEEPER_DEBUG
-		case 4:
+		case 5:
 			/* debug menu */
 			{
 				int the = mvpromptInt(0, 0, "The");
@@ -176,20 +435,19 @@ int main(int argc, char* argv[]) {
 #endif	/* CMINESWEEPER_DEBUG */
 
 		case -1:
-			mainMenuOption = 3;
+			mainMenuOption = 4;
 		}
 
 		/* calculate HUD offset */
 		int hudOffset;
-		hudOffset = 2 * savegame.width + 3;
-		if (hudOffset < 18) hudOffset = 18;
+		hudOffset = hudOffsetFor(savegame.width);
 
 		/* game time, using whatever Savegame was set up in the last step */
-		if (mainMenuOption != 3) {
+		if (mainMenuOption != 4) {
 			/* keep playing while player wants to */
 			int exitCode;
 			do {
-				exitCode = game(&savegame);
+				exitCode = game(&savegame, &options);
 				if (exitCode == GAME_FAILURE || exitCode == GAME_SUCCESS) {
 					int playAgain;
 					playAgain = mvmenu(9, hudOffset, 2, "Play again?",
@@ -204,11 +462,17 @@ int main(int argc, char* argv[]) {
 					/* otherwise, set gameData to NULL before a new game */
 					savegame.gameData = NULL;
 				}
+				/* a new game goes in a slot of its own */
+				if (exitCode != GAME_EXIT)
+					savegame.slot = -1;
 			} while (exitCode != GAME_EXIT);
 		}
-	} while (mainMenuOption != 3);
+	} while (mainMenuOption != 4);
 	
 	echo();
 	endwin();
+#ifdef CMINESWEEPER_PERF
+	dumpPerf();
+#endif
 	return 0;
 }
@@ -31,8 +31,8 @@ int mvmenu(int y, int x, int optc, const char *title, ...) {
 }
 
 int vmenu(int y, int x, int optc, const char *title, va_list options) {
-	int i, k; /* counting variables */
-	size_t maxLength;
+	int i; /* counting variables */
+	size_t k, maxLength;
 	/* string array to hold option names */
 	const char **optionNames = malloc(optc * sizeof(char *));
 	/* array to cache string lengths to avoid calling strlen multiple times */
@@ -145,8 +145,7 @@ int vmenu(int y, int x, int optc, const char *title, va_list options) {
 /* TODO:
    allow user to exit the prompt using Q (may require changing parameters) */
 int mvpromptInt(int y, int x, const char *prompt) {
-	size_t width;
-	int i;
+	size_t width, i;
 
 	if (prompt != NULL) {
 		size_t length = strlen(prompt);
@@ -211,3 +210,107 @@ int mvpromptInt(int y, int x, const char *prompt) {
 int promptInt(const char *prompt) {
 	return mvpromptInt(0, 0, prompt);
 }
+
+int mvlistMenu(int y, int x, int rows, const char *title, int optc, const char **options) {
+	int i; /* counting variables */
+	size_t k, maxLength, titleLength, length;
+
+	/* variables for navigating the menu */
+	bool gotInput = false; /* the user has made a choice */
+	int buf = 0;
+	int option = 0;
+	int top = 0; /* first option shown */
+
+	if (optc < 1)
+		return -1;
+	if (rows > optc)
+		rows = optc;
+	if (rows < 1)
+		rows = 1;
+
+	/* calculate the width of the box necessary to fit all options */
+	titleLength = strlen(title) - 2;
+	maxLength = titleLength;
+	for (i = 0; i < optc; i++) {
+		length = strlen(options[i]) + 2;
+		if (length > maxLength)
+			maxLength = length;
+	}
+
+	curs_set(0); /* cursor invisible */
+
+	do {
+		/* keep the chosen option on screen */
+		if (option < top)
+			top = option;
+		if (option >= top + rows)
+			top = option - rows + 1;
+
+		/* print the menu */
+		mvprintw(y, x, "+= %s ", title);
+		for (k = 0; k < maxLength - titleLength; k++)
+			addch('=');
+		addstr("=+");
+
+		/* the blank lines above and below show if there is more */
+		mvaddstr(y + 1, x, (top > 0) ? "|   ^ " : "|     ");
+		for (k = 0; k < maxLength; k++)
+			addch(' ');
+		addstr(" |");
+
+		for (i = 0; i < rows; i++) {
+			mvprintw(y + i + 2, x, "| %4d) %s", top + i + 1, options[top + i]);
+			for (k = strlen(options[top + i]) + 2; k < maxLength; k++)
+				addch(' ');
+			addstr(" |");
+		}
+
+		mvaddstr(y + i + 2, x, (top + rows < optc) ? "|   v " : "|     ");
+		for (k = 0; k < maxLength; k++)
+			addch(' ');
+		addstr(" |");
+
+		mvaddstr(y + i + 3, x, "+=====");
+		for (k = 0; k < maxLength; k++)
+			addch('=');
+		addstr("=+");
+
+		/* draw option pointer */
+		mvaddch(y + option - top + 2, x + 7, '>' | A_BLINK);
+
+		refresh();
+
+		/* now get input */
+		buf = getch();
+		if (buf < 0x80)
+			buf = toupper(buf);
+
+		if (buf == 'Q' || buf == 27) {
+			/* quit or Esc */
+			option = -1;
+			gotInput = true;
+		} else if (buf == 'W' || buf == KEY_UP || buf == 'A' || buf == KEY_LEFT) {
+			if (option > 0) option--;
+		} else if (buf == 'S' || buf == KEY_DOWN || buf == 'D' || buf == KEY_RIGHT) {
+			if (option < optc - 1) option++;
+		} else if (buf == KEY_PPAGE) {
+			option -= rows;
+			if (option < 0) option = 0;
+		} else if (buf == KEY_NPAGE) {
+			option += rows;
+			if (option > optc - 1) option = optc - 1;
+		} else if (buf == KEY_HOME) {
+			option = 0;
+		} else if (buf == KEY_END) {
+			option = optc - 1;
+		} else if (buf == 10) {
+			/* return or enter */
+			gotInput = true;
+		}
+	} while (!gotInput);
+
+	/* un-blink the option cursor */
+	if (option != -1)
+		mvchgat(y + option - top + 2, x + 7, 1, A_NORMAL, 1, NULL);
+	return option;
+}
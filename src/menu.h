@@ -15,6 +15,11 @@ int menu(int optc, const char *title, ...);
    -1 if exit */
 int mvmenu(int y, int x, int optc, const char *title, ...);
 
+/* lets the user choose from optc options, showing rows of them at a time and
+   scrolling through the rest; returns the 0-indexed option chosen, or -1 if
+   exit */
+int mvlistMenu(int y, int x, int rows, const char *title, int optc, const char **options);
+
 /* internal va_list menu function */
 int vmenu(int y, int x, int optc, const char *title, va_list options);
 
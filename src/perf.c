@@ -0,0 +1,106 @@
+/*
+ * perf.c
+ *
+ * Defines the performance counters; empty unless CMINESWEEPER_PERF is defined
+ */
+
+#include "perf.h"
+
+#ifdef CMINESWEEPER_PERF
+
+#include <time.h>	/* clock_gettime */
+
+PerfCounter perfCounters[PERF_COUNTERS];
+uint64_t perfFrames[PERF_BUCKETS];
+
+static const char *names[PERF_COUNTERS] = {
+	"frames", "draw", "refresh", "openSquares", "allClear", "recountCovered", "save", "load"
+};
+static const char *units[PERF_COUNTERS] = {
+	"", "", "", "cells", "", "cells", "bytes", "bytes"
+};
+
+uint64_t perfNow(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void perfRecord(int counter, uint64_t nanoseconds, uint64_t items) {
+	/* the saver writes from its own thread */
+	__atomic_fetch_add(&perfCounters[counter].calls, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&perfCounters[counter].nanoseconds, nanoseconds, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&perfCounters[counter].items, items, __ATOMIC_RELAXED);
+}
+
+void perfFrame(uint64_t nanoseconds) {
+	uint64_t microseconds = nanoseconds / 1000;
+	int bucket = 0;
+
+	while (bucket < PERF_BUCKETS - 1 && microseconds >= 2) {
+		microseconds >>= 1;
+		bucket++;
+	}
+	__atomic_fetch_add(&perfFrames[bucket], 1, __ATOMIC_RELAXED);
+	perfRecord(PERF_FRAME, nanoseconds, 0);
+}
+
+double perfPercentile(double p) {
+	uint64_t total = 0, seen = 0;
+	int bucket;
+
+	for (bucket = 0; bucket < PERF_BUCKETS; bucket++)
+		total += perfFrames[bucket];
+	if (total == 0)
+		return 0.0;
+
+	for (bucket = 0; bucket < PERF_BUCKETS - 1; bucket++) {
+		seen += perfFrames[bucket];
+		if (seen >= p * total)
+			break;
+	}
+	return (double) (2ULL << bucket);
+}
+
+const char *perfName(int counter) {
+	return names[counter];
+}
+
+const char *perfUnit(int counter) {
+	return units[counter];
+}
+
+int perfDump(FILE *file) {
+	uint64_t most = 0;
+	int counter, bucket, i;
+
+	fprintf(file, "%-16s %12s %14s %12s %16s\n", "counter", "calls", "total ms", "avg us", "items");
+	for (counter = 0; counter < PERF_COUNTERS; counter++) {
+		const PerfCounter *c = &perfCounters[counter];
+		fprintf(file, "%-16s %12llu %14.3f %12.2f %16llu%s%s\n", names[counter],
+			(unsigned long long) c->calls, c->nanoseconds / 1e6,
+			(c->calls > 0) ? c->nanoseconds / 1e3 / c->calls : 0.0,
+			(unsigned long long) c->items, (*units[counter] != '\0') ? " " : "", units[counter]);
+	}
+
+	fprintf(file, "\nframe times: p50 < %.0f us, p90 < %.0f us, p99 < %.0f us\n",
+		perfPercentile(0.50), perfPercentile(0.90), perfPercentile(0.99));
+	for (bucket = 0; bucket < PERF_BUCKETS; bucket++) {
+		if (perfFrames[bucket] > most)
+			most = perfFrames[bucket];
+	}
+	for (bucket = 0; bucket < PERF_BUCKETS; bucket++) {
+		if (perfFrames[bucket] == 0)
+			continue;
+		if (bucket < PERF_BUCKETS - 1)
+			fprintf(file, "< %7llu us %10llu ", 2ULL << bucket, (unsigned long long) perfFrames[bucket]);
+		else
+			fprintf(file, "    slower %10llu ", (unsigned long long) perfFrames[bucket]);
+		for (i = 0; i < (int) (50 * perfFrames[bucket] / most); i++)
+			fputc('#', file);
+		fputc('\n', file);
+	}
+	return 0;
+}
+
+#endif	/* CMINESWEEPER_PERF */
@@ -0,0 +1,86 @@
+/*
+ * perf.h
+ *
+ * Contains the performance counters, which count and time the hot paths of the
+ * game and keep a histogram of frame times. They only exist when the game is
+ * built with CMINESWEEPER_PERF defined (make perf); otherwise the macros below
+ * expand to nothing and cost nothing.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#ifndef PERF_H
+#define PERF_H
+
+/* the counters, each of which counts calls, the nanoseconds spent in them and
+   the cells or bytes they handled */
+#define PERF_FRAME		0	/* iterations of the game loop */
+#define PERF_DRAW		1	/* drawing the board */
+#define PERF_REFRESH	2	/* refresh, which writes the changes to the terminal */
+#define PERF_OPEN		3	/* openSquares, and the cells it opened */
+#define PERF_ALL_CLEAR	4	/* allClear */
+#define PERF_RECOUNT	5	/* recountCovered, and the cells it scanned */
+#define PERF_SAVE		6	/* writing save files, and their bytes */
+#define PERF_LOAD		7	/* loading save files, and their bytes */
+#define PERF_COUNTERS	8
+
+/* frame times are sorted into buckets by powers of two of microseconds:
+   bucket 0 holds frames under 2 us, bucket k frames from 2^k us up to
+   2^(k+1) us, and the last bucket everything slower */
+#define PERF_BUCKETS	21
+
+#ifdef CMINESWEEPER_PERF
+
+typedef struct {
+	uint64_t calls;
+	uint64_t nanoseconds;
+	uint64_t items;			/* cells or bytes */
+} PerfCounter;
+
+extern PerfCounter perfCounters[PERF_COUNTERS];
+extern uint64_t perfFrames[PERF_BUCKETS];
+
+/* the monotonic clock in nanoseconds */
+uint64_t perfNow(void);
+
+/* adds a call taking the given nanoseconds and handling the given items to a
+   counter; safe to call from any thread */
+void perfRecord(int counter, uint64_t nanoseconds, uint64_t items);
+
+/* adds a frame to the histogram and to PERF_FRAME */
+void perfFrame(uint64_t nanoseconds);
+
+/* returns the frame time below which the fraction p of the frames fall, in
+   microseconds, as the upper end of its bucket */
+double perfPercentile(double p);
+
+/* returns the name of a counter, and of what its items are */
+const char *perfName(int counter);
+const char *perfUnit(int counter);
+
+/* prints every counter and the histogram to file */
+int perfDump(FILE *file);
+
+/* starts a timer in a new variable */
+#define PERF_START(var)					uint64_t var = perfNow()
+/* starts the timer in var over */
+#define PERF_RESTART(var)				((var) = perfNow())
+/* adds the time since var was started to a counter, with the items handled */
+#define PERF_STOP(counter, var, items)	perfRecord((counter), perfNow() - (var), (items))
+/* adds a call that isn't timed to a counter */
+#define PERF_COUNT(counter, items)		perfRecord((counter), 0, (items))
+/* adds the time since var was started to the frame histogram */
+#define PERF_FRAME_END(var)				perfFrame(perfNow() - (var))
+
+#else
+
+#define PERF_START(var)					((void) 0)
+#define PERF_RESTART(var)				((void) 0)
+#define PERF_STOP(counter, var, items)	((void) 0)
+#define PERF_COUNT(counter, items)		((void) 0)
+#define PERF_FRAME_END(var)				((void) 0)
+
+#endif	/* CMINESWEEPER_PERF */
+
+#endif /* PERF_H */
@@ -0,0 +1,1213 @@
+/*
+ * probability.c
+ *
+ * Defines functions for working out the chance of a mine under each square.
+ *
+ * The covered squares next to numbers (the frontier) are split into components
+ * that share no numbers. The configurations of each component are counted by
+ * backtracking, separately for every number of mines k it can hold, and the
+ * counts are cached by the component's structure, so the components a move
+ * doesn't touch are never counted again. The components are then combined by
+ * convolving their counts, with every total number of mines K on the frontier
+ * weighted by the C(u, M - K) ways of placing the remaining mines under the u
+ * other covered squares.
+ */
+
+#include <stdlib.h>
+#include <string.h>	/* memset, memcmp */
+#include <math.h>	/* exp, lgamma, frexp, ldexp */
+
+#include "probability.h"
+
+struct ComponentCounts {
+	uint64_t hash;
+	unsigned long stamp;	/* call to computeProbabilities that last used it */
+	int *key;			/* the component's structure, as built by computeProbabilities */
+	int keyLength;
+	int size;			/* number of squares in the component */
+	double *total;		/* total[k]: configurations with k mines, scaled so the largest is 1,
+						   or NULL if they couldn't be counted */
+	double *perSquare;	/* perSquare[i * (size + 1) + k]: the ones with a mine on square i */
+};
+
+/* the numbers and squares of one component, decoded from its key */
+typedef struct {
+	int size;			/* number of squares */
+	int numberCount;
+	int *need;			/* mines each number needs among the squares */
+	int *numberStart;	/* number j touches numberSquares[numberStart[j]] up to numberStart[j + 1] */
+	int *numberSquares;
+	int *squareStart;	/* square i touches squareNumbers[squareStart[i]] up to squareStart[i + 1] */
+	int *squareNumbers;
+	int *after;			/* for each entry of squareNumbers, the squares of that number decided later */
+	int *order;			/* order in which the squares are decided */
+	int *position;		/* position of every square in order */
+	int *first;			/* position of the first square of every number */
+	int *activeStart;	/* numbers half decided before position p: active[activeStart[p]] up to activeStart[p + 1] */
+	int *active;
+	int *remaining;		/* scratch space, mines each number still needs */
+} Structure;
+
+/* the most states a layer of countByLayers may hold before giving up */
+#define MAX_STATES 65536
+
+/* the states reached after deciding the first p squares. A state holds the
+   mines that every half decided number still needs, one byte each, and ways
+   holds, for every state, the number of ways to reach it with 0 to p mines,
+   scaled so the largest is 1. */
+typedef struct {
+	int width;				/* bytes per state: numbers half decided at this point */
+	int count;
+	int capacity;
+	unsigned char *keys;	/* keys[state * width + t] */
+	double *ways;			/* ways[state * (p + 1) + k] */
+	int *table;				/* open addressing hash table of state indices, -1 if free */
+	int tableSize;
+	size_t bytes;			/* memory allocated for the layer */
+} Layer;
+
+static void freeStructure(Structure *st) {
+	free(st->need);
+	free(st->numberStart);
+	free(st->numberSquares);
+	free(st->squareStart);
+	free(st->squareNumbers);
+	free(st->after);
+	free(st->order);
+	free(st->position);
+	free(st->first);
+	free(st->activeStart);
+	free(st->active);
+	free(st->remaining);
+}
+
+/* orders the squares breadth first from square start, returning the square
+   reached last */
+static int orderBreadthFirst(Structure *st, int start) {
+	int head = 0, tail = 0;
+	int i, j, n, s;
+
+	for (i = 0; i < st->size; i++)
+		st->position[i] = -1;
+	st->position[start] = tail;
+	st->order[tail++] = start;
+
+	while (head < tail) {
+		i = st->order[head++];
+		for (n = st->squareStart[i]; n < st->squareStart[i + 1]; n++) {
+			j = st->squareNumbers[n];
+			for (s = st->numberStart[j]; s < st->numberStart[j + 1]; s++) {
+				int q = st->numberSquares[s];
+				if (st->position[q] == -1) {
+					st->position[q] = tail;
+					st->order[tail++] = q;
+				}
+			}
+		}
+	}
+	return st->order[st->size - 1];
+}
+
+/* orders the squares starting from square start, always taking next the square
+   next to the ones already taken that finishes the most numbers and starts
+   the fewest */
+static void orderGreedily(Structure *st, int start) {
+	int *left = st->remaining;	/* undecided squares of every number */
+	int candidates = 1;
+	int i, j, n, s, p, c;
+
+	/* the candidates are the squares not yet taken that share a number with
+	   one that was; order doubles as the list of them, kept past position p */
+	for (i = 0; i < st->size; i++)
+		st->position[i] = -1;
+	for (j = 0; j < st->numberCount; j++)
+		left[j] = st->numberStart[j + 1] - st->numberStart[j];
+	st->order[0] = start;
+	st->position[start] = 0;
+
+	for (p = 0; p < st->size; p++) {
+		int best = p, bestScore = 0, square;
+
+		/* only happens if the squares aren't all connected */
+		for (i = 0; p == candidates; i++) {
+			if (st->position[i] == -1) {
+				st->position[i] = candidates;
+				st->order[candidates++] = i;
+			}
+		}
+
+		for (c = p; c < candidates; c++) {
+			int score = 0;
+			i = st->order[c];
+			for (n = st->squareStart[i]; n < st->squareStart[i + 1]; n++) {
+				j = st->squareNumbers[n];
+				if (left[j] == st->numberStart[j + 1] - st->numberStart[j])
+					score++;	/* starts a number */
+				if (left[j] == 1)
+					score--;	/* finishes a number */
+			}
+			if (c == p || score < bestScore) {
+				best = c;
+				bestScore = score;
+			}
+		}
+
+		/* move the best candidate to position p */
+		square = st->order[best];
+		st->order[best] = st->order[p];
+		st->position[st->order[best]] = best;
+		st->order[p] = square;
+		st->position[square] = p;
+
+		for (n = st->squareStart[square]; n < st->squareStart[square + 1]; n++) {
+			j = st->squareNumbers[n];
+			left[j]--;
+			for (s = st->numberStart[j]; s < st->numberStart[j + 1]; s++) {
+				int q = st->numberSquares[s];
+				if (st->position[q] == -1) {
+					st->position[q] = candidates;
+					st->order[candidates++] = q;
+				}
+			}
+		}
+	}
+}
+
+/* returns the most numbers half decided at once in the current order, using
+   depth, which has room for size + 1 ints */
+static int orderWidth(const Structure *st, int *depth) {
+	int widest = 0, j, n, p;
+
+	memset(depth, 0, (st->size + 1) * sizeof(int));
+	for (j = 0; j < st->numberCount; j++) {
+		int first = st->size, last = 0;
+		for (n = st->numberStart[j]; n < st->numberStart[j + 1]; n++) {
+			p = st->position[st->numberSquares[n]];
+			if (p < first) first = p;
+			if (p > last) last = p;
+		}
+		depth[first + 1]++;
+		depth[last + 1]--;
+	}
+	for (p = 1; p <= st->size; p++) {
+		depth[p] += depth[p - 1];
+		if (depth[p] > widest)
+			widest = depth[p];
+	}
+	return widest;
+}
+
+/* orders the squares so that few numbers are half decided at any time, since
+   the number of states countByLayers goes through grows quickly with them.
+   Row-major order suits blobs, breadth first order suits long thin frontiers
+   and the greedy order often beats both, so all three are tried and the
+   narrowest is kept. Returns -1 if memory runs out. */
+static int orderSquares(Structure *st) {
+	int *best = (int *) malloc((st->size + 1) * sizeof(int));
+	int *depth = (int *) malloc((st->size + 1) * sizeof(int));
+	int bestWidth, width, end, i, attempt;
+
+	if (best == NULL || depth == NULL) {
+		free(best);
+		free(depth);
+		return -1;
+	}
+
+	/* the squares are numbered in row-major order to begin with */
+	for (i = 0; i < st->size; i++)
+		st->order[i] = st->position[i] = i;
+	bestWidth = orderWidth(st, depth);
+	memcpy(best, st->order, st->size * sizeof(int));
+
+	/* start the others at one end of the component */
+	end = orderBreadthFirst(st, 0);
+	for (attempt = 0; attempt < 2; attempt++) {
+		if (attempt == 0)
+			orderBreadthFirst(st, end);
+		else
+			orderGreedily(st, end);
+		width = orderWidth(st, depth);
+		if (width < bestWidth) {
+			bestWidth = width;
+			memcpy(best, st->order, st->size * sizeof(int));
+		}
+	}
+
+	memcpy(st->order, best, st->size * sizeof(int));
+	for (i = 0; i < st->size; i++)
+		st->position[st->order[i]] = i;
+	free(best);
+	free(depth);
+	return 0;
+}
+
+/* decodes key, which holds the number of squares, the number of numbers, and
+   then for every number the mines it still needs, how many squares it touches
+   and their indices; returns -1 if memory runs out */
+static int decodeKey(const int *key, Structure *st) {
+	int size = key[0], numberCount = key[1], entries = 0;
+	int i, j, n, s, p, pos, last;
+
+	for (pos = 2, j = 0; j < numberCount; j++) {
+		entries += key[pos + 1];
+		pos += 2 + key[pos + 1];
+	}
+
+	st->size = size;
+	st->numberCount = numberCount;
+	st->need = (int *) malloc((numberCount + 1) * sizeof(int));
+	st->numberStart = (int *) malloc((numberCount + 1) * sizeof(int));
+	st->numberSquares = (int *) malloc((entries + 1) * sizeof(int));
+	st->squareStart = (int *) calloc(size + 1, sizeof(int));
+	st->squareNumbers = (int *) malloc((entries + 1) * sizeof(int));
+	st->after = (int *) malloc((entries + 1) * sizeof(int));
+	st->order = (int *) malloc(size * sizeof(int));
+	st->position = (int *) malloc(size * sizeof(int));
+	st->first = (int *) malloc((numberCount + 1) * sizeof(int));
+	st->activeStart = (int *) calloc(size + 2, sizeof(int));
+	st->active = NULL;
+	st->remaining = (int *) malloc((numberCount + 1) * sizeof(int));
+	if (st->need == NULL || st->numberStart == NULL || st->numberSquares == NULL
+			|| st->squareStart == NULL || st->squareNumbers == NULL || st->after == NULL
+			|| st->order == NULL || st->position == NULL || st->first == NULL
+			|| st->activeStart == NULL || st->remaining == NULL)
+		return -1;
+
+	/* the squares of every number, and from them the numbers of every square */
+	for (pos = 2, j = 0, n = 0; j < numberCount; j++) {
+		st->need[j] = key[pos];
+		st->numberStart[j] = n;
+		for (s = 0; s < key[pos + 1]; s++) {
+			st->numberSquares[n++] = key[pos + 2 + s];
+			st->squareStart[key[pos + 2 + s] + 1]++;
+		}
+		pos += 2 + key[pos + 1];
+	}
+	st->numberStart[numberCount] = n;
+	for (i = 0; i < size; i++)
+		st->squareStart[i + 1] += st->squareStart[i];
+	for (j = 0; j < numberCount; j++) {
+		for (n = st->numberStart[j]; n < st->numberStart[j + 1]; n++)
+			st->squareNumbers[st->squareStart[st->numberSquares[n]]++] = j;
+	}
+	for (i = size; i > 0; i--)
+		st->squareStart[i] = st->squareStart[i - 1];
+	st->squareStart[0] = 0;
+
+	if (orderSquares(st) == -1)
+		return -1;
+
+	/* where every number starts and ends in the order */
+	for (j = 0; j < numberCount; j++) {
+		st->first[j] = size;
+		for (n = st->numberStart[j]; n < st->numberStart[j + 1]; n++) {
+			if (st->position[st->numberSquares[n]] < st->first[j])
+				st->first[j] = st->position[st->numberSquares[n]];
+		}
+	}
+	for (i = 0; i < size; i++) {
+		for (n = st->squareStart[i]; n < st->squareStart[i + 1]; n++) {
+			j = st->squareNumbers[n];
+			st->after[n] = 0;
+			for (s = st->numberStart[j]; s < st->numberStart[j + 1]; s++) {
+				if (st->position[st->numberSquares[s]] > st->position[i])
+					st->after[n]++;
+			}
+		}
+	}
+
+	/* number j is half decided before position p if first[j] < p <= last */
+	for (j = 0; j < numberCount; j++) {
+		last = 0;
+		for (n = st->numberStart[j]; n < st->numberStart[j + 1]; n++) {
+			if (st->position[st->numberSquares[n]] > last)
+				last = st->position[st->numberSquares[n]];
+		}
+		for (p = st->first[j] + 1; p <= last; p++)
+			st->activeStart[p + 1]++;
+	}
+	for (p = 0; p <= size; p++) {
+		st->activeStart[p + 1] += st->activeStart[p];
+	}
+	st->active = (int *) malloc((st->activeStart[size + 1] + 1) * sizeof(int));
+	if (st->active == NULL)
+		return -1;
+	for (j = 0; j < numberCount; j++) {
+		last = 0;
+		for (n = st->numberStart[j]; n < st->numberStart[j + 1]; n++) {
+			if (st->position[st->numberSquares[n]] > last)
+				last = st->position[st->numberSquares[n]];
+		}
+		for (p = st->first[j] + 1; p <= last; p++)
+			st->active[st->activeStart[p]++] = j;
+	}
+	for (p = size + 1; p > 0; p--)
+		st->activeStart[p] = st->activeStart[p - 1];
+	st->activeStart[0] = 0;
+
+	return 0;
+}
+
+/* decides the square at position p, with a mine if v is 1, in the state key of
+   layer p, and stores the resulting state of layer p + 1 in next; returns false
+   if that leaves a number with too many or too few mines */
+static bool transition(const Structure *st, int p, const unsigned char *key, int v, unsigned char *next) {
+	int *remaining = st->remaining;
+	int i = st->order[p];
+	int n, t;
+
+	for (t = 0; t < st->activeStart[p + 1] - st->activeStart[p]; t++)
+		remaining[st->active[st->activeStart[p] + t]] = key[t];
+
+	for (n = st->squareStart[i]; n < st->squareStart[i + 1]; n++) {
+		int j = st->squareNumbers[n];
+		if (st->first[j] == p)
+			remaining[j] = st->need[j];
+		remaining[j] -= v;
+		if (remaining[j] < 0 || remaining[j] > st->after[n])
+			return false;
+	}
+
+	for (t = 0; t < st->activeStart[p + 2] - st->activeStart[p + 1]; t++)
+		next[t] = remaining[st->active[st->activeStart[p + 1] + t]];
+	return true;
+}
+
+static unsigned int hashState(const unsigned char *key, int width) {
+	unsigned int hash = 2166136261u;	/* FNV-1a */
+	int t;
+
+	for (t = 0; t < width; t++) {
+		hash ^= key[t];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/* returns the index of the state key in layer, or -1 if it isn't there */
+static int findState(const Layer *layer, const unsigned char *key) {
+	int slot;
+
+	if (layer->tableSize == 0)
+		return -1;
+	slot = hashState(key, layer->width) & (layer->tableSize - 1);
+	while (layer->table[slot] != -1) {
+		if (memcmp(&layer->keys[(size_t) layer->table[slot] * layer->width], key, layer->width) == 0)
+			return layer->table[slot];
+		slot = (slot + 1) & (layer->tableSize - 1);
+	}
+	return -1;
+}
+
+/* returns the index of the state key in layer, adding it with no ways to reach
+   it if it isn't there, or -1 if the layer is full, or growing it would take
+   the memory in *used past PROBABILITY_WORK_BYTES, or memory runs out; length
+   is the length of the vectors in ways */
+static int addState(Layer *layer, const unsigned char *key, int length, size_t *used) {
+	int index = findState(layer, key);
+	int slot, i;
+
+	if (index != -1)
+		return index;
+	if (layer->count == MAX_STATES)
+		return -1;
+
+	if (layer->count == layer->capacity) {
+		int capacity = layer->capacity ? 2 * layer->capacity : 16;
+		size_t grown = (size_t) (capacity - layer->capacity) * (layer->width + length * sizeof(double));
+		unsigned char *keys;
+		double *ways;
+		if (*used + grown > PROBABILITY_WORK_BYTES)
+			return -1;
+		keys = (unsigned char *) realloc(layer->keys, (size_t) capacity * layer->width + 1);
+		if (keys == NULL)
+			return -1;
+		layer->keys = keys;
+		ways = (double *) realloc(layer->ways, (size_t) capacity * length * sizeof(double));
+		if (ways == NULL)
+			return -1;
+		layer->ways = ways;
+		layer->capacity = capacity;
+		layer->bytes += grown;
+		*used += grown;
+	}
+
+	/* keep the table at most half full */
+	if (2 * (layer->count + 1) > layer->tableSize) {
+		int size = layer->tableSize ? 2 * layer->tableSize : 32;
+		size_t grown = (size_t) (size - layer->tableSize) * sizeof(int);
+		int *table;
+		if (*used + grown > PROBABILITY_WORK_BYTES)
+			return -1;
+		table = (int *) malloc(size * sizeof(int));
+		if (table == NULL)
+			return -1;
+		free(layer->table);
+		layer->table = table;
+		layer->tableSize = size;
+		layer->bytes += grown;
+		*used += grown;
+		for (i = 0; i < size; i++)
+			table[i] = -1;
+		for (i = 0; i < layer->count; i++) {
+			slot = hashState(&layer->keys[(size_t) i * layer->width], layer->width) & (size - 1);
+			while (table[slot] != -1)
+				slot = (slot + 1) & (size - 1);
+			table[slot] = i;
+		}
+	}
+
+	index = layer->count++;
+	memcpy(&layer->keys[(size_t) index * layer->width], key, layer->width);
+	memset(&layer->ways[(size_t) index * length], 0, length * sizeof(double));
+	slot = hashState(key, layer->width) & (layer->tableSize - 1);
+	while (layer->table[slot] != -1)
+		slot = (slot + 1) & (layer->tableSize - 1);
+	layer->table[slot] = index;
+	return index;
+}
+
+/* frees the memory of layer, taking it off *used, and empties it */
+static void freeLayer(Layer *layer, size_t *used) {
+	free(layer->keys);
+	free(layer->ways);
+	free(layer->table);
+	*used -= layer->bytes;
+	layer->keys = NULL;
+	layer->ways = NULL;
+	layer->table = NULL;
+	layer->count = layer->capacity = layer->tableSize = 0;
+	layer->bytes = 0;
+}
+
+/* Deciding a square at most doubles the sum of the forward counts of a layer,
+   and the largest backward count, so scaling them down every RESCALE_EVERY
+   layers keeps them far from overflowing. */
+#define RESCALE_EVERY 256
+
+/* scales v down by a power of two, which is exact, so its largest element is
+   below 1, and returns that power */
+static int rescale(double *v, long length) {
+	double largest = 0.0, factor;
+	long i;
+	int exponent;
+
+	for (i = 0; i < length; i++) {
+		if (v[i] > largest)
+			largest = v[i];
+	}
+	if (largest == 0.0)
+		return 0;
+	frexp(largest, &exponent);
+	factor = ldexp(1.0, -exponent);
+	for (i = 0; i < length; i++)
+		v[i] *= factor;
+	return exponent;
+}
+
+/* builds layer p + 1 from layer p, and stores the power of two its ways were
+   scaled down by in scale[p + 1], on top of scale[p]; returns -1 if it
+   doesn't fit in PROBABILITY_WORK_BYTES */
+static int forwardLayer(const Structure *st, Layer *layers, int p, int *scale,
+		unsigned char *next, size_t *used) {
+	Layer *from = &layers[p], *to = &layers[p + 1];
+	int s, v, a, index;
+
+	for (s = 0; s < from->count; s++) {
+		for (v = 0; v <= 1; v++) {
+			if (!transition(st, p, &from->keys[(size_t) s * from->width], v, next))
+				continue;
+			index = addState(to, next, p + 2, used);
+			if (index == -1)
+				return -1;
+			for (a = 0; a <= p; a++)
+				to->ways[(size_t) index * (p + 2) + a + v] += from->ways[(size_t) s * (p + 1) + a];
+		}
+	}
+
+	scale[p + 1] = scale[p];
+	if ((p + 1) % RESCALE_EVERY == 0)
+		scale[p + 1] += rescale(to->ways, (long) to->count * (p + 2));
+	return 0;
+}
+
+/* counts the configurations by deciding the squares one at a time in order and
+   merging the ways that leave the half decided numbers needing the same mines.
+   A forward pass counts the ways to reach every state, and a backward pass the
+   ways to finish from it, which multiplied give the configurations with a mine
+   on each square. The work grows with the number of states rather than the
+   number of configurations.
+
+   Once the layers take more than a quarter of PROBABILITY_WORK_BYTES, only
+   every span-th layer of the forward pass is kept, and the ones in between
+   are built again from the last one kept when the backward pass gets to them,
+   so about 2 * sqrt(size) layers are held at once. The counts of every layer
+   are scaled down when they grow too large, and brought back to the scale of
+   total as they are added to perSquare. */
+static int countByLayers(const Structure *st, double *total, double *perSquare) {
+	const int size = st->size;
+	size_t used = ((size_t) size * (size + 1) + size + 1) * sizeof(double);
+	size_t backBytes = sizeof(double), nextBytes;
+	Layer *layers;
+	double *back = NULL, *nextBack;
+	unsigned char *next;
+	int *scale, backScale = 0;
+	int span, p, q, s, v, a, b, index, status = -1;
+
+	layers = (Layer *) calloc(size + 1, sizeof(Layer));
+	scale = (int *) malloc((size + 1) * sizeof(int));
+	next = (unsigned char *) malloc(st->activeStart[size + 1] + 1);
+	if (layers == NULL || scale == NULL || next == NULL) {
+		free(layers);
+		free(scale);
+		free(next);
+		return -1;
+	}
+	for (p = 0; p <= size; p++)
+		layers[p].width = st->activeStart[p + 1] - st->activeStart[p];
+	for (span = 1; span * span < size + 1; span++)
+		;
+
+	/* forward: ways[k] of a state in layer p counts the ways to reach it with
+	   k mines among the first p squares */
+	if (addState(&layers[0], next, 1, &used) == -1)
+		goto done;
+	layers[0].ways[0] = 1.0;
+	scale[0] = 0;
+	for (p = 0; p < size; p++) {
+		if (forwardLayer(st, layers, p, scale, next, &used) == -1)
+			goto done;
+		if (p % span != 0 && used > PROBABILITY_WORK_BYTES / 4)
+			freeLayer(&layers[p], &used);
+	}
+	if (layers[size].count == 0) {
+		status = 0;	/* no configuration satisfies every number */
+		goto done;
+	}
+	for (a = 0; a <= size; a++)
+		total[a] = layers[size].ways[a];
+
+	/* backward: back[k] of a state in layer p counts the ways to finish from it
+	   with k mines among the squares from position p on, scaled down by
+	   2^backScale */
+	back = (double *) malloc(sizeof(double));
+	if (back == NULL)
+		goto done;
+	used += backBytes;
+	back[0] = 1.0;
+	for (p = size - 1; p >= 0; p--) {
+		const int length = size - p + 1;
+		const int i = st->order[p];
+		/* brings ways * back to the scale of total */
+		const double factor = ldexp(1.0, scale[p] + backScale - scale[size]);
+
+		/* build the layers since the last one kept again; layer 0 is
+		   always kept */
+		if (layers[p].ways == NULL) {
+			for (q = p - 1; layers[q].ways == NULL; q--)
+				;
+			for (; q < p; q++) {
+				if (forwardLayer(st, layers, q, scale, next, &used) == -1)
+					goto done;
+			}
+		}
+
+		nextBytes = (size_t) layers[p].count * length * sizeof(double);
+		if (used + nextBytes > PROBABILITY_WORK_BYTES)
+			goto done;
+		nextBack = (double *) calloc((size_t) layers[p].count * length, sizeof(double));
+		if (nextBack == NULL)
+			goto done;
+		used += nextBytes;
+		for (s = 0; s < layers[p].count; s++) {
+			for (v = 0; v <= 1; v++) {
+				const double *rest;
+				int low, high;
+				if (!transition(st, p, &layers[p].keys[(size_t) s * layers[p].width], v, next))
+					continue;
+				index = findState(&layers[p + 1], next);
+				rest = &back[(size_t) index * (length - 1)];
+
+				/* only a narrow band of mine counts is possible from a state */
+				for (low = 0; low < length - 1 && rest[low] == 0.0; low++)
+					;
+				for (high = length - 2; high >= low && rest[high] == 0.0; high--)
+					;
+				for (b = low; b <= high; b++)
+					nextBack[(size_t) s * length + b + v] += rest[b];
+
+				/* configurations through this state with a mine on square i */
+				if (v == 0)
+					continue;
+				for (a = 0; a <= p; a++) {
+					double ways = layers[p].ways[(size_t) s * (p + 1) + a] * factor;
+					if (ways == 0.0)
+						continue;
+					for (b = low; b <= high; b++)
+						perSquare[i * (size + 1) + a + 1 + b] += ways * rest[b];
+				}
+			}
+		}
+		free(back);
+		used -= backBytes;
+		back = nextBack;
+		backBytes = nextBytes;
+		if (p % RESCALE_EVERY == 0)
+			backScale += rescale(back, (long) layers[p].count * length);
+		freeLayer(&layers[p + 1], &used);
+	}
+	status = 0;
+
+done:
+	for (p = 0; p <= size; p++)
+		freeLayer(&layers[p], &used);
+	free(layers);
+	free(scale);
+	free(back);
+	free(next);
+	return status;
+}
+
+/* counts the configurations of the component described by key */
+static int countConfigurations(const int *key, ComponentCounts *counts) {
+	Structure st;
+	double largest = 0.0;
+	int size = key[0];
+	int i, status = -1;
+
+	memset(&st, 0, sizeof(Structure));
+	counts->size = size;
+	if ((size_t) size * (size + 1) * sizeof(double) > PROBABILITY_WORK_BYTES)
+		return -1;
+	counts->total = (double *) calloc(size + 1, sizeof(double));
+	counts->perSquare = (double *) calloc((size_t) size * (size + 1), sizeof(double));
+	if (counts->total == NULL || counts->perSquare == NULL)
+		goto done;
+
+	if (decodeKey(key, &st) == -1 || countByLayers(&st, counts->total, counts->perSquare) == -1)
+		goto done;
+
+	/* only the ratios of the counts matter */
+	for (i = 0; i <= size; i++) {
+		if (counts->total[i] > largest)
+			largest = counts->total[i];
+	}
+	if (largest > 0.0) {
+		for (i = 0; i <= size; i++)
+			counts->total[i] /= largest;
+		for (i = 0; i < size * (size + 1); i++)
+			counts->perSquare[i] /= largest;
+	}
+	status = 0;
+
+done:
+	freeStructure(&st);
+	return status;
+}
+
+static void freeCounts(ComponentCounts *counts) {
+	free(counts->key);
+	free(counts->total);
+	free(counts->perSquare);
+	memset(counts, 0, sizeof(ComponentCounts));
+}
+
+/* returns the memory taken by counts */
+static size_t countsBytes(const ComponentCounts *counts) {
+	return counts->keyLength * sizeof(int)
+		+ ((size_t) counts->size * (counts->size + 1) + counts->size + 1) * sizeof(double);
+}
+
+/* drops the entries of the cache used the longest ago until it takes at most
+   PROBABILITY_CACHE_BYTES, keeping the ones used by the current call */
+static void trimCache(Probability *probability) {
+	while (probability->cacheBytes > PROBABILITY_CACHE_BYTES) {
+		ComponentCounts *oldest = NULL;
+		int i;
+
+		for (i = 0; i < PROBABILITY_CACHE_SIZE; i++) {
+			ComponentCounts *entry = &probability->cache[i];
+			if (entry->key != NULL && entry->stamp != probability->calls
+					&& (oldest == NULL || entry->stamp < oldest->stamp))
+				oldest = entry;
+		}
+		if (oldest == NULL)
+			return;
+		probability->cacheBytes -= countsBytes(oldest);
+		freeCounts(oldest);
+	}
+}
+
+/* returns the counts for the component described by key, counting them unless
+   the same component was seen recently, or NULL if they can't be counted
+   within PROBABILITY_WORK_BYTES or memory runs out. If
+   the slot in the cache holds another component used by the current call, the
+   counts are stored in spare instead. */
+static const ComponentCounts *lookupCounts(Probability *probability, const int *key, int keyLength,
+		ComponentCounts *spare) {
+	uint64_t hash = 14695981039346656037ULL;	/* FNV-1a */
+	ComponentCounts *entry;
+	int i;
+
+	for (i = 0; i < keyLength; i++) {
+		hash ^= (uint32_t) key[i];
+		hash *= 1099511628211ULL;
+	}
+
+	entry = &probability->cache[hash % PROBABILITY_CACHE_SIZE];
+	if (entry->key != NULL && entry->hash == hash && entry->keyLength == keyLength
+			&& memcmp(entry->key, key, keyLength * sizeof(int)) == 0) {
+		entry->stamp = probability->calls;
+		return (entry->total != NULL) ? entry : NULL;
+	}
+
+	if (entry->key != NULL && entry->stamp == probability->calls)
+		entry = spare;
+	else if (entry->key != NULL)
+		probability->cacheBytes -= countsBytes(entry);
+	freeCounts(entry);
+	entry->key = (int *) malloc(keyLength * sizeof(int));
+	if (entry->key == NULL)
+		return NULL;
+	memcpy(entry->key, key, keyLength * sizeof(int));
+	entry->hash = hash;
+	entry->stamp = probability->calls;
+	entry->keyLength = keyLength;
+	if (countConfigurations(key, entry) == -1) {
+		/* remember that it can't be counted, so the next call doesn't try
+		   again */
+		free(entry->total);
+		free(entry->perSquare);
+		entry->total = entry->perSquare = NULL;
+		entry->size = 0;
+	}
+
+	if (entry != spare) {
+		probability->cacheBytes += countsBytes(entry);
+		trimCache(probability);
+	}
+	return (entry->total != NULL) ? entry : NULL;
+}
+
+/* stores the convolution of a and b in out, dropping the terms past cap, and
+   returns its length; out may not overlap a or b */
+static int convolve(const double *a, int lengthA, const double *b, int lengthB, double *out, int cap) {
+	int length = lengthA + lengthB - 1;
+	int i, j;
+
+	if (length > cap + 1)
+		length = cap + 1;
+	memset(out, 0, length * sizeof(double));
+	for (i = 0; i < lengthA && i < length; i++) {
+		if (a[i] == 0.0)
+			continue;
+		for (j = 0; j < lengthB && i + j < length; j++)
+			out[i + j] += a[i] * b[j];
+	}
+	return length;
+}
+
+/* divides v by its largest element, so long products don't overflow */
+static void normalize(double *v, int length) {
+	double largest = 0.0;
+	int i;
+
+	for (i = 0; i < length; i++) {
+		if (v[i] > largest)
+			largest = v[i];
+	}
+	if (largest > 0.0) {
+		for (i = 0; i < length; i++)
+			v[i] /= largest;
+	}
+}
+
+static long findRoot(long *parent, long i) {
+	while (parent[i] != i) {
+		parent[i] = parent[parent[i]];	/* path halving */
+		i = parent[i];
+	}
+	return i;
+}
+
+static inline bool isCovered(const Board *board, int x, int y) {
+	return 1 <= x && x <= board->width && 1 <= y && y <= board->height
+		&& (CELL(*board, x, y) & MASK_CHAR) == '+';
+}
+
+int initProbability(Probability *probability, Board *board) {
+	probability->board = board;
+	probability->cells = (long) (board->width + 2) * (board->height + 2);
+	probability->calls = 0;
+	probability->cacheBytes = 0;
+
+	probability->odds = (double *) calloc(probability->cells, sizeof(double));
+	probability->parent = (long *) malloc(probability->cells * sizeof(long));
+	probability->component = (int *) malloc(probability->cells * sizeof(int));
+	probability->local = (int *) malloc(probability->cells * sizeof(int));
+	probability->cache = (ComponentCounts *) calloc(PROBABILITY_CACHE_SIZE, sizeof(ComponentCounts));
+	if (probability->odds == NULL || probability->parent == NULL || probability->component == NULL
+			|| probability->local == NULL || probability->cache == NULL) {
+		freeProbability(probability);
+		return -1;
+	}
+	return 0;
+}
+
+int freeProbability(Probability *probability) {
+	int i;
+
+	if (probability->cache != NULL) {
+		for (i = 0; i < PROBABILITY_CACHE_SIZE; i++)
+			freeCounts(&probability->cache[i]);
+	}
+	free(probability->odds);
+	free(probability->parent);
+	free(probability->component);
+	free(probability->local);
+	free(probability->cache);
+	probability->odds = NULL;
+	probability->parent = NULL;
+	probability->component = NULL;
+	probability->local = NULL;
+	probability->cache = NULL;
+	return 0;
+}
+
+int computeProbabilities(Probability *probability, long minesLeft) {
+	const Board *board = probability->board;
+	const long stride = board->width + 2;
+	long *parent = probability->parent;
+	int *component = probability->component;
+	int *local = probability->local;
+	double *odds = probability->odds;
+
+	long frontier = 0, covered = 0, outside;
+	int componentCount = 0;
+	int *sizes = NULL, *start = NULL, *keyStart = NULL, *keyEnd = NULL, *keys = NULL;
+	long *squares = NULL;
+	const ComponentCounts **counts = NULL;
+	ComponentCounts *spares = NULL;
+	double *weights = NULL, *products = NULL, *contexts = NULL;
+	long *offset = NULL;
+	int *length = NULL;
+	int leaves, cap, status = -1;
+	double maxLog = -HUGE_VAL, z;
+	long i, j;
+	int c, h, k, n, x, y;
+
+	if (minesLeft < 0)
+		return -1;
+	probability->calls++;
+
+	/* join the covered squares around each number into one component */
+	for (y = 1; y <= board->height; y++) {
+		for (x = 1; x <= board->width; x++) {
+			i = y * stride + x;
+			parent[i] = -1;
+			component[i] = -1;
+			odds[i] = ((CELL(*board, x, y) & MASK_CHAR) == 'P') ? 1.0 : 0.0;
+			if ((CELL(*board, x, y) & MASK_CHAR) == '+')
+				covered++;
+		}
+	}
+	for (y = 1; y <= board->height; y++) {
+		for (x = 1; x <= board->width; x++) {
+			unsigned char d = CELL(*board, x, y) & MASK_CHAR;
+			long first = -1;
+
+			if (d < '1' || '8' < d)
+				continue;
+			for (k = -1; k <= 1; k++) {
+				for (h = -1; h <= 1; h++) {
+					if (!isCovered(board, x + h, y + k))
+						continue;
+					j = (y + k) * stride + x + h;
+					if (parent[j] == -1) {
+						parent[j] = j;
+						frontier++;
+					}
+					if (first == -1)
+						first = j;
+					else
+						parent[findRoot(parent, j)] = findRoot(parent, first);
+				}
+			}
+		}
+	}
+	outside = covered - frontier;
+
+	/* number the components and the squares within them, in row-major order */
+	sizes = (int *) calloc(frontier + 1, sizeof(int));
+	squares = (long *) malloc((frontier + 1) * sizeof(long));
+	if (sizes == NULL || squares == NULL)
+		goto done;
+	for (y = 1; y <= board->height; y++) {
+		for (x = 1; x <= board->width; x++) {
+			i = y * stride + x;
+			if (parent[i] == -1)
+				continue;
+			j = findRoot(parent, i);
+			if (component[j] == -1)
+				component[j] = componentCount++;
+			component[i] = component[j];
+			local[i] = sizes[component[i]]++;
+		}
+	}
+	start = (int *) malloc((componentCount + 1) * sizeof(int));
+	keyStart = (int *) calloc(componentCount + 1, sizeof(int));
+	keyEnd = (int *) malloc((componentCount + 1) * sizeof(int));
+	counts = (const ComponentCounts **) malloc((componentCount + 1) * sizeof(ComponentCounts *));
+	spares = (ComponentCounts *) calloc(componentCount + 1, sizeof(ComponentCounts));
+	if (start == NULL || keyStart == NULL || keyEnd == NULL || counts == NULL || spares == NULL)
+		goto done;
+	for (start[0] = 0, c = 0; c < componentCount; c++)
+		start[c + 1] = start[c] + sizes[c];
+	for (y = 1; y <= board->height; y++) {
+		for (x = 1; x <= board->width; x++) {
+			i = y * stride + x;
+			if (parent[i] != -1)
+				squares[start[component[i]] + local[i]] = i;
+		}
+	}
+
+	/* describe every component by its numbers: the mines each one still needs
+	   and the squares it touches. Two components with the same description
+	   have the same configurations, wherever they are on the board. */
+	for (y = 1; y <= board->height; y++) {
+		for (x = 1; x <= board->width; x++) {
+			unsigned char d = CELL(*board, x, y) & MASK_CHAR;
+			int touching = 0, remaining;
+
+			if (d < '1' || '8' < d)
+				continue;
+			remaining = d - '0';
+			for (k = -1; k <= 1; k++) {
+				for (h = -1; h <= 1; h++) {
+					if (isCovered(board, x + h, y + k)) {
+						touching++;
+						c = component[(y + k) * stride + x + h];
+					} else if (1 <= x + h && x + h <= board->width && 1 <= y + k && y + k <= board->height
+							&& (CELL(*board, x + h, y + k) & MASK_CHAR) == 'P') {
+						remaining--;
+					}
+				}
+			}
+			if (remaining < 0 || remaining > touching)
+				goto done;	/* the flags around this number are wrong */
+			if (touching > 0)
+				keyStart[c + 1] += 2 + touching;
+		}
+	}
+	for (c = 0; c < componentCount; c++) {
+		keyStart[c + 1] += keyStart[c] + 2;
+		keyEnd[c] = keyStart[c] + 2;
+	}
+	keys = (int *) malloc((keyStart[componentCount] + 1) * sizeof(int));
+	if (keys == NULL)
+		goto done;
+	for (c = 0; c < componentCount; c++) {
+		keys[keyStart[c]] = sizes[c];
+		keys[keyStart[c] + 1] = 0;
+	}
+	for (y = 1; y <= board->height; y++) {
+		for (x = 1; x <= board->width; x++) {
+			unsigned char d = CELL(*board, x, y) & MASK_CHAR;
+			int *key, touching = 0;
+
+			if (d < '1' || '8' < d)
+				continue;
+			c = -1;
+			for (k = -1; k <= 1; k++) {
+				for (h = -1; h <= 1; h++) {
+					if (isCovered(board, x + h, y + k))
+						c = component[(y + k) * stride + x + h];
+				}
+			}
+			if (c == -1)
+				continue;
+			key = &keys[keyEnd[c]];
+			key[0] = d - '0';
+			for (k = -1; k <= 1; k++) {
+				for (h = -1; h <= 1; h++) {
+					if (isCovered(board, x + h, y + k))
+						key[2 + touching++] = local[(y + k) * stride + x + h];
+					else if (1 <= x + h && x + h <= board->width && 1 <= y + k && y + k <= board->height
+							&& (CELL(*board, x + h, y + k) & MASK_CHAR) == 'P')
+						key[0]--;
+				}
+			}
+			key[1] = touching;
+			keyEnd[c] += 2 + touching;
+			keys[keyStart[c] + 1]++;
+		}
+	}
+	for (c = 0; c < componentCount; c++) {
+		counts[c] = lookupCounts(probability, &keys[keyStart[c]], keyEnd[c] - keyStart[c], &spares[c]);
+		if (counts[c] == NULL)
+			goto done;
+	}
+
+	/* weight of every total number of mines K on the frontier; totals beyond
+	   the mines left are impossible, so no vector needs to be longer than cap */
+	cap = (frontier < minesLeft) ? frontier : minesLeft;
+	weights = (double *) malloc((cap + 1) * sizeof(double));
+	if (weights == NULL)
+		goto done;
+	for (k = 0; k <= cap; k++) {
+		if (minesLeft - k > outside) {
+			weights[k] = -HUGE_VAL;
+			continue;
+		}
+		weights[k] = lgamma(outside + 1.0) - lgamma(minesLeft - k + 1.0)
+			- lgamma(outside - minesLeft + k + 1.0);
+		if (weights[k] > maxLog)
+			maxLog = weights[k];
+	}
+	if (maxLog == -HUGE_VAL)
+		goto done;	/* more mines left than covered squares */
+	for (k = 0; k <= cap; k++)
+		weights[k] = exp(weights[k] - maxLog);
+
+	/* Multiply the components together pairwise in a binary tree, whose leaves
+	   are the components (padded with ones) and whose root holds the ways to
+	   place K mines on the whole frontier. */
+	for (leaves = 1; leaves < componentCount; leaves *= 2)
+		;
+	offset = (long *) malloc(2 * leaves * sizeof(long));
+	length = (int *) malloc(2 * leaves * sizeof(int));
+	if (offset == NULL || length == NULL)
+		goto done;
+	for (n = 0; n < leaves; n++) {
+		length[leaves + n] = (n < componentCount) ? counts[n]->size + 1 : 1;
+		if (length[leaves + n] > cap + 1)
+			length[leaves + n] = cap + 1;
+	}
+	for (n = leaves - 1; n >= 1; n--) {
+		length[n] = length[2 * n] + length[2 * n + 1] - 1;
+		if (length[n] > cap + 1)
+			length[n] = cap + 1;
+	}
+	for (offset[1] = 0, n = 1; n < 2 * leaves - 1; n++)
+		offset[n + 1] = offset[n] + length[n];
+	products = (double *) malloc((offset[2 * leaves - 1] + length[2 * leaves - 1]) * sizeof(double));
+	contexts = (double *) malloc((offset[2 * leaves - 1] + length[2 * leaves - 1]) * sizeof(double));
+	if (products == NULL || contexts == NULL)
+		goto done;
+	for (n = 0; n < leaves; n++) {
+		if (n < componentCount)
+			memcpy(&products[offset[leaves + n]], counts[n]->total, length[leaves + n] * sizeof(double));
+		else
+			products[offset[leaves + n]] = 1.0;
+	}
+	for (n = leaves - 1; n >= 1; n--) {
+		convolve(&products[offset[2 * n]], length[2 * n],
+			&products[offset[2 * n + 1]], length[2 * n + 1], &products[offset[n]], cap);
+		normalize(&products[offset[n]], length[n]);
+	}
+
+	/* the squares away from the numbers all have the same chance */
+	if (outside > 0) {
+		double mines = 0.0;
+		z = 0.0;
+		for (k = 0; k < length[1]; k++) {
+			z += products[k] * weights[k];
+			mines += products[k] * weights[k] * (minesLeft - k);
+		}
+		if (z == 0.0)
+			goto done;
+		for (y = 1; y <= board->height; y++) {
+			for (x = 1; x <= board->width; x++) {
+				i = y * stride + x;
+				if ((CELL(*board, x, y) & MASK_CHAR) == '+' && parent[i] == -1)
+					odds[i] = mines / z / outside;
+			}
+		}
+	}
+
+	/* Going back down the tree, the context of a node holds, for every number
+	   of mines t under it, the weight of all the ways the rest of the board can
+	   go along with them. A node's context comes from its parent's context and
+	   its sibling's product, so every component gets its context without
+	   multiplying all of the others together again. */
+	memcpy(contexts, weights, length[1] * sizeof(double));
+	for (n = 1; n < leaves; n++) {
+		for (h = 0; h <= 1; h++) {
+			int child = 2 * n + h, sibling = 2 * n + 1 - h;
+			double *context = &contexts[offset[child]];
+			const double *other = &products[offset[sibling]];
+			const double *above = &contexts[offset[n]];
+			int t, b;
+
+			for (t = 0; t < length[child]; t++) {
+				context[t] = 0.0;
+				for (b = 0; b < length[sibling] && b + t < length[n]; b++)
+					context[t] += other[b] * above[b + t];
+			}
+			normalize(context, length[child]);
+		}
+	}
+
+	for (c = 0; c < componentCount; c++) {
+		const ComponentCounts *cc = counts[c];
+		const double *g = &contexts[offset[leaves + c]];
+
+		z = 0.0;
+		for (k = 0; k < length[leaves + c]; k++)
+			z += cc->total[k] * g[k];
+		if (z == 0.0)
+			goto done;	/* no configuration fits the mines left */
+
+		for (n = 0; n < cc->size; n++) {
+			double p = 0.0;
+			for (k = 0; k < length[leaves + c]; k++)
+				p += cc->perSquare[n * (cc->size + 1) + k] * g[k];
+			odds[squares[start[c] + n]] = p / z;
+		}
+	}
+	status = 0;
+
+done:
+	free(sizes);
+	free(squares);
+	free(start);
+	free(keyStart);
+	free(keyEnd);
+	free(keys);
+	free(counts);
+	if (spares != NULL) {
+		for (c = 0; c < componentCount; c++)
+			freeCounts(&spares[c]);
+	}
+	free(spares);
+	free(weights);
+	free(offset);
+	free(length);
+	free(products);
+	free(contexts);
+	return status;
+}
+
+double mineProbability(const Probability *probability, int x, int y) {
+	if (x < 1 || probability->board->width < x || y < 1 || probability->board->height < y)
+		return 0.0;
+	return probability->odds[(long) y * (probability->board->width + 2) + x];
+}
+
+bool safestSquare(const Probability *probability, int *x, int *y) {
+	const Board *board = probability->board;
+	double best = 2.0;
+	int h, k;
+
+	for (k = 1; k <= board->height; k++) {
+		for (h = 1; h <= board->width; h++) {
+			double p = mineProbability(probability, h, k);
+			if ((CELL(*board, h, k) & MASK_CHAR) == '+' && p < best) {
+				best = p;
+				*x = h;
+				*y = k;
+			}
+		}
+	}
+	return best <= 1.0;
+}
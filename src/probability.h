@@ -0,0 +1,69 @@
+/*
+ * probability.h
+ *
+ * Contains declarations of the Probability struct, which works out the exact
+ * chance of a mine under every covered square of a Board from the numbers,
+ * flags and number of mines left, and of the functions that use it. Like the
+ * solver, it never looks at the mine bits.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "board.h"
+
+#ifndef PROBABILITY_H
+#define PROBABILITY_H
+
+/* number of slots the configurations of components are remembered in between
+   calls */
+#define PROBABILITY_CACHE_SIZE 256
+
+/* the most memory the remembered configurations may take; the ones used the
+   longest ago are dropped to stay under it */
+#define PROBABILITY_CACHE_BYTES ((size_t) 64 << 20)
+
+/* the most memory counting the configurations of one component may take; a
+   component that needs more isn't counted */
+#define PROBABILITY_WORK_BYTES ((size_t) 64 << 20)
+
+/* the configurations of one component, defined in probability.c */
+typedef struct ComponentCounts ComponentCounts;
+
+typedef struct {
+	Board *board;			/* the board being looked at */
+	long cells;				/* size of the board's array, including the border */
+	double *odds;			/* chance of a mine under every cell, same layout as the array */
+	long *parent;			/* union-find forest joining the covered squares next to numbers */
+	int *component;			/* component of every covered square next to a number */
+	int *local;				/* index of the square within its component */
+	ComponentCounts *cache;	/* configurations of recently seen components */
+	size_t cacheBytes;		/* memory taken by the cache's entries */
+	unsigned long calls;	/* number of calls to computeProbabilities */
+} Probability;
+
+/* set up for board, which has to stay allocated as long as the struct is used;
+   returns -1 if the memory can't be allocated */
+int initProbability(Probability *probability, Board *board);
+
+/* free the memory allocated for the struct */
+int freeProbability(Probability *probability);
+
+/* works out the chance of a mine under every covered square, given that
+   minesLeft mines are hidden under the covered squares without a flag. Flags
+   are taken to be right. Returns -1 if the numbers can't all be satisfied, if
+   a component can't be counted within PROBABILITY_WORK_BYTES, or if memory
+   runs out. */
+int computeProbabilities(Probability *probability, long minesLeft);
+
+/* returns the chance of a mine at (x, y), as of the last call to
+   computeProbabilities; 0 for opened squares and 1 for flags */
+double mineProbability(const Probability *probability, int x, int y);
+
+/* stores the coordinates of the covered square without a flag that is least
+   likely to hold a mine in x and y, and returns true, or returns false if
+   there is none */
+bool safestSquare(const Probability *probability, int *x, int *y);
+
+#endif /* PROBABILITY_H */
@@ -0,0 +1,432 @@
+/*
+ * recording.c
+ *
+ * Defines functions for recording games and playing the recordings back
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>	/* memcpy, memcmp, memset */
+
+#include "recording.h"
+
+static void putLittleEndian(unsigned char *p, uint64_t value, int bytes) {
+	int i;
+	for (i = 0; i < bytes; i++)
+		p[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static uint64_t getLittleEndian(const unsigned char *p, int bytes) {
+	uint64_t value = 0;
+	int i;
+	for (i = bytes - 1; i >= 0; i--)
+		value = (value << 8) | p[i];
+	return value;
+}
+
+/* maps small numbers of either sign to small unsigned numbers */
+static uint64_t zigzag(int64_t value) {
+	return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+	return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+/* stores value at p as a varint, returning the number of bytes used, at most
+   10 */
+static int putVarint(unsigned char *p, uint64_t value) {
+	int n = 0;
+	while (value >= 0x80) {
+		p[n++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	p[n++] = value;
+	return n;
+}
+
+/* reads a varint from data at *position, moving *position past it; returns
+   false if it runs past size */
+static bool getVarint(const unsigned char *data, size_t size, size_t *position, uint64_t *value) {
+	int shift;
+
+	*value = 0;
+	for (shift = 0; shift < 64 && *position < size; shift += 7) {
+		unsigned char byte = data[(*position)++];
+		*value |= (uint64_t) (byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+uint32_t boardChecksum(const Board *board) {
+	uint32_t crc = 0;
+	int y;
+	for (y = 1; y <= board->height; y++)
+		crc = crc32(crc, &CELL(*board, 1, y), board->width);
+	return crc;
+}
+
+int initRecording(Recording *recording) {
+	recording->capacity = 256;
+	recording->data = (unsigned char *) malloc(recording->capacity);
+	clearRecording(recording);
+	return (recording->data == NULL) ? -1 : 0;
+}
+
+int clearRecording(Recording *recording) {
+	recording->size = 0;
+	recording->moves = 0;
+	recording->x = recording->y = 0;
+	recording->time = 0;
+	return 0;
+}
+
+int freeRecording(Recording *recording) {
+	free(recording->data);
+	recording->data = NULL;
+	recording->size = recording->capacity = 0;
+	return 0;
+}
+
+int recordMove(Recording *recording, int action, int x, int y, int64_t time) {
+	int64_t microseconds = time / 1000;
+	unsigned char *p;
+
+	/* a move takes at most a byte and three varints */
+	if (recording->size + 31 > recording->capacity) {
+		size_t capacity = 2 * recording->capacity;
+		unsigned char *data = (unsigned char *) realloc(recording->data, capacity);
+		if (data == NULL)
+			return -1;
+		recording->data = data;
+		recording->capacity = capacity;
+	}
+
+	/* the clock never runs backwards in a recording */
+	if (microseconds < recording->time)
+		microseconds = recording->time;
+
+	p = recording->data + recording->size;
+	*p++ = action;
+	p += putVarint(p, zigzag((int64_t) x - recording->x));
+	p += putVarint(p, zigzag((int64_t) y - recording->y));
+	p += putVarint(p, microseconds - recording->time);
+	recording->size = p - recording->data;
+
+	recording->moves++;
+	recording->x = x;
+	recording->y = y;
+	recording->time = microseconds;
+	return 0;
+}
+
+int writeRecording(const char *path, const Recording *recording, const Engine *engine, int64_t time) {
+	const Board *board = &engine->board;
+	unsigned char header[RECORDING_HEADER_SIZE];
+	unsigned char end[48], *p = end;
+	uint32_t crc;
+	FILE *file;
+	bool written;
+
+	memcpy(header, RECORDING_MAGIC, 4);
+	putLittleEndian(header + 4, RECORDING_VERSION, 2);
+	putLittleEndian(header + 6, RECORDING_HEADER_SIZE, 2);
+	putLittleEndian(header + 8, (uint32_t) board->width, 4);
+	putLittleEndian(header + 12, (uint32_t) board->height, 4);
+	putLittleEndian(header + 16, (uint32_t) board->mineCount, 4);
+	putLittleEndian(header + 20, board->seed, 8);
+	putLittleEndian(header + 28, crc32(0, header, RECORDING_HEADER_SIZE - 4), 4);
+
+	*p++ = 0;
+	*p++ = engine->status;
+	p += putVarint(p, recording->moves);
+	p += putVarint(p, engine->flagsPlaced);
+	p += putVarint(p, (time < 0) ? 0 : time / 1000);
+	putLittleEndian(p, boardChecksum(board), 4);
+	p += 4;
+
+	crc = crc32(0, header, RECORDING_HEADER_SIZE);
+	crc = crc32(crc, recording->data, recording->size);
+	crc = crc32(crc, end, p - end);
+	putLittleEndian(p, crc, 4);
+	p += 4;
+
+	file = fopen(path, "wb");
+	if (file == NULL)
+		return -1;
+	written = fwrite(header, RECORDING_HEADER_SIZE, 1, file) == 1
+		&& (recording->size == 0 || fwrite(recording->data, recording->size, 1, file) == 1)
+		&& fwrite(end, p - end, 1, file) == 1;
+	if (fclose(file) != 0)
+		written = false;
+	return written ? 0 : -1;
+}
+
+/* reads the moves and the end of the recording that follow the header;
+   returns -1 if they are malformed */
+static int loadMoves(Replay *replay, const unsigned char *data, size_t size) {
+	size_t position = RECORDING_HEADER_SIZE;
+	long capacity = 0;
+	int64_t x = 0, y = 0, time = 0;
+	uint64_t dx, dy, dt, moves, flags, finalTime;
+
+	/* the end of the game, and the file, start with a zero byte */
+	while (position < size && data[position] != 0) {
+		int action = data[position++];
+		if (action != ACTION_OPEN && action != ACTION_FLAG && action != ACTION_AUTO)
+			return -1;
+		if (!getVarint(data, size, &position, &dx)
+				|| !getVarint(data, size, &position, &dy)
+				|| !getVarint(data, size, &position, &dt))
+			return -1;
+
+		/* squares stay within the range of an int, and times within that of
+		   nanoseconds */
+		if (dx > UINT32_MAX || dy > UINT32_MAX || (uint64_t) (INT64_MAX / 1000 - time) < dt)
+			return -1;
+		x += unzigzag(dx);
+		y += unzigzag(dy);
+		time += dt;
+		if (x < INT32_MIN || INT32_MAX < x || y < INT32_MIN || INT32_MAX < y)
+			return -1;
+
+		if (replay->moveCount == capacity) {
+			RecordedMove *grown;
+			capacity = (capacity == 0) ? 256 : 2 * capacity;
+			grown = (RecordedMove *) realloc(replay->moves, capacity * sizeof(RecordedMove));
+			if (grown == NULL)
+				return -1;
+			replay->moves = grown;
+		}
+		replay->moves[replay->moveCount].action = action;
+		replay->moves[replay->moveCount].x = x;
+		replay->moves[replay->moveCount].y = y;
+		replay->moves[replay->moveCount].time = time * 1000;
+		replay->moveCount++;
+	}
+
+	if (position + 2 > size)
+		return -1;
+	position++;
+	replay->finalStatus = data[position++];
+	if (!getVarint(data, size, &position, &moves)
+			|| !getVarint(data, size, &position, &flags)
+			|| !getVarint(data, size, &position, &finalTime)
+			|| position + 8 != size)
+		return -1;
+	if (moves != (uint64_t) replay->moveCount || flags > INT32_MAX || finalTime > INT64_MAX / 1000)
+		return -1;
+	replay->finalFlags = flags;
+	replay->finalTime = finalTime * 1000;
+	replay->finalBoard = getLittleEndian(data + position, 4);
+	return 0;
+}
+
+int loadReplay(Replay *replay, const unsigned char *data, size_t size, int interval) {
+	replay->moves = NULL;
+	replay->moveCount = 0;
+	replay->keyframes = NULL;
+	replay->interval = 0;
+	replay->current = 0;
+
+	/* the whole file has to be intact before anything in it is believed */
+	if (size < RECORDING_HEADER_SIZE + 4
+			|| memcmp(data, RECORDING_MAGIC, 4) != 0
+			|| getLittleEndian(data + 4, 2) != RECORDING_VERSION
+			|| getLittleEndian(data + 6, 2) != RECORDING_HEADER_SIZE
+			|| getLittleEndian(data + 28, 4) != crc32(0, data, RECORDING_HEADER_SIZE - 4)
+			|| getLittleEndian(data + size - 4, 4) != crc32(0, data, size - 4))
+		return -1;
+
+	replay->width = (int32_t) getLittleEndian(data + 8, 4);
+	replay->height = (int32_t) getLittleEndian(data + 12, 4);
+	replay->mineCount = (int32_t) getLittleEndian(data + 16, 4);
+	replay->seed = getLittleEndian(data + 20, 8);
+	if (replay->width < 1 || replay->height < 1 || replay->mineCount < 0
+			|| replay->mineCount > (long) replay->width * replay->height)
+		return -1;
+
+	if (loadMoves(replay, data, size) == -1) {
+		free(replay->moves);
+		return -1;
+	}
+
+	if (interval > 0) {
+		replay->keyframes = (Keyframe *) calloc(replay->moveCount / interval + 1, sizeof(Keyframe));
+		if (replay->keyframes == NULL) {
+			free(replay->moves);
+			return -1;
+		}
+		replay->interval = interval;
+	}
+
+	/* the mines are placed by the first square opened, just like in the
+	   game; no-guess games are recorded with the seed that was picked, so
+	   that they come out the same without searching again */
+	if (initEngine(&replay->engine, replay->width, replay->height, replay->mineCount, replay->seed) == -1) {
+		free(replay->keyframes);
+		free(replay->moves);
+		return -1;
+	}
+	return 0;
+}
+
+int loadReplayFile(Replay *replay, const char *path, int interval) {
+	unsigned char *data;
+	long size;
+	FILE *file;
+	int status;
+
+	file = fopen(path, "rb");
+	if (file == NULL)
+		return -1;
+	if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0) {
+		fclose(file);
+		return -1;
+	}
+	data = (unsigned char *) malloc(size > 0 ? size : 1);
+	if (data == NULL || (size > 0 && fread(data, size, 1, file) != 1)) {
+		free(data);
+		fclose(file);
+		return -1;
+	}
+	fclose(file);
+
+	status = loadReplay(replay, data, size, interval);
+	free(data);
+	return status;
+}
+
+int freeReplay(Replay *replay) {
+	long k;
+
+	if (replay->keyframes != NULL) {
+		for (k = 0; k <= replay->moveCount / replay->interval; k++) {
+			if (replay->keyframes[k].save.gameData != NULL)
+				freeGameData(&replay->keyframes[k].save);
+		}
+	}
+	free(replay->keyframes);
+	free(replay->moves);
+	replay->keyframes = NULL;
+	replay->moves = NULL;
+	return freeEngine(&replay->engine);
+}
+
+/* stores the game as keyframe k; returns -1 if memory runs out */
+static int storeKeyframe(Replay *replay, long k) {
+	Keyframe *keyframe = &replay->keyframes[k];
+	unsigned char *shrunk;
+
+	keyframe->save.width = replay->width;
+	keyframe->save.height = replay->height;
+	keyframe->save.seed = replay->engine.board.seed;	/* places the mines of a seeded layout */
+	if (setGameData(replay->engine.board, &keyframe->save) == -1)
+		return -1;
+	/* the encoding is usually far smaller than the room made for it */
+	shrunk = (unsigned char *) realloc(keyframe->save.gameData, keyframe->save.size > 0 ? keyframe->save.size : 1);
+	if (shrunk != NULL)
+		keyframe->save.gameData = shrunk;
+
+	keyframe->flagsPlaced = replay->engine.flagsPlaced;
+	keyframe->firstClick = replay->engine.firstClick;
+	keyframe->status = replay->engine.status;
+	return 0;
+}
+
+/* brings the game back to keyframe k, which has been stored */
+static void restoreKeyframe(Replay *replay, long k) {
+	Engine *engine = &replay->engine;
+	const Keyframe *keyframe = &replay->keyframes[k];
+
+	/* mines that haven't been placed yet still come from the seed */
+	resetEngine(engine, replay->seed);
+	if (k > 0) {
+		getGameData(&engine->board, keyframe->save);
+		engine->flagsPlaced = keyframe->flagsPlaced;
+		engine->firstClick = keyframe->firstClick;
+		engine->status = keyframe->status;
+	}
+	markAllDirty(&engine->board);
+	replay->current = k * replay->interval;
+}
+
+/* plays the next move, storing a keyframe after it if one is due; returns -1
+   if memory runs out */
+static int playMove(Replay *replay) {
+	const RecordedMove *move = &replay->moves[replay->current];
+
+	engineAct(&replay->engine, move->action, move->x, move->y);
+	replay->current++;
+
+	if (replay->interval > 0 && replay->current % replay->interval == 0) {
+		long k = replay->current / replay->interval;
+		if (replay->keyframes[k].save.gameData == NULL)
+			return storeKeyframe(replay, k);
+	}
+	return 0;
+}
+
+long seekReplay(Replay *replay, long move) {
+	long k;
+
+	if (move < 0)
+		move = 0;
+	if (move > replay->moveCount)
+		move = replay->moveCount;
+
+	if (replay->interval > 0) {
+		/* start over from the last keyframe before the move that has been
+		   reached, unless the game is already between it and the move */
+		k = move / replay->interval;
+		while (k > 0 && replay->keyframes[k].save.gameData == NULL)
+			k--;
+		if (replay->current > move || replay->current < k * replay->interval)
+			restoreKeyframe(replay, k);
+	} else if (replay->current > move) {
+		resetEngine(&replay->engine, replay->seed);
+		markAllDirty(&replay->engine.board);
+		replay->current = 0;
+	}
+
+	while (replay->current < move) {
+		if (playMove(replay) == -1)
+			return -1;
+	}
+	return replay->current;
+}
+
+int verifyReplay(Replay *replay) {
+	const Engine *engine = &replay->engine;
+	int64_t last;
+	long i;
+
+	if (seekReplay(replay, 0) == -1)
+		return -1;
+
+	for (i = 0; i < replay->moveCount; i++) {
+		const RecordedMove *move = &replay->moves[i];
+		if (move->x < 1 || replay->width < move->x || move->y < 1 || replay->height < move->y
+				|| engine->status != STATUS_PLAYING)
+			return REPLAY_BAD_MOVE;
+		/* the clock only starts once the mines are placed */
+		if (!engine->firstClick && move->time != 0)
+			return REPLAY_BAD_TIME;
+		if (playMove(replay) == -1)
+			return -1;
+	}
+
+	if (engine->status != replay->finalStatus || engine->flagsPlaced != replay->finalFlags
+			|| boardChecksum(&engine->board) != replay->finalBoard)
+		return REPLAY_BAD_RESULT;
+
+	/* the clock stops with the move that ends the game, and can only have run
+	   on past the last move of a game that isn't over */
+	last = (replay->moveCount > 0) ? replay->moves[replay->moveCount - 1].time : 0;
+	if (replay->finalTime < last
+			|| (replay->finalStatus != STATUS_PLAYING && replay->finalTime != last))
+		return REPLAY_BAD_TIME;
+	return REPLAY_VERIFIED;
+}
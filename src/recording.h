@@ -0,0 +1,148 @@
+/*
+ * recording.h
+ *
+ * Contains declarations of the Recording struct, which collects the moves of
+ * a game as it is played, and of the Replay struct, which plays a recording
+ * back. Since a game is decided by its seed and its moves, a recording can be
+ * checked by playing it again, without trusting the result it reports.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "engine.h"
+#include "savegame.h"
+
+#ifndef RECORDING_H
+#define RECORDING_H
+
+/* A recording starts with a header of little-endian fields:
+
+	offset	size	field
+	0		4		magic, "CMSR"
+	4		2		format version, RECORDING_VERSION
+	6		2		header size, RECORDING_HEADER_SIZE
+	8		4		width
+	12		4		height
+	16		4		mine count
+	20		8		seed the mines were placed with
+	28		4		CRC-32 of the header up to here
+
+   followed by the moves. Every move is a byte holding its action, one of
+   ACTION_OPEN, ACTION_FLAG and ACTION_AUTO, and three varints, 7 bits per byte
+   with the high bit set on all but the last byte: the distance in x and in y
+   from the square of the previous move, which starts out as (0, 0), zigzag
+   encoded so that small steps either way take one byte, and the time since
+   the previous move in microseconds, on the game clock, which starts when
+   the first square is opened.
+
+   The moves end with a zero byte, a byte holding the status the game ended
+   with, varints holding the number of moves, the flags placed and the final
+   time of the game in microseconds, as the game clock showed it when the game
+   ended, the CRC-32 of the squares of the final board, and the CRC-32 of the
+   whole file up to there. */
+#define RECORDING_MAGIC			"CMSR"
+#define RECORDING_VERSION		1
+#define RECORDING_HEADER_SIZE	32
+
+/* moves between the keyframes kept by the review screen */
+#define RECORDING_KEYFRAME_INTERVAL 64
+
+/* results of verifyReplay */
+#define REPLAY_VERIFIED		0	/* the recording plays out the way it says */
+#define REPLAY_BAD_MOVE		1	/* a move is off the board or made after the game ended */
+#define REPLAY_BAD_RESULT	2	/* the game doesn't end with the status, flags or board recorded */
+#define REPLAY_BAD_TIME		3	/* the game clock doesn't agree with the times of the moves */
+
+/* the moves of a game being played, encoded as described above */
+typedef struct {
+	unsigned char *data;
+	size_t size, capacity;
+	long moves;			/* number of moves recorded */
+	int x, y;			/* square of the last move */
+	int64_t time;		/* time of the last move, in microseconds */
+} Recording;
+
+/* a move read back from a recording */
+typedef struct {
+	int action;
+	int x, y;
+	int64_t time;		/* duration of the game when the move was made, in nanoseconds */
+} RecordedMove;
+
+/* the state of a replay after a number of moves, for seeking */
+typedef struct {
+	Savegame save;		/* the board, or no gameData if the keyframe hasn't been reached yet */
+	int flagsPlaced;
+	bool firstClick;
+	int status;
+} Keyframe;
+
+typedef struct {
+	int width, height;
+	long mineCount;
+	uint64_t seed;
+	RecordedMove *moves;
+	long moveCount;
+
+	/* the end of the game, as the recording reports it */
+	int finalStatus;
+	int finalFlags;
+	int64_t finalTime;	/* nanoseconds */
+	uint32_t finalBoard;	/* CRC-32 of the squares */
+
+	Engine engine;		/* the game after the first current moves */
+	long current;
+
+	/* a keyframe every interval moves, kept as they are first played
+	   through; keyframe 0 is the start of the game */
+	Keyframe *keyframes;
+	int interval;
+} Replay;
+
+/* set up an empty recording; returns -1 if memory runs out */
+int initRecording(Recording *recording);
+
+/* empty the recording for a new game, reusing the memory that is already
+   allocated */
+int clearRecording(Recording *recording);
+
+/* free the memory allocated for the recording */
+int freeRecording(Recording *recording);
+
+/* add a move made time nanoseconds into the game; returns -1 if memory runs
+   out */
+int recordMove(Recording *recording, int action, int x, int y, int64_t time);
+
+/* write the recording of the game played on engine to path, with the final
+   time of the game clock in nanoseconds; returns -1 if the file can't be
+   written */
+int writeRecording(const char *path, const Recording *recording, const Engine *engine, int64_t time);
+
+/* reads the recording in the size bytes at data, setting up the replay at the
+   start of the game with a keyframe every interval moves, or none if interval
+   is 0. Returns -1 if the recording is invalid or damaged, or if memory runs
+   out. REMEMBER TO CALL freeReplay */
+int loadReplay(Replay *replay, const unsigned char *data, size_t size, int interval);
+
+/* loadReplay for the recording in the file at path */
+int loadReplayFile(Replay *replay, const char *path, int interval);
+
+/* free the memory allocated for the replay */
+int freeReplay(Replay *replay);
+
+/* brings the game to the state after the first move moves, starting from the
+   nearest keyframe when that is quicker than playing on from the current
+   move; returns the move the replay is now at, or -1 if memory runs out */
+long seekReplay(Replay *replay, long move);
+
+/* plays the whole recording from the start and checks that it is consistent
+   and ends the way it reports; returns one of the REPLAY_ results, or -1 if
+   memory runs out. The replay is left at the end of the game. */
+int verifyReplay(Replay *replay);
+
+/* returns the CRC-32 of the squares of the board, row by row */
+uint32_t boardChecksum(const Board *board);
+
+#endif /* RECORDING_H */
@@ -0,0 +1,131 @@
+/*
+ * render.c
+ *
+ * Defines the functions that draw a Board on the terminal using curses
+ */
+
+#include <ctype.h>	/* isdigit */
+
+#include "render.h"
+#include "perf.h"
+
+/* prints the two characters representing the square at (x, y) at the current
+   cursor position, returning the number of characters printed */
+static int printSquare(const Board *board, int x, int y, bool hide, chtype mineAttr) {
+	unsigned char c = CELL(*board, x, y) & MASK_CHAR;
+
+	if (hide) {
+		/* to print hidden board */
+		addch('[' | COLOR_PAIR(0));
+		addch(']' | COLOR_PAIR(0));
+		return 2;
+	}
+
+	if (isdigit(c)) {
+		/* if character is a number, then print space and number */
+		addch(' ' | COLOR_PAIR(5));
+		addch(c | COLOR_PAIR(5));
+		return 3;
+	}
+
+	switch (c) {
+	case '+':
+		addch('[' | COLOR_PAIR(0));
+		addch(']' | COLOR_PAIR(0));
+		break;
+	case 'X':
+		if (mineAttr == 0) {
+			/* if no custom attributes were provided */
+			addch('>' | COLOR_PAIR(3) | A_BOLD);
+			addch('<' | COLOR_PAIR(3) | A_BOLD);
+		} else {
+			addch('|' | mineAttr);
+			addch('>' | mineAttr);
+		}
+		break;
+	case '#':
+		addch('@' | COLOR_PAIR(3) | A_BOLD);
+		addch('@' | COLOR_PAIR(3) | A_BOLD);
+		break;
+	case 'P':
+		addch('|' | COLOR_PAIR(3) | A_BOLD);
+		addch('>' | COLOR_PAIR(3) | A_BOLD);
+		break;
+	case 'F':
+		addch('|' | COLOR_PAIR(4) | A_BOLD);
+		addch('>' | COLOR_PAIR(4) | A_BOLD);
+		break;
+	default:
+		addstr("  ");
+	}
+	return 2;
+}
+
+int printBoardCustom(Board board, bool hide, chtype mineAttr) {
+	const Viewport *view = &board.view;
+	int chars = 0;
+	int x, y;
+
+	/* for every element in the visible part of the array */
+	for (y = view->y; y < view->y + view->height; y++) {
+		mvaddch(y - view->y + 1, 0, '|');
+		for (x = view->x; x < view->x + view->width; x++)
+			chars += printSquare(&board, x, y, hide, mineAttr);
+		if (view->width < 7) {
+			addch(' ');
+			for(x = 0; x < (7 - view->width); x++) printw("  ");
+		}
+		addch('|' | COLOR_PAIR(1));
+	}
+
+	return chars;
+}
+
+int printBoardChanges(Board *board) {
+	const Viewport *view = &board->view;
+	int chars = 0;
+	long i;
+	PERF_START(start);
+
+	if (board->allDirty) {
+		chars = printBoard(*board);
+	} else {
+		const long stride = board->width + 2;
+		for (i = 0; i < board->dirtyCount; i++) {
+			int x = board->dirty[i] % stride;
+			int y = board->dirty[i] / stride;
+			if (!inView(*board, x, y))
+				continue;
+			move(y - view->y + 1, 2 * (x - view->x) + 1);
+			chars += printSquare(board, x, y, false, (chtype) 0);
+		}
+	}
+
+	clearDirty(board);
+	PERF_STOP(PERF_DRAW, start, chars);
+	return chars;
+}
+
+int printBoard(Board board) {
+	return printBoardCustom(board, false, (chtype) 0);
+}
+
+int printFrame(Board board) {
+	int width = board.view.width;
+	int x;
+
+	mvaddstr(0, 0, "+= Minesweeper ");
+	for (x = 8; x < width; x++) addstr("==");
+	if (width > 7) addch('=');
+	addstr("=+");
+
+	mvaddstr(board.view.height + 1, 0, "+==============");
+	for (x = 8; x < width; x++) addstr("==");
+	if (width > 7) addch('=');
+	addstr("=+");
+	return 0;
+}
+
+int printBlank(Board board) {
+	return printBoardCustom(board, true, (chtype) 0);
+}
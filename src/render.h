@@ -0,0 +1,32 @@
+/*
+ * render.h
+ *
+ * Contains declarations of the functions that print a Board using curses.
+ */
+
+#include <curses.h>
+#include <stdbool.h>
+
+#include "board.h"
+
+#ifndef RENDER_H
+#define RENDER_H
+
+/* Prints a graphical representation of the visible part of board, displaying
+   mines as mineChar. If hide is true, all squared will be printed as "[]" */
+int printBoardCustom(Board board, bool hide, chtype mineAttr);
+
+/* printBoard with default arguments for hide and mineChar */
+int printBoard(Board board);
+
+/* prints only the squares that changed since the last call, or the whole board
+   if too much has changed, and then clears the list of changes */
+int printBoardChanges(Board *board);
+
+/* print a blank game board of dimensions defined in board */
+int printBlank(Board board);
+
+/* prints the top and bottom of the board frame for convenience */
+int printFrame(Board board);
+
+#endif /* RENDER_H */
@@ -0,0 +1,168 @@
+/*
+ * replay.c
+ *
+ * Defines the main function of cminesweeper-replay, which checks recorded
+ * games by playing them again without a terminal, spread across all cores, and
+ * reports the ones that don't play out the way they claim.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>	/* clock_gettime */
+#include <unistd.h>	/* getopt, sysconf */
+#include <pthread.h>
+
+#include "engine.h"
+#include "recording.h"
+
+/* recordings claimed by a thread at a time */
+#define REPLAY_CHUNK 16
+
+/* what became of one recording */
+typedef struct {
+	const char *path;
+	int result;			/* one of the REPLAY_ results, or -1 if it can't be read */
+	int status;			/* status the game ended with */
+	long moves;
+	int64_t time;		/* final time of the game, in nanoseconds */
+} Result;
+
+/* the recordings to check, shared by all threads */
+typedef struct {
+	Result *results;
+	long count;
+	long next;			/* index of the next unclaimed recording */
+	long moves;			/* moves played by all threads */
+} Batch;
+
+static uint64_t nanoseconds(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static void *replayThread(void *arg) {
+	Batch *batch = (Batch *) arg;
+	long moves = 0;
+	long i, end;
+
+	for (;;) {
+		i = __atomic_fetch_add(&batch->next, REPLAY_CHUNK, __ATOMIC_RELAXED);
+		if (i >= batch->count)
+			break;
+		end = (i + REPLAY_CHUNK < batch->count) ? i + REPLAY_CHUNK : batch->count;
+
+		for (; i < end; i++) {
+			Result *result = &batch->results[i];
+			Replay replay;
+
+			/* no keyframes are needed to play straight through */
+			if (loadReplayFile(&replay, result->path, 0) == -1) {
+				result->result = -1;
+				continue;
+			}
+			result->result = verifyReplay(&replay);
+			result->status = replay.finalStatus;
+			result->moves = replay.moveCount;
+			result->time = replay.finalTime;
+			moves += replay.current;
+			freeReplay(&replay);
+		}
+	}
+
+	__atomic_fetch_add(&batch->moves, moves, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+static const char *describe(const Result *result) {
+	switch (result->result) {
+	case REPLAY_VERIFIED:
+		return (result->status == STATUS_WON) ? "won" : (result->status == STATUS_LOST) ? "lost" : "unfinished";
+	case REPLAY_BAD_MOVE:
+		return "a move is off the board or after the end of the game";
+	case REPLAY_BAD_RESULT:
+		return "the game doesn't end the way it is recorded";
+	case REPLAY_BAD_TIME:
+		return "the game clock doesn't agree with the times of the moves";
+	default:
+		return "not a valid recording";
+	}
+}
+
+static void usage(const char *name) {
+	fprintf(stderr,
+		"usage: %s [-t threads] [-q] recording...\n"
+		"\n"
+		"  -t threads  worker threads (default: one per core)\n"
+		"  -q          only list the recordings that fail\n",
+		name);
+}
+
+int main(int argc, char *argv[]) {
+	int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	bool quiet = false;
+	Batch batch;
+	pthread_t *ids;
+	uint64_t start, elapsed;
+	long i, failed = 0;
+	int opt, t;
+
+	while ((opt = getopt(argc, argv, "t:qh")) != -1) {
+		switch (opt) {
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 'q':
+			quiet = true;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (threads < 1 || optind == argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	batch.count = argc - optind;
+	batch.next = 0;
+	batch.moves = 0;
+	batch.results = (Result *) calloc(batch.count, sizeof(Result));
+	ids = (pthread_t *) malloc(threads * sizeof(pthread_t));
+	if (batch.results == NULL || ids == NULL) {
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		return 1;
+	}
+	for (i = 0; i < batch.count; i++)
+		batch.results[i].path = argv[optind + i];
+
+	start = nanoseconds();
+	for (t = 0; t < threads; t++)
+		pthread_create(&ids[t], NULL, replayThread, &batch);
+	for (t = 0; t < threads; t++)
+		pthread_join(ids[t], NULL);
+	elapsed = nanoseconds() - start;
+
+	/* results come out in the order the recordings were given */
+	for (i = 0; i < batch.count; i++) {
+		const Result *result = &batch.results[i];
+		if (result->result != REPLAY_VERIFIED)
+			failed++;
+		if (result->result == REPLAY_VERIFIED && !quiet)
+			printf("ok     %s: %s, %ld moves, %.3f s\n", result->path, describe(result),
+				result->moves, result->time / 1e9);
+		else if (result->result != REPLAY_VERIFIED)
+			printf("FAILED %s: %s\n", result->path, describe(result));
+	}
+
+	fprintf(stderr, "%ld recordings, %ld failed, %ld moves in %.1f ms: %.0f recordings/s, %.0f moves/s\n",
+		batch.count, failed, batch.moves, elapsed / 1e6,
+		batch.count / (elapsed / 1e9), batch.moves / (elapsed / 1e9));
+
+	free(batch.results);
+	free(ids);
+	return (failed > 0) ? 1 : 0;
+}
@@ -0,0 +1,174 @@
+/*
+ * review.c
+ *
+ * Defines the review screen, which plays back a recorded game
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <curses.h>
+#include <ctype.h>	/* isdigit */
+
+#include "util.h"
+#include "board.h"
+#include "engine.h"
+#include "render.h"
+#include "recording.h"
+#include "review.h"
+
+/* longest pause between two moves when the recording is played, in
+   milliseconds; a player who stopped to think isn't waited for */
+#define REVIEW_MAX_PAUSE 1000
+
+/* print the review controls with the top left corner at (y, x) */
+static int printReviewCtrlsyx(int y, int x) {
+	mvaddstr(y++, x, "+============== Replay ==============+");
+	mvaddstr(y++, x, "| A D  < > : previous/next move      |");
+	mvaddstr(y++, x, "| Shift+A D: 10 moves back/forward   |");
+	mvaddstr(y++, x, "| W S      : 100 moves back/forward  |");
+	mvaddstr(y++, x, "| G Shift+G: first/last move         |");
+	mvaddstr(y++, x, "| Space    : play/pause              |");
+	mvaddstr(y++, x, "| Q  Esc   : quit                    |");
+	mvaddstr(y++, x, "+====================================+");
+	return 0;
+}
+
+int review(const char *path) {
+	Replay replay;
+	if (loadReplayFile(&replay, path, RECORDING_KEYFRAME_INTERVAL) == -1)
+		return -1;
+	Board *board = &replay.engine.board;
+
+	/* playing the whole game once checks it, and leaves a keyframe behind
+	   every so often for seeking */
+	int verdict = verifyReplay(&replay);
+	seekReplay(&replay, 0);
+
+	fitViewToScreen(board);
+	int hudOffset = hudOffsetFor(board->width);
+
+	noecho();
+	curs_set(0);
+	clear();
+
+	bool redrawAll = true;		/* the screen was cleared */
+	bool isPlaying = false;		/* moves are played at the speed they were made */
+	int shownX = 0, shownY = 0;	/* square of the last move played */
+	bool isDone = false;
+
+	while (!isDone) {
+		const RecordedMove *last = (replay.current > 0) ? &replay.moves[replay.current - 1] : NULL;
+		int x = (last != NULL) ? last->x : 0, y = (last != NULL) ? last->y : 0;
+
+		if (redrawAll) {
+			printFrame(*board);
+			printReviewCtrlsyx(0, hudOffset);
+			markAllDirty(board);
+			redrawAll = false;
+		}
+		mvprintw(8, hudOffset, "[ Move %ld/%ld ][ %.3f ]",
+			replay.current, replay.moveCount, (last != NULL) ? last->time / 1e9 : 0.0);
+		clrtoeol();
+		mvaddstr(9, hudOffset,
+			(replay.engine.status == STATUS_WON) ? "[ Won          ]"
+			: (replay.engine.status == STATUS_LOST) ? "[ Lost         ]"
+			: isPlaying ? "[ Playing      ]"
+			: "[ Paused       ]");
+		mvaddstr(10, hudOffset,
+			(verdict == REPLAY_VERIFIED)
+			? "[ Verified     ]"
+			: "[ Not verified ]");
+
+		/* the last move is highlighted like the cursor in the game */
+		if (x != shownX || y != shownY) {
+			if (shownX > 0)
+				markDirty(board, shownX, shownY);
+			if (x > 0) {
+				markDirty(board, x, y);
+				scrollToSquare(board, x, y);
+			}
+			shownX = x;
+			shownY = y;
+		}
+		printBoardChanges(board);
+		if (x > 0 && inView(*board, x, y)) {
+			unsigned char c = CELL(*board, x, y) & MASK_CHAR;
+			move(y - board->view.y + 1, 2 * (x - board->view.x) + 1);
+			chgat(2, A_REVERSE, isdigit(c) ? 5 : (c == 'P' || c == '#') ? 3 : 1, NULL);
+		}
+		refresh();
+
+		/* while playing, wait as long as the player did before the next
+		   move */
+		if (isPlaying && replay.current < replay.moveCount) {
+			int64_t wait = (replay.moves[replay.current].time - ((last != NULL) ? last->time : 0)) / 1000000;
+			timeout((wait < REVIEW_MAX_PAUSE) ? (int) wait : REVIEW_MAX_PAUSE);
+		} else {
+			isPlaying = false;
+			timeout(-1);
+		}
+		int input = getch();
+		timeout(-1);
+
+		long target = replay.current;
+		switch (input) {
+		case ERR:
+			/* the next move is due */
+			target++;
+			break;
+		case 'q':
+		case 27: /* key code for Esc */
+			isDone = true;
+			break;
+		case 32: /* spacebar */
+			isPlaying = !isPlaying;
+			break;
+		case KEY_RIGHT:
+		case 'd':
+			target++;
+			break;
+		case KEY_LEFT:
+		case 'a':
+			target--;
+			break;
+		case 'D':
+			target += 10;
+			break;
+		case 'A':
+			target -= 10;
+			break;
+		case KEY_DOWN:
+		case KEY_NPAGE:
+		case 's':
+			target += 100;
+			break;
+		case KEY_UP:
+		case KEY_PPAGE:
+		case 'w':
+			target -= 100;
+			break;
+		case KEY_HOME:
+		case 'g':
+			target = 0;
+			break;
+		case KEY_END:
+		case 'G':
+			target = replay.moveCount;
+			break;
+		case KEY_RESIZE:
+			fitViewToScreen(board);
+			if (shownX > 0)
+				scrollToSquare(board, shownX, shownY);
+			hudOffset = hudOffsetFor(board->width);
+			clear();
+			redrawAll = true;
+			break;
+		}
+
+		if (target != replay.current && seekReplay(&replay, target) == -1)
+			beep();
+	}
+
+	freeReplay(&replay);
+	return 0;
+}
@@ -0,0 +1,15 @@
+/*
+ * review.h
+ *
+ * Contains the declaration of the review screen, which plays back a recorded
+ * game move by move.
+ */
+
+#ifndef REVIEW_H
+#define REVIEW_H
+
+/* lets the player step through the recording in the file at path, checking it
+   first; returns -1 if the file isn't a valid recording */
+int review(const char *path);
+
+#endif /* REVIEW_H */
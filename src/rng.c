@@ -0,0 +1,63 @@
+/*
+ * rng.c
+ *
+ * Defines the xoshiro256** generator used for mine placement. Its whole state
+ * lives in the Rng struct, so every board can carry its own generator.
+ */
+
+#include <time.h>	/* clock_gettime */
+
+#include "rng.h"
+
+/* splitmix64, used to expand a single 64-bit seed into the generator state */
+static uint64_t splitmix(uint64_t *x) {
+	uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl(uint64_t x, int k) {
+	return (x << k) | (x >> (64 - k));
+}
+
+void seedRng(Rng *rng, uint64_t seed) {
+	int i;
+	for (i = 0; i < 4; i++)
+		rng->s[i] = splitmix(&seed);
+}
+
+uint64_t nextRandom(Rng *rng) {
+	uint64_t *s = rng->s;
+	uint64_t result = rotl(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+
+	return result;
+}
+
+uint64_t boundedRandom(Rng *rng, uint64_t bound) {
+	/* reject the values at the top of the range that would bias the result
+	   towards the low numbers */
+	uint64_t limit = -bound % bound;
+	uint64_t r;
+
+	do r = nextRandom(rng);
+	while (r < limit);
+	return r % bound;
+}
+
+uint64_t timeSeed(void) {
+	struct timespec now;
+	uint64_t x;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	x = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+	return splitmix(&x);
+}
@@ -0,0 +1,29 @@
+/*
+ * rng.h
+ *
+ * Contains declarations of the Rng struct, a small seedable pseudorandom number
+ * generator (xoshiro256**), and the functions that drive it.
+ */
+
+#include <stdint.h>
+
+#ifndef RNG_H
+#define RNG_H
+
+typedef struct {
+	uint64_t s[4];
+} Rng;
+
+/* reset the generator so that it reproduces the sequence for seed */
+void seedRng(Rng *rng, uint64_t seed);
+
+/* returns the next 64 random bits */
+uint64_t nextRandom(Rng *rng);
+
+/* returns a uniformly distributed number in [0, bound); bound must be nonzero */
+uint64_t boundedRandom(Rng *rng, uint64_t bound);
+
+/* returns a seed derived from the current time, for new games */
+uint64_t timeSeed(void);
+
+#endif /* RNG_H */
@@ -5,67 +5,574 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>	/* offsetof */
 #include <limits.h>	/* NAME_MAX */
-#include <string.h>	/* strcpy, strcat, memset */
+#include <string.h>	/* strcpy, strcat, strrchr, memset, memcmp */
+#include <fcntl.h>	/* open */
+#include <unistd.h>	/* close, ftruncate, fsync */
+#include <sys/mman.h>	/* mmap */
+#include <sys/stat.h>	/* fstat */
 
 #include "savegame.h"
 #include "board.h"
+#include "perf.h"
 
 /* these are defined as macros in case we need to redefine them for
    non-unix-like platforms */
 #define HOME_ENV_NAME	"HOME"
 #define PATH_MAXSIZE 	NAME_MAX
 
+/* The first save files were the raw Savegame struct as laid out on the host,
+   minus the pointer at its end, followed by one byte per square XORed with
+   0x55. The seed was only added to the struct shortly before the format
+   changed, so there are files with and without it. */
+typedef struct {
+	int64_t size;
+	int32_t width, height;
+	int32_t qtyMines;
+	int32_t flagsPlaced;
+	uint32_t gameBools;
+	int32_t cy, cx;
+	struct timespec timeOffset;
+	uint64_t seed;
+} LegacyHeader;
+
+/* builds board data one square at a time */
+typedef struct {
+	unsigned char *data;	/* room for at least one byte per square */
+	int64_t size;			/* bytes written so far */
+	int code;				/* code of the run being built */
+	int64_t length;			/* squares in the run being built */
+} Encoder;
+
+/* CRC-32 of every 4-bit value, for the polynomial used by zlib and PNG */
+static const uint32_t crcTable[16] = {
+	0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+	0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+	0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+	0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+uint32_t crc32(uint32_t crc, const unsigned char *data, size_t length) {
+	size_t i;
+
+	crc = ~crc;
+	for (i = 0; i < length; i++) {
+		crc ^= data[i];
+		crc = (crc >> 4) ^ crcTable[crc & 0x0F];
+		crc = (crc >> 4) ^ crcTable[crc & 0x0F];
+	}
+	return ~crc;
+}
+
+/* stores value in the given number of bytes at p, least significant first */
+static void putLittleEndian(unsigned char *p, uint64_t value, int bytes) {
+	int i;
+	for (i = 0; i < bytes; i++)
+		p[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static uint64_t getLittleEndian(const unsigned char *p, int bytes) {
+	uint64_t value = 0;
+	int i;
+	for (i = bytes - 1; i >= 0; i--)
+		value = (value << 8) | p[i];
+	return value;
+}
+
+/* returns the SAVE_ code of a square, or -1 if it is in no state that can be
+   saved */
+static int squareCode(unsigned char square) {
+	int mine = (square & MASK_MINE) ? SAVE_MINE : 0;
+	unsigned char c = square & MASK_CHAR;
+
+	switch (c) {
+	case '+':
+	case 'X':	/* mines shown at the end of a game */
+		return SAVE_COVERED | mine;
+	case 'P':
+	case 'F':
+		return SAVE_FLAGGED | mine;
+	case ' ':
+	case '#':
+		return SAVE_OPENED | mine;
+	}
+	if ('1' <= c && c <= '8')
+		return SAVE_OPENED | mine;
+	return -1;
+}
+
+static void putVarint(Encoder *encoder, uint64_t value) {
+	while (value >= 0x80) {
+		encoder->data[encoder->size++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	encoder->data[encoder->size++] = value;
+}
+
+/* A run of length squares takes at most length bytes, since (length - 1) << 3
+   | code has fewer than 7 * length bits, so data never needs more than a byte
+   per square. */
+static void endRun(Encoder *encoder) {
+	if (encoder->length > 0)
+		putVarint(encoder, (uint64_t) (encoder->length - 1) << 3 | encoder->code);
+	encoder->length = 0;
+}
+
+static inline void putSquare(Encoder *encoder, int code) {
+	if (encoder->length > 0 && code == encoder->code) {
+		encoder->length++;
+		return;
+	}
+	endRun(encoder);
+	encoder->code = code;
+	encoder->length = 1;
+}
+
+/* reads a varint at *position, moving past it; returns false if it runs past
+   the end of the data or is too long */
+static bool getVarint(const unsigned char *data, int64_t size, int64_t *position, uint64_t *value) {
+	int shift;
+
+	*value = 0;
+	for (shift = 0; shift < 64 && *position < size; shift += 7) {
+		unsigned char byte = data[(*position)++];
+		*value |= (uint64_t) (byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			return true;
+	}
+	return false;
+}
+
+/* reads the layout at the start of board data, moving *position past it;
+   returns false if it isn't valid for a width by height board */
+static bool getLayout(const unsigned char *data, int64_t size, int64_t *position,
+		int width, int height, uint64_t *layout, uint64_t *firstX, uint64_t *firstY) {
+	*firstX = *firstY = 0;
+	if (!getVarint(data, size, position, layout))
+		return false;
+	if (*layout == SAVE_LAYOUT_STORED)
+		return true;
+	if (*layout != SAVE_LAYOUT_SEEDED
+			|| !getVarint(data, size, position, firstX)
+			|| !getVarint(data, size, position, firstY))
+		return false;
+	/* either both are 0, or they are a square of the board */
+	if (*firstX == 0 && *firstY == 0)
+		return true;
+	return 1 <= *firstX && *firstX <= (uint64_t) width && 1 <= *firstY && *firstY <= (uint64_t) height;
+}
+
+/* returns true if data holds a valid layout followed by exactly width *
+   height squares in valid runs */
+static bool validBoardData(const unsigned char *data, int64_t size, int width, int height) {
+	const int64_t squares = (int64_t) width * height;
+	int64_t position = 0, square = 0;
+	uint64_t layout, firstX, firstY, run;
+	int maxCode;
+
+	if (!getLayout(data, size, &position, width, height, &layout, &firstX, &firstY))
+		return false;
+	maxCode = (layout == SAVE_LAYOUT_SEEDED) ? SAVE_OPENED : (SAVE_OPENED | SAVE_MINE);
+	while (square < squares) {
+		if (!getVarint(data, size, &position, &run))
+			return false;
+		if ((int) (run & 0x07) > maxCode || ((run & SAVE_MINE) && layout == SAVE_LAYOUT_SEEDED)
+				|| (run >> 3) >= (uint64_t) (squares - square))
+			return false;
+		square += (run >> 3) + 1;
+	}
+	return position == size;
+}
+
 int getGameData(Board *board, Savegame save) {
-	int outputIndex = 0;
-	int x, y;
+	const int64_t squares = (int64_t) board->width * board->height;
+	int64_t position = 0, square = 0, length, n;
+	uint64_t layout, firstX, firstY, run;
+	unsigned char c;
+	int code;
+	int x = 1, y = 1;
+
+	if (!getLayout(save.gameData, save.size, &position, board->width, board->height,
+			&layout, &firstX, &firstY))
+		return -1;
 
-	/* iterate through elements on both boards */
+	while (square < squares) {
+		if (!getVarint(save.gameData, save.size, &position, &run))
+			return -1;
+		code = run & 0x07;
+		length = (run >> 3) + 1;
+		if (code > (SAVE_OPENED | SAVE_MINE) || length > squares - square
+				|| ((code & SAVE_MINE) && layout == SAVE_LAYOUT_SEEDED))
+			return -1;
+		square += length;
+
+		/* opened squares get their numbers once the counts are known */
+		if (code & SAVE_OPENED)
+			c = (code & SAVE_MINE) ? '#' : ' ';
+		else
+			c = (code & SAVE_FLAGGED) ? 'P' : '+';
+		if (code & SAVE_MINE)
+			c |= MASK_MINE;
+
+		/* runs of covered squares can span many rows */
+		while (length > 0) {
+			n = board->width - x + 1;
+			if (n > length)
+				n = length;
+			memset(&CELL(*board, x, y), c, n);
+			length -= n;
+			x += n;
+			if (x > board->width) {
+				x = 1;
+				y++;
+			}
+		}
+	}
+
+	/* rebuild the cached state that isn't stored in the save file; placing
+	   the mines again leaves the squares as they are */
+	if (layout == SAVE_LAYOUT_SEEDED) {
+		seedBoard(board, save.seed);
+		if (firstX == 0)
+			initializeMines(board);
+		else
+			initializeMinesAround(board, firstX, firstY);
+	} else {
+		computeCounts(board);
+	}
 	for (y = 1; y <= board->height; y++) {
 		for (x = 1; x <= board->width; x++) {
-			/* XOR byte with a constant and write to board */
-			board->array[x][y] = save.gameData[outputIndex++] ^ 0x55;
+			c = CELL(*board, x, y);
+			if ((c & MASK_CHAR) != ' ')
+				continue;
+			if (c & MASK_MINE)
+				CELL(*board, x, y) = '#' | MASK_MINE;
+			else if (COUNT(*board, x, y) > 0)
+				CELL(*board, x, y) = '0' + COUNT(*board, x, y);
 		}
 	}
-	return outputIndex;
+	recountCovered(board);
+	markAllChanged(board);
+	return squares;
 }
 
-int setGameData(Board board, Savegame *save) {
-	int outputIndex = 0;
-	int x, y;
-	save->gameData = malloc(save->size);
-
-	/* iterate through elements on both boards */
-	for (y = 1; y <= board.height; y++) {
-		for (x = 1; x <= board.width; x++) {
-			/* XOR array with a constant and assign to block */
-			save->gameData[outputIndex++] = board.array[x][y] ^ 0x55;
+/* encodes the squares of board into data, which must have room for
+   SAVE_LAYOUT_SIZE bytes and a byte per square, and returns the number of bytes
+   used */
+static int64_t encodeBoard(const Board *board, unsigned char *data) {
+	Encoder encoder;
+	unsigned char previous;
+	int x, y, code;
+	/* the mine bit is dropped from every code when the seed places the mines */
+	int codeMask = board->seeded ? ~SAVE_MINE : ~0;
+
+	encoder.data = data;
+	encoder.size = 0;
+	encoder.length = 0;
+
+	if (board->seeded) {
+		putVarint(&encoder, SAVE_LAYOUT_SEEDED);
+		putVarint(&encoder, board->firstX);
+		putVarint(&encoder, board->firstY);
+	} else {
+		putVarint(&encoder, SAVE_LAYOUT_STORED);
+	}
+
+	/* neighboring squares are mostly identical, so the code is only worked out
+	   again when the square differs from the one before it */
+	previous = 0;
+	code = SAVE_COVERED;
+	for (y = 1; y <= board->height; y++) {
+		const unsigned char *row = &CELL(*board, 1, y);
+		for (x = 0; x < board->width; x++) {
+			if (row[x] != previous) {
+				previous = row[x];
+				code = squareCode(previous);
+				if (code == -1)
+					code = SAVE_COVERED | ((previous & MASK_MINE) ? SAVE_MINE : 0);
+				code &= codeMask;
+			}
+			putSquare(&encoder, code);
 		}
 	}
-	return outputIndex;
+	endRun(&encoder);
+	return encoder.size;
 }
 
-int writeSaveFile(const char *filename, Savegame save) {
-	/* the full name of the save file */
-	char longname[PATH_MAXSIZE + 1];
+int setGameData(Board board, Savegame *save) {
+	const int64_t squares = (int64_t) board.width * board.height;
+
+	save->mapping = NULL;
+	save->gameData = (unsigned char *) malloc(SAVE_LAYOUT_SIZE + squares);
+	if (save->gameData == NULL) {
+		save->size = 0;
+		return -1;
+	}
+	save->size = encodeBoard(&board, save->gameData);
+	return save->size;
+}
+
+int freeGameData(Savegame *save) {
+	if (save->mapping != NULL)
+		munmap(save->mapping, save->mappingSize);
+	else
+		free(save->gameData);
+	save->mapping = NULL;
+	save->gameData = NULL;
+	return 0;
+}
+
+/* fills in the header for save, whose board data is data */
+static void putHeader(unsigned char *header, const Savegame *save, const unsigned char *data) {
+	memcpy(header, SAVE_MAGIC, 4);
+	putLittleEndian(header + 4, SAVE_VERSION, 2);
+	putLittleEndian(header + 6, SAVE_HEADER_SIZE, 2);
+	putLittleEndian(header + 8, save->width, 4);
+	putLittleEndian(header + 12, save->height, 4);
+	putLittleEndian(header + 16, save->qtyMines, 4);
+	putLittleEndian(header + 20, save->flagsPlaced, 4);
+	putLittleEndian(header + 24, save->gameBools, 4);
+	putLittleEndian(header + 28, save->cy, 4);
+	putLittleEndian(header + 32, save->cx, 4);
+	putLittleEndian(header + 36, save->timeOffset.tv_sec, 8);
+	putLittleEndian(header + 44, save->timeOffset.tv_nsec, 4);
+	putLittleEndian(header + 48, save->seed, 8);
+	putLittleEndian(header + 56, save->size, 8);
+	putLittleEndian(header + 64,
+		crc32(crc32(0, header, SAVE_HEADER_SIZE - 4), data, save->size), 4);
+}
+
+/* the full names of the save file filename and of the temporary file it is
+   written to first */
+static void savePaths(char *longname, char *tempname, const char *filename) {
 	memset(longname, 0, PATH_MAXSIZE + 1);
 	strcpy(longname, getenv(HOME_ENV_NAME));
 	strcat(longname, "/.cminesweeper/");
 	strcat(longname, filename);
+	strcpy(tempname, longname);
+	strcat(tempname, ".tmp");
+}
 
-	FILE *savefile = fopen(longname, "wb");
-	if (savefile != NULL) {
-		/* first write the raw struct data. Note that we subtract the value of
-		   sizeof(uint8_t) from the size of the data block, because the last
-		   member in the Savegame struct is actually a pointer. */
-		fwrite(&save, sizeof(save) - sizeof(uint8_t *), 1, savefile);
-		/* then write the data pointed to by gameData */
-		fwrite(save.gameData, save.size, 1, savefile);
-		fclose(savefile);
-	} else {
+int syncDirectory(const char *longname) {
+	char directory[PATH_MAXSIZE + 1];
+	char *slash;
+	int dirfd, status;
+
+	strcpy(directory, longname);
+	slash = strrchr(directory, '/');
+	if (slash != NULL)
+		*slash = '\0';
+	dirfd = open(directory, O_RDONLY | O_DIRECTORY);
+	if (dirfd == -1)
+		return -1;
+	status = fsync(dirfd);
+	close(dirfd);
+	return status;
+}
+
+/* Renames the file written and synced to tempname over longname, which is
+   then either the old save or the new one, however the process or the machine
+   goes down; returns -1 if the file can't be renamed. */
+static int commitFile(const char *tempname, const char *longname) {
+	if (rename(tempname, longname) == -1) {
+		remove(tempname);
+		return -1;
+	}
+
+	/* the rename itself only lasts once the directory is synced */
+	syncDirectory(longname);
+	return 0;
+}
+
+int writeSaveFile(const char *filename, Savegame save) {
+	/* the full name of the save file, and the file it is written to first */
+	char longname[PATH_MAXSIZE + 1], tempname[PATH_MAXSIZE + 5];
+	savePaths(longname, tempname, filename);
+	PERF_START(start);
+
+	unsigned char header[SAVE_HEADER_SIZE];
+	putHeader(header, &save, save.gameData);
+
+	FILE *savefile = fopen(tempname, "wb");
+	if (savefile == NULL) {
 		/* error opening file */
 		return -1;
 	}
+	bool written = fwrite(header, SAVE_HEADER_SIZE, 1, savefile) == 1
+		&& (save.size == 0 || fwrite(save.gameData, save.size, 1, savefile) == 1)
+		&& fflush(savefile) == 0
+		&& fsync(fileno(savefile)) == 0;
+	if (fclose(savefile) != 0)
+		written = false;
+	if (!written) {
+		remove(tempname);
+		return -1;
+	}
+	int status = commitFile(tempname, longname);
+	PERF_STOP(PERF_SAVE, start, SAVE_HEADER_SIZE + save.size);
+	return status;
+}
+
+int writeSaveBoard(const char *filename, Savegame save, const Board *board) {
+	/* the full name of the save file, and the file it is written to first */
+	char longname[PATH_MAXSIZE + 1], tempname[PATH_MAXSIZE + 5];
+	savePaths(longname, tempname, filename);
+	PERF_START(start);
+
+	/* make the file as large as the board data could possibly get, encode
+	   straight into it, and cut it down to the size that was actually used */
+	const size_t capacity = SAVE_HEADER_SIZE + SAVE_LAYOUT_SIZE + (size_t) board->width * board->height;
+	unsigned char *map;
+	int fd = open(tempname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		return -1;
+	if (ftruncate(fd, capacity) == -1) {
+		close(fd);
+		remove(tempname);
+		return -1;
+	}
+	map = (unsigned char *) mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		close(fd);
+		remove(tempname);
+		return -1;
+	}
+
+	save.size = encodeBoard(board, map + SAVE_HEADER_SIZE);
+	putHeader(map, &save, map + SAVE_HEADER_SIZE);
+	munmap(map, capacity);
+
+	int status = ftruncate(fd, SAVE_HEADER_SIZE + save.size);
+	if (status == 0)
+		status = fsync(fd);
+	if (close(fd) == -1)
+		status = -1;
+	if (status == -1) {
+		remove(tempname);
+		return -1;
+	}
+	status = commitFile(tempname, longname);
+	PERF_STOP(PERF_SAVE, start, SAVE_HEADER_SIZE + save.size);
+	return status;
+}
+
+/* reads a save file in the current format from the mapped file contents; the
+   board data is used where it is, so the mapping is handed to saveptr. The
+   data of version 2 files is copied instead, after a layout is put in front of
+   it, and saveptr->mapping is left NULL. */
+static int loadCurrentSave(unsigned char *contents, size_t fileSize, Savegame *saveptr) {
+	const unsigned char *header = contents;
+	int version;
+
+	if (fileSize < SAVE_HEADER_SIZE
+			|| ((version = getLittleEndian(header + 4, 2)) != SAVE_VERSION && version != 2)
+			|| getLittleEndian(header + 6, 2) != SAVE_HEADER_SIZE)
+		return -1;
+
+	saveptr->width = getLittleEndian(header + 8, 4);
+	saveptr->height = getLittleEndian(header + 12, 4);
+	saveptr->qtyMines = getLittleEndian(header + 16, 4);
+	saveptr->flagsPlaced = getLittleEndian(header + 20, 4);
+	saveptr->gameBools = getLittleEndian(header + 24, 4);
+	saveptr->cy = getLittleEndian(header + 28, 4);
+	saveptr->cx = getLittleEndian(header + 32, 4);
+	saveptr->timeOffset.tv_sec = getLittleEndian(header + 36, 8);
+	saveptr->timeOffset.tv_nsec = getLittleEndian(header + 44, 4);
+	saveptr->seed = getLittleEndian(header + 48, 8);
+	saveptr->size = getLittleEndian(header + 56, 8);
+
+	/* everything after the header is board data */
+	if (saveptr->width < 1 || saveptr->height < 1
+			|| saveptr->size != (int64_t) (fileSize - SAVE_HEADER_SIZE))
+		return -1;
+	if (crc32(crc32(0, header, SAVE_HEADER_SIZE - 4), contents + SAVE_HEADER_SIZE, saveptr->size)
+			!= getLittleEndian(header + 64, 4))
+		return -1;
+
+	if (version == 2) {
+		unsigned char *data = (unsigned char *) malloc(saveptr->size + 1);
+		if (data == NULL)
+			return -1;
+		data[0] = SAVE_LAYOUT_STORED;
+		memcpy(data + 1, contents + SAVE_HEADER_SIZE, saveptr->size);
+		saveptr->size++;
+		if (!validBoardData(data, saveptr->size, saveptr->width, saveptr->height)) {
+			free(data);
+			return -1;
+		}
+		saveptr->gameData = data;
+		saveptr->mapping = NULL;
+		return 0;
+	}
+
+	if (!validBoardData(contents + SAVE_HEADER_SIZE, saveptr->size, saveptr->width, saveptr->height))
+		return -1;
+	saveptr->gameData = contents + SAVE_HEADER_SIZE;
+	saveptr->mapping = contents;
+	saveptr->mappingSize = fileSize;
+	return 0;
+}
+
+/* reads a save file in the first format from the mapped file contents,
+   converting its board data */
+static int loadLegacySave(const unsigned char *contents, size_t fileSize, Savegame *saveptr) {
+	LegacyHeader legacy;
+	size_t headerSize;
+	const unsigned char *squares;
+	Encoder encoder;
+	int64_t i;
+	int code;
+
+	if (fileSize < offsetof(LegacyHeader, seed))
+		return -1;
+	memset(&legacy, 0, sizeof(legacy));
+	memcpy(&legacy, contents, offsetof(LegacyHeader, seed));
+
+	/* the header is the only part of the file that isn't one byte per square,
+	   which tells the two versions apart */
+	if (legacy.width < 1 || legacy.height < 1
+			|| legacy.size != (int64_t) legacy.width * legacy.height)
+		return -1;
+	if (fileSize - offsetof(LegacyHeader, seed) == (size_t) legacy.size)
+		headerSize = offsetof(LegacyHeader, seed);
+	else if (fileSize - sizeof(LegacyHeader) == (size_t) legacy.size)
+		headerSize = sizeof(LegacyHeader);
+	else
+		return -1;
+	if (headerSize == sizeof(LegacyHeader))
+		memcpy(&legacy.seed, contents + offsetof(LegacyHeader, seed), sizeof(legacy.seed));
+
+	squares = contents + headerSize;
+	encoder.data = (unsigned char *) malloc(SAVE_LAYOUT_SIZE + legacy.size);
+	encoder.size = 0;
+	encoder.length = 0;
+	if (encoder.data == NULL)
+		return -1;
+	putVarint(&encoder, SAVE_LAYOUT_STORED);
+	for (i = 0; i < legacy.size; i++) {
+		code = squareCode(squares[i] ^ 0x55);
+		if (code == -1) {
+			free(encoder.data);
+			return -1;
+		}
+		putSquare(&encoder, code);
+	}
+	endRun(&encoder);
+
+	saveptr->width = legacy.width;
+	saveptr->height = legacy.height;
+	saveptr->qtyMines = legacy.qtyMines;
+	saveptr->flagsPlaced = legacy.flagsPlaced;
+	saveptr->gameBools = legacy.gameBools;
+	saveptr->cy = legacy.cy;
+	saveptr->cx = legacy.cx;
+	saveptr->timeOffset = legacy.timeOffset;
+	saveptr->seed = legacy.seed;
+	saveptr->size = encoder.size;
+	saveptr->gameData = encoder.data;
+	saveptr->mapping = NULL;
 	return 0;
 }
 
@@ -76,44 +583,43 @@ int loadSaveFile(const char *filename, Savegame *saveptr) {
 	strcpy(longname, getenv(HOME_ENV_NAME));
 	strcat(longname, "/.cminesweeper/");
 	strcat(longname, filename);
+	PERF_START(start);
 
-	FILE *savefile = fopen(longname, "rb");
-	if (savefile != NULL) {
-		/* first read the raw struct data. Note that we subtract the value of
-		   sizeof(uint8_t) from the size of the data block, because the last
-		   member in the Savegame struct is actually a pointer. */
-		fread(saveptr, sizeof(Savegame) - sizeof(uint8_t *), 1, savefile);
-
-		/* return an error value if the dimensions of the struct don't make sense */
-		if (saveptr->size != saveptr->width * saveptr->height) {
-			fclose(savefile);
-			return -1;
-		}
+	int fd = open(longname, O_RDONLY);
+	if (fd == -1) {
+		/* error opening file */
+		return -1;
+	}
 
-		fseek(savefile, 0, SEEK_END);	/* seek to end of file */
-		/* Calculate offset from the end of the file to the file header;
-		   everything between the end of the header and the end of the file is
-		   considered part of the data block. If the size of this block does not
-		   match saveptr->size, then return an error value. */
-		if (ftell(savefile) - (sizeof(Savegame) - sizeof(uint8_t *)) != saveptr->size) {
-			fclose(savefile);
-			return -1;
-		}
+	/* the file is mapped rather than read, so that the board data can be
+	   decoded from the page cache without being copied first */
+	struct stat info;
+	unsigned char *contents;
+	if (fstat(fd, &info) == -1 || info.st_size == 0) {
+		close(fd);
+		return -1;
+	}
+	contents = (unsigned char *) mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (contents == MAP_FAILED)
+		return -1;
+	madvise(contents, info.st_size, MADV_SEQUENTIAL);
 
-		/* The save file has passed the integrity check, so set the position
-		   indicator back to the beginning of the data block */
-		fseek(savefile, sizeof(Savegame) - sizeof(uint8_t *), SEEK_SET);
-		/* allocate the necessary memory */
-		saveptr->gameData = (unsigned char *) malloc(saveptr->size);
-		/* then read the data pointed to by gameData */
-		fread(saveptr->gameData, saveptr->size, 1, savefile);
-		fclose(savefile);
+	/* files without the magic number are from before the current format */
+	int status;
+	if (info.st_size >= 4 && memcmp(contents, SAVE_MAGIC, 4) == 0) {
+		status = loadCurrentSave(contents, info.st_size, saveptr);
+		PERF_STOP(PERF_LOAD, start, info.st_size);
+		if (status == 0 && saveptr->mapping != NULL)
+			return 0;
 	} else {
-		/* error opening file */
-		return -1;
+		status = loadLegacySave(contents, info.st_size, saveptr);
+		PERF_STOP(PERF_LOAD, start, info.st_size);
 	}
 
-	return 0;
+	/* the mapping is only kept when the board data is used from it */
+	munmap(contents, info.st_size);
+	return status;
 }
 
 int removeSaveFile(const char *filename) {
@@ -124,4 +630,4 @@ int removeSaveFile(const char *filename) {
 	strcat(longname, filename);
 
 	return remove(longname);
-}
\ No newline at end of file
+}
@@ -12,6 +12,55 @@
 /* masks for extracting bools from gameBools */
 #define MASK_FLAG_MODE		0x01
 #define MASK_FIRST_CLICK	0x02
+#define MASK_NO_GUESS		0x04
+
+/* Save files start with a fixed header of little-endian fields:
+
+	offset	size	field
+	0		4		magic, "CMSW"
+	4		2		format version, SAVE_VERSION
+	6		2		header size, SAVE_HEADER_SIZE
+	8		4		width
+	12		4		height
+	16		4		qtyMines
+	20		4		flagsPlaced
+	24		4		gameBools
+	28		4		cy
+	32		4		cx
+	36		8		seconds of timeOffset
+	44		4		nanoseconds of timeOffset
+	48		8		seed
+	56		8		size of the board data
+	64		4		CRC-32 of the header up to here followed by the board data
+
+   The board data that follows is made of varints, 7 bits per byte with the high
+   bit set on all but the last byte. The first one tells where the mines are:
+   SAVE_LAYOUT_STORED if they are stored with the squares, or SAVE_LAYOUT_SEEDED
+   followed by firstX and firstY if they are placed again from the seed, with
+   seedBoard and initializeMinesAround(firstX, firstY), or initializeMines if
+   both are 0. The rest lists the squares row by row as runs of squares in the
+   same state, each holding (length - 1) << 3 | code, where code is one of the
+   SAVE_ codes below. The numbers on opened squares aren't stored, since they
+   follow from the mines. With a seeded layout SAVE_MINE is never set, so the
+   runs only break where squares were opened or flagged, and a mostly covered
+   board takes a few bytes whatever its size.
+
+   Version 2 had no layout and always stored the mines; such files are read as
+   if their data started with SAVE_LAYOUT_STORED. */
+#define SAVE_MAGIC			"CMSW"
+#define SAVE_VERSION		3
+#define SAVE_HEADER_SIZE	68
+
+/* how the mines of a save are stored, and the most bytes that takes */
+#define SAVE_LAYOUT_STORED	0
+#define SAVE_LAYOUT_SEEDED	1
+#define SAVE_LAYOUT_SIZE	11
+
+/* codes of the states a square can be saved in */
+#define SAVE_MINE		0x01	/* added to the others when the square holds a mine */
+#define SAVE_COVERED	0x00
+#define SAVE_FLAGGED	0x02
+#define SAVE_OPENED		0x04
 
 /* struct storing the state of the game */
 typedef struct {
@@ -22,27 +71,60 @@ typedef struct {
 	uint32_t gameBools;		/* integer storing the state of in-game bools */
 	int32_t cy, cx;			/* cursor coordinates */
 	struct timespec timeOffset;	/* game duration */
-	unsigned char *gameData;	/* string of bytes storing board data */
+	uint64_t seed;			/* seed of the board's generator, see seedBoard */
+	unsigned char *gameData;	/* board data, encoded as described above */
+	void *mapping;			/* the mapped save file gameData points into, or NULL if
+							   gameData was allocated */
+	size_t mappingSize;
+	int32_t slot;			/* save slot the game is kept in, see slots.h, or -1 if it
+							   hasn't been saved yet; not stored in the save file */
 } Savegame;
 
 /* prototypes for utility functions */
 
-/* decodes game data from the savegame into the mine and board structs */
+/* decodes game data from the savegame into the board struct, which must have
+   the dimensions and mines of the savegame; a seeded layout is placed again
+   from save.seed, which board is reseeded with. Returns the number of squares
+   decoded, or -1 if the data is invalid */
 int getGameData(Board *board, Savegame save);
 
-/* encodes game data from the mine and board structs into the savegame;
-   REMEMBER TO FREE saveptr->gameData AFTER CALLING */
+/* encodes game data from the board struct into the savegame, setting
+   saveptr->size; the mines are only stored if board->seeded isn't set. Returns
+   the size, or -1 if memory runs out.
+   REMEMBER TO CALL freeGameData AFTER CALLING */
 int setGameData(Board board, Savegame *saveptr);
 
-/* write savegame save to disk */
+/* releases saveptr->gameData, whether it was allocated or mapped */
+int freeGameData(Savegame *saveptr);
+
+/* write savegame save to disk; returns -1 if the file can't be written. The
+   file is written and synced under another name first and renamed over the old
+   one, so a crash never leaves a partly written save behind. */
 int writeSaveFile(const char *filename, Savegame save);
 
+/* write savegame save to disk like writeSaveFile, with the board data encoded
+   straight from board into the mapped file, so that no copy of it is made in
+   memory; save.size and save.gameData are ignored. Returns -1 if the file
+   can't be written. */
+int writeSaveBoard(const char *filename, Savegame save, const Board *board);
+
 /* read savegame from disk into *saveptr, returning -1 if there is an error or if
-   the save file is invalid or has been tampered with;
-   REMEMBER TO FREE saveptr->gameData after moving it to a Board object */
+   the save file is invalid or has been tampered with. The file is mapped into
+   memory and gameData points straight into it. Save files written before the
+   current format was introduced are converted as they are read.
+   REMEMBER TO CALL freeGameData after moving it to a Board object */
 int loadSaveFile(const char *filename, Savegame *saveptr);
 
 /* removes a savefile from disk */
 int removeSaveFile(const char *filename);
 
-#endif /* SAVEGAME_H */
\ No newline at end of file
+/* syncs the directory holding the file longname, so that a file created or
+   renamed there lasts however the machine goes down; returns -1 if it can't
+   be synced */
+int syncDirectory(const char *longname);
+
+/* continues the CRC-32 crc, which is 0 to start with, over length bytes of
+   data */
+uint32_t crc32(uint32_t crc, const unsigned char *data, size_t length);
+
+#endif /* SAVEGAME_H */
@@ -0,0 +1,125 @@
+/*
+ * saver.c
+ *
+ * Defines the background writer of save slots
+ */
+
+#include <stdlib.h>
+#include <string.h>	/* memcpy */
+
+#include "saver.h"
+#include "slots.h"
+
+static void *saverThread(void *arg) {
+	Saver *saver = (Saver *) arg;
+	int status;
+
+	pthread_mutex_lock(&saver->lock);
+	for (;;) {
+		while (!saver->pending && !saver->stopping)
+			pthread_cond_wait(&saver->changed, &saver->lock);
+		if (!saver->pending)
+			break;
+
+		/* swap the buffers, so that a new snapshot can be queued while this
+		   one is written */
+		Savegame save = saver->pendingSave;
+		Board board = saver->pendingBoard;
+		size_t capacity = saver->pendingCapacity;
+		saver->pendingSave = saver->writingSave;
+		saver->pendingBoard = saver->writingBoard;
+		saver->pendingCapacity = saver->writingCapacity;
+		saver->writingSave = save;
+		saver->writingBoard = board;
+		saver->writingCapacity = capacity;
+		saver->pending = false;
+		saver->writing = true;
+		pthread_mutex_unlock(&saver->lock);
+
+		status = writeSlot(save.slot, save, &board);
+
+		pthread_mutex_lock(&saver->lock);
+		saver->writing = false;
+		saver->finished++;
+		saver->status = status;
+		pthread_cond_broadcast(&saver->changed);
+	}
+	pthread_mutex_unlock(&saver->lock);
+	return NULL;
+}
+
+int initSaver(Saver *saver) {
+	memset(saver, 0, sizeof(Saver));
+	pthread_mutex_init(&saver->lock, NULL);
+	pthread_cond_init(&saver->changed, NULL);
+	if (pthread_create(&saver->thread, NULL, saverThread, saver) != 0) {
+		pthread_cond_destroy(&saver->changed);
+		pthread_mutex_destroy(&saver->lock);
+		return -1;
+	}
+	return 0;
+}
+
+int queueSave(Saver *saver, Savegame save, const Board *board) {
+	const size_t size = (size_t) (board->width + 2) * (board->height + 2);
+
+	pthread_mutex_lock(&saver->lock);
+	if (saver->pendingCapacity < size) {
+		unsigned char *array = (unsigned char *) realloc(saver->pendingBoard.array, size);
+		if (array == NULL) {
+			pthread_mutex_unlock(&saver->lock);
+			return -1;
+		}
+		saver->pendingBoard.array = array;
+		saver->pendingCapacity = size;
+	}
+	saver->pendingBoard.width = board->width;
+	saver->pendingBoard.height = board->height;
+	saver->pendingBoard.seeded = board->seeded;
+	saver->pendingBoard.firstX = board->firstX;
+	saver->pendingBoard.firstY = board->firstY;
+	memcpy(saver->pendingBoard.array, board->array, size);
+
+	save.gameData = NULL;
+	save.mapping = NULL;
+	saver->pendingSave = save;
+	saver->pending = true;
+	pthread_cond_broadcast(&saver->changed);
+	pthread_mutex_unlock(&saver->lock);
+	return 0;
+}
+
+int waitSaver(Saver *saver) {
+	int status;
+
+	pthread_mutex_lock(&saver->lock);
+	while (saver->pending || saver->writing)
+		pthread_cond_wait(&saver->changed, &saver->lock);
+	status = saver->status;
+	pthread_mutex_unlock(&saver->lock);
+	return status;
+}
+
+long saverFinished(Saver *saver, int *status) {
+	long finished;
+
+	pthread_mutex_lock(&saver->lock);
+	finished = saver->finished;
+	*status = saver->status;
+	pthread_mutex_unlock(&saver->lock);
+	return finished;
+}
+
+int freeSaver(Saver *saver) {
+	pthread_mutex_lock(&saver->lock);
+	saver->stopping = true;
+	pthread_cond_broadcast(&saver->changed);
+	pthread_mutex_unlock(&saver->lock);
+	pthread_join(saver->thread, NULL);
+
+	free(saver->pendingBoard.array);
+	free(saver->writingBoard.array);
+	pthread_cond_destroy(&saver->changed);
+	pthread_mutex_destroy(&saver->lock);
+	return 0;
+}
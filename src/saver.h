@@ -0,0 +1,56 @@
+/*
+ * saver.h
+ *
+ * Contains declarations of the Saver struct, a thread that writes save slots
+ * in the background, and of the functions that hand it snapshots of the game.
+ * Taking a snapshot only copies the squares of the board, so saving never holds
+ * up the game, however large the board is.
+ */
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "board.h"
+#include "savegame.h"
+
+#ifndef SAVER_H
+#define SAVER_H
+
+typedef struct {
+	pthread_t thread;
+	pthread_mutex_t lock;		/* guards everything below */
+	pthread_cond_t changed;		/* signaled when a snapshot is queued or written */
+
+	/* the snapshot waiting to be written, and the one being written; only
+	   the latest snapshot queued is kept, since it supersedes the others */
+	Savegame pendingSave, writingSave;
+	Board pendingBoard, writingBoard;	/* only the size, layout and squares are used */
+	size_t pendingCapacity, writingCapacity;	/* bytes allocated for each array */
+	bool pending, writing;
+	bool stopping;				/* the thread exits once nothing is pending */
+
+	long finished;				/* snapshots written or failed so far */
+	int status;					/* result of the last one, 0 or -1 */
+} Saver;
+
+/* start the writer thread; returns -1 if it can't be started */
+int initSaver(Saver *saver);
+
+/* copies the squares of board and queues them to be written to slot save.slot
+   with writeSlot, replacing any snapshot that hasn't been started on yet;
+   returns -1 if memory runs out */
+int queueSave(Saver *saver, Savegame save, const Board *board);
+
+/* blocks until every snapshot queued so far has been written, and returns the
+   result of the last one */
+int waitSaver(Saver *saver);
+
+/* returns the number of snapshots written or failed so far, storing the result
+   of the last one in *status */
+long saverFinished(Saver *saver, int *status);
+
+/* waits for the snapshots queued so far, then stops the thread and frees the
+   memory allocated for them */
+int freeSaver(Saver *saver);
+
+#endif /* SAVER_H */
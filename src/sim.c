@@ -0,0 +1,361 @@
+/*
+ * sim.c
+ *
+ * Defines the main function of cminesweeper-sim, which plays large numbers of
+ * games without a terminal using the solver as the player, spread across all cores,
+ * and reports throughput, win rates, the mean 3BV of the boards and per-game
+ * latency.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <strings.h>	/* strcasecmp */
+#include <time.h>	/* clock_gettime */
+#include <unistd.h>	/* getopt, sysconf */
+#include <pthread.h>
+
+#include "engine.h"
+#include "bitboard.h"
+#include "rng.h"
+#include "solver.h"
+#include "probability.h"
+#include "recording.h"
+
+/* games claimed by a thread at a time */
+#define SIM_CHUNK 64
+
+typedef struct {
+	const char *name;
+	int width, height;
+	long mineCount;
+} Difficulty;
+
+/* the presets offered by the main menu */
+static const Difficulty presets[] = {
+	{ "Beginner",     9,  9, 10 },
+	{ "Intermediate", 16, 16, 40 },
+	{ "Advanced",     30, 24, 99 },
+};
+
+/* a batch of games of one difficulty, shared by all threads */
+typedef struct {
+	Difficulty difficulty;
+	long games;				/* number of games to play */
+	uint64_t seed;			/* game i is generated from seed + i */
+	long next;				/* index of the next unclaimed game */
+	long wins;
+	long clicks;			/* sum of the 3BV of every board */
+	uint64_t *latencies;	/* nanoseconds taken by every game */
+	const char *recordings;	/* directory to write a recording of every game to, or NULL */
+} Batch;
+
+static uint64_t nanoseconds(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* opens the square at (x, y), adding the move to recording unless it is NULL;
+   like in the game, the clock only runs once the mines are placed */
+static void play(Engine *engine, Recording *recording, int x, int y, uint64_t start) {
+	bool minesPlaced = engine->firstClick;
+
+	engineOpen(engine, x, y);
+	if (recording != NULL)
+		recordMove(recording, ACTION_OPEN, x, y, minesPlaced ? nanoseconds() - start : 0);
+}
+
+/* opens a random covered square that isn't known to be a mine, which is what
+   the player falls back on when the odds can't be worked out */
+static void guess(Engine *engine, const Solver *solver, Rng *rng, Recording *recording, uint64_t start) {
+	Board *board = &engine->board;
+	long candidates = 0, pick;
+	int x, y;
+
+	for (y = 1; y <= board->height; y++) {
+		for (x = 1; x <= board->width; x++) {
+			if ((CELL(*board, x, y) & MASK_CHAR) == '+' && solverKnown(solver, x, y) != SOLVER_MINE)
+				candidates++;
+		}
+	}
+	if (candidates == 0)
+		return;
+
+	pick = boundedRandom(rng, candidates);
+	for (y = 1; y <= board->height; y++) {
+		for (x = 1; x <= board->width; x++) {
+			if ((CELL(*board, x, y) & MASK_CHAR) == '+' && solverKnown(solver, x, y) != SOLVER_MINE
+					&& pick-- == 0) {
+				play(engine, recording, x, y, start);
+				return;
+			}
+		}
+	}
+}
+
+/* plays one game until it is won or lost. The player opens the middle square,
+   then opens whatever the solver finds to be safe, and when it finds nothing,
+   the square least likely to be a mine. Mines are never flagged, since the
+   solver keeps track of them. The moves are recorded unless recording is
+   NULL. */
+static void playGame(Engine *engine, Solver *solver, Probability *probability, Rng *rng,
+		Recording *recording) {
+	Board *board = &engine->board;
+	uint64_t start;
+	int x, y;
+
+	play(engine, recording, (board->width + 1) / 2, (board->height + 1) / 2, 0);
+	start = nanoseconds();
+
+	while (engine->status == STATUS_PLAYING) {
+		/* nothing is drawn, so the list of changes is only there for the
+		   solver */
+		solverSyncDirty(solver);
+		clearDirty(board);
+		solverRun(solver);
+
+		if (solverNextSafe(solver, &x, &y))
+			play(engine, recording, x, y, start);
+		else if (computeProbabilities(probability, board->mineCount - engine->flagsPlaced) == 0
+				&& safestSquare(probability, &x, &y))
+			play(engine, recording, x, y, start);
+		else
+			guess(engine, solver, rng, recording, start);
+	}
+}
+
+static void *simThread(void *arg) {
+	Batch *batch = (Batch *) arg;
+	const Difficulty *d = &batch->difficulty;
+	Engine engine;
+	Solver solver;
+	Probability probability;
+	Rng rng;
+	Recording recording;
+	Bitboard bits;
+	char path[4096];
+	long wins = 0, clicks = 0;
+	long i, end;
+
+	/* every thread reuses a single board for all of its games */
+	if (initEngine(&engine, d->width, d->height, d->mineCount, 0) == -1)
+		return NULL;
+	if (initBitboard(&bits, d->width, d->height) == -1) {
+		freeEngine(&engine);
+		return NULL;
+	}
+	if (initSolver(&solver, &engine.board) == -1) {
+		freeBitboard(&bits);
+		freeEngine(&engine);
+		return NULL;
+	}
+	if (initProbability(&probability, &engine.board) == -1) {
+		freeSolver(&solver);
+		freeBitboard(&bits);
+		freeEngine(&engine);
+		return NULL;
+	}
+	if (initRecording(&recording) == -1) {
+		freeProbability(&probability);
+		freeSolver(&solver);
+		freeBitboard(&bits);
+		freeEngine(&engine);
+		return NULL;
+	}
+
+	for (;;) {
+		i = __atomic_fetch_add(&batch->next, SIM_CHUNK, __ATOMIC_RELAXED);
+		if (i >= batch->games)
+			break;
+		end = (i + SIM_CHUNK < batch->games) ? i + SIM_CHUNK : batch->games;
+
+		for (; i < end; i++) {
+			uint64_t start = nanoseconds();
+
+			/* seed everything from the game index, so that results don't
+			   depend on the number of threads */
+			resetEngine(&engine, batch->seed + i);
+			seedRng(&rng, ~(batch->seed + i));
+			if (batch->recordings == NULL) {
+				playGame(&engine, &solver, &probability, &rng, NULL);
+			} else {
+				/* the recording is written after the game is timed */
+				clearRecording(&recording);
+				playGame(&engine, &solver, &probability, &rng, &recording);
+			}
+
+			if (engine.status == STATUS_WON)
+				wins++;
+			batch->latencies[i] = nanoseconds() - start;
+
+			/* the layout is analyzed after the game is timed, on the
+			   compact copy, since only the mines matter */
+			boardToBitboard(&engine.board, &bits);
+			clicks += bitboardClicks(&bits);
+
+			if (batch->recordings != NULL) {
+				snprintf(path, sizeof(path), "%s/%dx%d-%ld-%llu.cmsr", batch->recordings,
+					d->width, d->height, d->mineCount, (unsigned long long) (batch->seed + i));
+				/* the game is over with its last move */
+				writeRecording(path, &recording, &engine, recording.time * 1000);
+			}
+		}
+	}
+
+	__atomic_fetch_add(&batch->wins, wins, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&batch->clicks, clicks, __ATOMIC_RELAXED);
+	freeRecording(&recording);
+	freeProbability(&probability);
+	freeSolver(&solver);
+	freeBitboard(&bits);
+	freeEngine(&engine);
+	return NULL;
+}
+
+static int compareLatency(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+	return (x > y) - (x < y);
+}
+
+/* returns the latency below which the fraction p of the sorted samples fall,
+   in microseconds */
+static double percentile(const uint64_t *sorted, long count, double p) {
+	long i = (long) (p * (count - 1) + 0.5);
+	return sorted[i] / 1000.0;
+}
+
+/* plays every game of the batch on the given number of threads and prints one
+   row of results */
+static int runBatch(Batch *batch, int threads) {
+	pthread_t *ids;
+	uint64_t start, elapsed;
+	char label[64];
+	int t;
+
+	batch->next = 0;
+	batch->wins = 0;
+	batch->clicks = 0;
+	batch->latencies = (uint64_t *) malloc(batch->games * sizeof(uint64_t));
+	ids = (pthread_t *) malloc(threads * sizeof(pthread_t));
+	if (batch->latencies == NULL || ids == NULL) {
+		free(batch->latencies);
+		free(ids);
+		return -1;
+	}
+
+	start = nanoseconds();
+	for (t = 0; t < threads; t++)
+		pthread_create(&ids[t], NULL, simThread, batch);
+	for (t = 0; t < threads; t++)
+		pthread_join(ids[t], NULL);
+	elapsed = nanoseconds() - start;
+
+	qsort(batch->latencies, batch->games, sizeof(uint64_t), compareLatency);
+	snprintf(label, sizeof(label), "%s %dx%d/%ld", batch->difficulty.name,
+		batch->difficulty.width, batch->difficulty.height, batch->difficulty.mineCount);
+	printf("%-26s %10ld %10ld %8.2f%% %9.1f %12.0f %9.1f %9.1f %9.1f %9.1f\n",
+		label, batch->games, batch->wins,
+		100.0 * batch->wins / batch->games,
+		(double) batch->clicks / batch->games,
+		batch->games / (elapsed / 1e9),
+		percentile(batch->latencies, batch->games, 0.50),
+		percentile(batch->latencies, batch->games, 0.90),
+		percentile(batch->latencies, batch->games, 0.99),
+		batch->latencies[batch->games - 1] / 1000.0);
+	fflush(stdout);
+
+	free(batch->latencies);
+	free(ids);
+	return 0;
+}
+
+static void usage(const char *name) {
+	fprintf(stderr,
+		"usage: %s [-n games] [-t threads] [-s seed] [-r dir] [-d difficulty]...\n"
+		"\n"
+		"  -n games       games to play per difficulty (default 100000)\n"
+		"  -t threads     worker threads (default: one per core)\n"
+		"  -s seed        seed of the first game (default: from the clock)\n"
+		"  -r dir         write a recording of every game to dir, named after\n"
+		"                 its difficulty and seed\n"
+		"  -d difficulty  beginner, intermediate, advanced or WxH/M, e.g.\n"
+		"                 100x100/2000; may be repeated (default: all presets)\n",
+		name);
+}
+
+int main(int argc, char *argv[]) {
+	Difficulty difficulties[64];
+	int difficultyCount = 0;
+	long games = 100000;
+	int threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	uint64_t seed = timeSeed();
+	const char *recordings = NULL;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "n:t:s:r:d:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			games = atol(optarg);
+			break;
+		case 't':
+			threads = atoi(optarg);
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'r':
+			recordings = optarg;
+			break;
+		case 'd':
+			if (difficultyCount == sizeof(difficulties) / sizeof(difficulties[0]))
+				break;
+			for (i = 0; i < 3; i++) {
+				if (strcasecmp(optarg, presets[i].name) == 0) {
+					difficulties[difficultyCount++] = presets[i];
+					break;
+				}
+			}
+			if (i == 3) {
+				Difficulty custom = { "Custom", 0, 0, 0 };
+				if (sscanf(optarg, "%dx%d/%ld", &custom.width, &custom.height, &custom.mineCount) != 3
+						|| custom.width < 2 || custom.height < 2 || custom.mineCount < 0
+						|| custom.mineCount > (long) custom.width * custom.height - 2) {
+					fprintf(stderr, "%s: invalid difficulty '%s'\n", argv[0], optarg);
+					return 1;
+				}
+				difficulties[difficultyCount++] = custom;
+			}
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (games < 1 || threads < 1) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (difficultyCount == 0) {
+		for (i = 0; i < 3; i++)
+			difficulties[difficultyCount++] = presets[i];
+	}
+
+	printf("seed %llu, %d threads\n\n", (unsigned long long) seed, threads);
+	printf("%-26s %10s %10s %9s %9s %12s %9s %9s %9s %9s\n",
+		"difficulty", "games", "wins", "win rate", "mean 3BV", "games/s",
+		"p50 us", "p90 us", "p99 us", "max us");
+	for (i = 0; i < difficultyCount; i++) {
+		Batch batch;
+		batch.difficulty = difficulties[i];
+		batch.games = games;
+		batch.seed = seed;
+		batch.recordings = recordings;
+		if (runBatch(&batch, threads) == -1) {
+			fprintf(stderr, "%s: out of memory\n", argv[0]);
+			return 1;
+		}
+	}
+	return 0;
+}
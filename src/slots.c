@@ -0,0 +1,433 @@
+/*
+ * slots.c
+ *
+ * Defines functions for keeping saved games in slots, and for maintaining the
+ * index of the slots
+ */
+
+#include <stdio.h>
+#include <stdlib.h>	/* getenv, qsort */
+#include <string.h>	/* memcpy, memcmp, memset, strcpy, strcat, strncmp */
+#include <ctype.h>	/* isdigit */
+#include <errno.h>	/* errno, EEXIST */
+#include <limits.h>	/* NAME_MAX */
+#include <fcntl.h>	/* open */
+#include <unistd.h>	/* write, fsync, close */
+#include <dirent.h>	/* opendir */
+#include <sys/file.h>	/* flock */
+#include <sys/stat.h>	/* stat */
+
+#include "slots.h"
+
+/* the lock held while the index is read and replaced, so that updates from
+   several games at once aren't lost */
+#define SLOT_LOCK_FILE	"slots.lock"
+
+/* the full name of a file in ~/.cminesweeper */
+static void slotPath(char *longname, const char *filename) {
+	memset(longname, 0, NAME_MAX + 1);
+	strcpy(longname, getenv("HOME"));
+	strcat(longname, "/.cminesweeper/");
+	strcat(longname, filename);
+}
+
+static void putLittleEndian(unsigned char *p, uint64_t value, int bytes) {
+	int i;
+	for (i = 0; i < bytes; i++)
+		p[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static uint64_t getLittleEndian(const unsigned char *p, int bytes) {
+	uint64_t value = 0;
+	int i;
+	for (i = bytes - 1; i >= 0; i--)
+		value = (value << 8) | p[i];
+	return value;
+}
+
+void slotFilename(char *filename, int slot) {
+	if (slot == 0)
+		snprintf(filename, SLOT_NAME_MAX, "savefile");
+	else
+		snprintf(filename, SLOT_NAME_MAX, "savefile-%d", slot);
+}
+
+/* returns the slot number of a save file name, or -1 if it isn't one */
+static int slotNumber(const char *filename) {
+	const char *p;
+	int slot = 0;
+
+	if (strcmp(filename, "savefile") == 0)
+		return 0;
+	if (strncmp(filename, "savefile-", 9) != 0 || filename[9] == '\0' || filename[9] == '0')
+		return -1;
+	for (p = filename + 9; *p != '\0'; p++) {
+		if (!isdigit((unsigned char) *p))
+			return -1;
+		slot = 10 * slot + (*p - '0');
+		if (slot > SLOT_MAX)
+			return -1;
+	}
+	return slot;
+}
+
+/* takes the exclusive lock on the index; returns the file descriptor to
+   release it with, or -1 */
+static int lockIndex(void) {
+	char longname[NAME_MAX + 1];
+	int fd;
+
+	slotPath(longname, SLOT_LOCK_FILE);
+	fd = open(longname, O_RDWR | O_CREAT, 0644);
+	if (fd != -1 && flock(fd, LOCK_EX) == -1) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void unlockIndex(int fd) {
+	if (fd != -1)
+		close(fd);
+}
+
+static void summarize(SlotSummary *summary, int slot, const Savegame *save, int64_t modified) {
+	summary->slot = slot;
+	summary->width = save->width;
+	summary->height = save->height;
+	summary->qtyMines = save->qtyMines;
+	summary->flagsPlaced = save->flagsPlaced;
+	summary->gameBools = save->gameBools;
+	summary->timeOffset = save->timeOffset;
+	summary->modified = modified;
+}
+
+/* adds summary to the index, replacing the entry of the same slot; returns -1
+   if memory runs out */
+static int setEntry(SlotIndex *index, const SlotSummary *summary) {
+	SlotSummary *slots;
+	int i;
+
+	for (i = 0; i < index->count && index->slots[i].slot < summary->slot; i++)
+		;
+	if (i < index->count && index->slots[i].slot == summary->slot) {
+		index->slots[i] = *summary;
+		return 0;
+	}
+
+	slots = (SlotSummary *) realloc(index->slots, (index->count + 1) * sizeof(SlotSummary));
+	if (slots == NULL)
+		return -1;
+	index->slots = slots;
+	memmove(&slots[i + 1], &slots[i], (index->count - i) * sizeof(SlotSummary));
+	slots[i] = *summary;
+	index->count++;
+	return 0;
+}
+
+/* takes slot out of the index; returns -1 if it wasn't in it */
+static int dropEntry(SlotIndex *index, int slot) {
+	int i;
+
+	for (i = 0; i < index->count; i++) {
+		if (index->slots[i].slot == slot) {
+			memmove(&index->slots[i], &index->slots[i + 1], (index->count - i - 1) * sizeof(SlotSummary));
+			index->count--;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/* reads the index file; returns -1 if it is missing or damaged, or if memory
+   runs out */
+static int readIndex(SlotIndex *index) {
+	char longname[NAME_MAX + 1];
+	unsigned char header[SLOT_INDEX_HEADER_SIZE], *entries, *p;
+	uint32_t count, crc;
+	FILE *file;
+	int i;
+
+	index->slots = NULL;
+	index->count = 0;
+
+	slotPath(longname, SLOT_INDEX_FILE);
+	file = fopen(longname, "rb");
+	if (file == NULL)
+		return -1;
+	if (fread(header, SLOT_INDEX_HEADER_SIZE, 1, file) != 1
+			|| memcmp(header, SLOT_INDEX_MAGIC, 4) != 0
+			|| getLittleEndian(header + 4, 2) != SLOT_INDEX_VERSION
+			|| getLittleEndian(header + 6, 2) != SLOT_INDEX_ENTRY_SIZE
+			|| (count = getLittleEndian(header + 8, 4)) > SLOT_MAX + 1) {
+		fclose(file);
+		return -1;
+	}
+
+	entries = (unsigned char *) malloc(count * SLOT_INDEX_ENTRY_SIZE + 1);
+	index->slots = (SlotSummary *) malloc(count * sizeof(SlotSummary) + 1);
+	if (entries == NULL || index->slots == NULL
+			|| (count > 0 && fread(entries, count * SLOT_INDEX_ENTRY_SIZE, 1, file) != 1)
+			|| fgetc(file) != EOF) {
+		free(entries);
+		freeSlotIndex(index);
+		fclose(file);
+		return -1;
+	}
+	fclose(file);
+
+	crc = crc32(0, header, SLOT_INDEX_HEADER_SIZE - 4);
+	crc = crc32(crc, entries, count * SLOT_INDEX_ENTRY_SIZE);
+	if (crc != getLittleEndian(header + 12, 4)) {
+		free(entries);
+		freeSlotIndex(index);
+		return -1;
+	}
+
+	for (i = 0, p = entries; i < (int) count; i++, p += SLOT_INDEX_ENTRY_SIZE) {
+		SlotSummary *summary = &index->slots[i];
+		summary->slot = getLittleEndian(p, 4);
+		summary->width = getLittleEndian(p + 4, 4);
+		summary->height = getLittleEndian(p + 8, 4);
+		summary->qtyMines = getLittleEndian(p + 12, 4);
+		summary->flagsPlaced = getLittleEndian(p + 16, 4);
+		summary->gameBools = getLittleEndian(p + 20, 4);
+		summary->timeOffset.tv_sec = getLittleEndian(p + 24, 8);
+		summary->timeOffset.tv_nsec = getLittleEndian(p + 32, 4);
+		summary->modified = getLittleEndian(p + 40, 8);
+	}
+	index->count = count;
+	free(entries);
+	return 0;
+}
+
+/* replaces the index file with index; the new index is written and synced
+   under another name first, so the old one stays whole until it is renamed
+   over, and the directory is synced after the rename. Returns -1 if it can't
+   be written. */
+static int writeIndex(const SlotIndex *index) {
+	char longname[NAME_MAX + 1], tempname[NAME_MAX + 1];
+	size_t size = SLOT_INDEX_HEADER_SIZE + (size_t) index->count * SLOT_INDEX_ENTRY_SIZE;
+	unsigned char *contents, *p;
+	ssize_t written;
+	int fd, i;
+
+	contents = (unsigned char *) calloc(size, 1);
+	if (contents == NULL)
+		return -1;
+	for (i = 0, p = contents + SLOT_INDEX_HEADER_SIZE; i < index->count; i++, p += SLOT_INDEX_ENTRY_SIZE) {
+		const SlotSummary *summary = &index->slots[i];
+		putLittleEndian(p, summary->slot, 4);
+		putLittleEndian(p + 4, summary->width, 4);
+		putLittleEndian(p + 8, summary->height, 4);
+		putLittleEndian(p + 12, summary->qtyMines, 4);
+		putLittleEndian(p + 16, summary->flagsPlaced, 4);
+		putLittleEndian(p + 20, summary->gameBools, 4);
+		putLittleEndian(p + 24, summary->timeOffset.tv_sec, 8);
+		putLittleEndian(p + 32, summary->timeOffset.tv_nsec, 4);
+		putLittleEndian(p + 40, summary->modified, 8);
+	}
+	memcpy(contents, SLOT_INDEX_MAGIC, 4);
+	putLittleEndian(contents + 4, SLOT_INDEX_VERSION, 2);
+	putLittleEndian(contents + 6, SLOT_INDEX_ENTRY_SIZE, 2);
+	putLittleEndian(contents + 8, index->count, 4);
+	putLittleEndian(contents + 12, crc32(crc32(0, contents, SLOT_INDEX_HEADER_SIZE - 4),
+		contents + SLOT_INDEX_HEADER_SIZE, size - SLOT_INDEX_HEADER_SIZE), 4);
+
+	slotPath(longname, SLOT_INDEX_FILE);
+	slotPath(tempname, SLOT_INDEX_FILE ".tmp");
+	fd = open(tempname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		free(contents);
+		return -1;
+	}
+	written = write(fd, contents, size);
+	free(contents);
+	if (written != (ssize_t) size || fsync(fd) == -1) {
+		close(fd);
+		remove(tempname);
+		return -1;
+	}
+	if (close(fd) == -1 || rename(tempname, longname) == -1) {
+		remove(tempname);
+		return -1;
+	}
+
+	/* the rename itself only lasts once the directory is synced */
+	syncDirectory(longname);
+	return 0;
+}
+
+static int compareSlots(const void *a, const void *b) {
+	return ((const SlotSummary *) a)->slot - ((const SlotSummary *) b)->slot;
+}
+
+/* builds the index from the save files in ~/.cminesweeper; returns -1 if
+   memory runs out */
+static int scanSlots(SlotIndex *index) {
+	char longname[NAME_MAX + 1];
+	struct dirent *entry;
+	DIR *directory;
+	int capacity = 0;
+
+	index->slots = NULL;
+	index->count = 0;
+
+	slotPath(longname, "");
+	directory = opendir(longname);
+	if (directory == NULL)
+		return 0;
+
+	while ((entry = readdir(directory)) != NULL) {
+		int slot = slotNumber(entry->d_name);
+		struct stat info;
+		Savegame save;
+
+		if (slot == -1 || loadSaveFile(entry->d_name, &save) == -1)
+			continue;
+		freeGameData(&save);
+		slotPath(longname, entry->d_name);
+		if (stat(longname, &info) == -1)
+			continue;
+
+		if (index->count == capacity) {
+			SlotSummary *slots;
+			capacity = (capacity == 0) ? 16 : 2 * capacity;
+			slots = (SlotSummary *) realloc(index->slots, capacity * sizeof(SlotSummary));
+			if (slots == NULL) {
+				closedir(directory);
+				freeSlotIndex(index);
+				return -1;
+			}
+			index->slots = slots;
+		}
+		summarize(&index->slots[index->count++], slot, &save, info.st_mtime);
+	}
+	closedir(directory);
+
+	qsort(index->slots, index->count, sizeof(SlotSummary), compareSlots);
+	return 0;
+}
+
+/* reads the index with the lock held, building it again if it has to be */
+static int readOrScan(SlotIndex *index) {
+	if (readIndex(index) == 0)
+		return 0;
+	if (scanSlots(index) == -1)
+		return -1;
+	writeIndex(index);
+	return 0;
+}
+
+int loadSlotIndex(SlotIndex *index) {
+	int lock = lockIndex();
+	int status = readOrScan(index);
+	unlockIndex(lock);
+	return status;
+}
+
+int freeSlotIndex(SlotIndex *index) {
+	free(index->slots);
+	index->slots = NULL;
+	index->count = 0;
+	return 0;
+}
+
+int unusedSlot(void) {
+	char filename[SLOT_NAME_MAX], longname[NAME_MAX + 1];
+	SlotIndex index;
+	int lock, slot, i, fd = -1;
+
+	/* the lock is held until the slot is taken, so that two games saving at
+	   once can't both be handed the same one */
+	lock = lockIndex();
+	if (readOrScan(&index) == -1) {
+		unlockIndex(lock);
+		return -1;
+	}
+
+	/* the entries are in order, so the first gap is the lowest free slot;
+	   a save file that isn't in the index yet is left alone all the same.
+	   The slot is taken by creating its save file, empty, which writeSlot
+	   later renames the real one over. */
+	for (slot = 0, i = 0; slot <= SLOT_MAX; slot++) {
+		if (i < index.count && index.slots[i].slot == slot) {
+			i++;
+			continue;
+		}
+		slotFilename(filename, slot);
+		slotPath(longname, filename);
+		fd = open(longname, O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd != -1)
+			break;
+		if (errno != EEXIST) {
+			slot = SLOT_MAX + 1;
+			break;
+		}
+	}
+	freeSlotIndex(&index);
+	unlockIndex(lock);
+
+	if (fd != -1)
+		close(fd);
+	return (slot <= SLOT_MAX) ? slot : -1;
+}
+
+int writeSlot(int slot, Savegame save, const Board *board) {
+	char filename[SLOT_NAME_MAX];
+	SlotSummary summary;
+	SlotIndex index;
+	int lock, status;
+
+	if (slot < 0 || SLOT_MAX < slot)
+		return -1;
+	slotFilename(filename, slot);
+	if (writeSaveBoard(filename, save, board) == -1)
+		return -1;
+
+	summarize(&summary, slot, &save, time(NULL));
+	lock = lockIndex();
+	status = readOrScan(&index);
+	if (status == 0) {
+		status = setEntry(&index, &summary);
+		if (status == 0)
+			status = writeIndex(&index);
+		freeSlotIndex(&index);
+	}
+	unlockIndex(lock);
+	return status;
+}
+
+/* takes slot out of the index */
+static void forgetSlot(int slot) {
+	SlotIndex index;
+	int lock = lockIndex();
+
+	if (readOrScan(&index) == 0) {
+		if (dropEntry(&index, slot) == 0)
+			writeIndex(&index);
+		freeSlotIndex(&index);
+	}
+	unlockIndex(lock);
+}
+
+int loadSlot(int slot, Savegame *saveptr) {
+	char filename[SLOT_NAME_MAX];
+
+	slotFilename(filename, slot);
+	if (loadSaveFile(filename, saveptr) == -1) {
+		forgetSlot(slot);
+		return -1;
+	}
+	return 0;
+}
+
+int removeSlot(int slot) {
+	char filename[SLOT_NAME_MAX];
+	int status;
+
+	slotFilename(filename, slot);
+	status = removeSaveFile(filename);
+	forgetSlot(slot);
+	return (status == 0) ? 0 : -1;
+}
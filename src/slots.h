@@ -0,0 +1,101 @@
+/*
+ * slots.h
+ *
+ * Contains declarations of the functions that keep several saved games in
+ * numbered slots, and of the index that lists them. The index holds a summary
+ * of every slot, so the slots can be listed without reading any board data.
+ */
+
+#include <stdint.h>
+#include <time.h>	/* timespec */
+
+#include "board.h"
+#include "savegame.h"
+
+#ifndef SLOTS_H
+#define SLOTS_H
+
+/* Slot 0 is the save file "savefile" in ~/.cminesweeper, where the only save
+   used to be kept, and slot n is "savefile-n". The index, "slots.index" next
+   to them, starts with a header of little-endian fields:
+
+	offset	size	field
+	0		4		magic, "CMSI"
+	4		2		format version, SLOT_INDEX_VERSION
+	6		2		size of an entry, SLOT_INDEX_ENTRY_SIZE
+	8		4		number of entries
+	12		4		CRC-32 of the header up to here followed by the entries
+
+   followed by one entry per slot, in order of slot number:
+
+	0		4		slot number
+	4		4		width
+	8		4		height
+	12		4		qtyMines
+	16		4		flagsPlaced
+	20		4		gameBools
+	24		8		seconds of timeOffset
+	32		4		nanoseconds of timeOffset
+	36		4		zero
+	40		8		time the slot was saved, in seconds since the epoch
+
+   The index is replaced as a whole by renaming a new one over it, so readers
+   see either the old or the new one. If it is missing or damaged, it is built
+   again from the save files. */
+#define SLOT_INDEX_FILE			"slots.index"
+#define SLOT_INDEX_MAGIC		"CMSI"
+#define SLOT_INDEX_VERSION		1
+#define SLOT_INDEX_HEADER_SIZE	16
+#define SLOT_INDEX_ENTRY_SIZE	48
+
+/* the highest slot number, and the longest file name of a slot */
+#define SLOT_MAX		9999
+#define SLOT_NAME_MAX	32
+
+/* what the index knows about a slot */
+typedef struct {
+	int32_t slot;
+	int32_t width, height;
+	int32_t qtyMines;
+	int32_t flagsPlaced;
+	uint32_t gameBools;
+	struct timespec timeOffset;	/* game duration */
+	int64_t modified;	/* when the slot was saved, in seconds since the epoch */
+} SlotSummary;
+
+typedef struct {
+	SlotSummary *slots;	/* in order of slot number */
+	int count;
+} SlotIndex;
+
+/* writes the name of the save file of slot, relative to ~/.cminesweeper, into
+   filename, which has room for SLOT_NAME_MAX bytes */
+void slotFilename(char *filename, int slot);
+
+/* reads the index, building it again from the save files if it is missing or
+   damaged; returns -1 if memory runs out.
+   REMEMBER TO CALL freeSlotIndex */
+int loadSlotIndex(SlotIndex *index);
+
+/* free the memory allocated for the index */
+int freeSlotIndex(SlotIndex *index);
+
+/* takes the lowest slot number that isn't in use by creating an empty save
+   file for it, so that no other game is handed it too; returns the slot, or
+   -1 if they are all in use or the file can't be created. An empty save file
+   is never listed, and a later writeSlot replaces it. */
+int unusedSlot(void);
+
+/* writes save to slot like writeSaveBoard, and adds its summary to the index;
+   returns -1 if either can't be written */
+int writeSlot(int slot, Savegame save, const Board *board);
+
+/* reads the save in slot like loadSaveFile; a slot that can't be read is
+   taken out of the index. Returns -1 if there is an error. */
+int loadSlot(int slot, Savegame *saveptr);
+
+/* removes the save file of slot and takes it out of the index; returns -1 if
+   there is no such save file */
+int removeSlot(int slot);
+
+#endif /* SLOTS_H */
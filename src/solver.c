@@ -0,0 +1,328 @@
+/*
+ * solver.c
+ *
+ * Defines functions for managing and running the Solver struct
+ */
+
+#include <stdlib.h>
+#include <string.h>	/* memset */
+
+#include "solver.h"
+
+#define POPCOUNT(w) __builtin_popcountll(w)
+
+/* The unknown neighbors of a number are kept as a set of bits in a 7x7 window
+   around some number A; that covers the neighbors of every number up to two
+   squares away from A, which are the only ones that can share squares with it.
+   This is the bit of the square at offset (dx, dy) from the window's center. */
+#define WINDOW_BIT(dx, dy) ((uint64_t) 1 << (((dy) + 3) * 7 + (dx) + 3))
+
+static inline long cellIndex(const Board *board, int x, int y) {
+	return (long) y * (board->width + 2) + x;
+}
+
+static inline bool isNumber(unsigned char c) {
+	return '1' <= c && c <= '8';
+}
+
+/* adds the cell at index i to the work queue, unless it is already in it */
+static inline void enqueue(Solver *solver, long i) {
+	if (solver->queued[i])
+		return;
+	solver->queued[i] = 1;
+	solver->queue[solver->queueCount++] = i;
+}
+
+/* queues the cell at index i and its neighbors, whose numbers are the ones
+   affected when the cell changes */
+static void enqueueAround(Solver *solver, long i) {
+	const long stride = solver->board->width + 2;
+	int h, k;
+
+	for (k = -1; k <= 1; k++) {
+		for (h = -1; h <= 1; h++) {
+			long j = i + k * stride + h;
+			if (0 <= j && j < solver->cells)
+				enqueue(solver, j);
+		}
+	}
+}
+
+/* records a deduction about the cell at index i */
+static void markKnown(Solver *solver, long i, int value) {
+	if (solver->known[i] != SOLVER_UNKNOWN)
+		return;
+
+	solver->known[i] = value;
+	solver->listed[i] = 1;
+	if (value == SOLVER_SAFE)
+		solver->safe[solver->safeCount++] = i;
+	else
+		solver->mines[solver->mineCount++] = i;
+	enqueueAround(solver, i);
+}
+
+/* records the same deduction about every square in set, a 7x7 window centered
+   on (x, y) */
+static void markWindow(Solver *solver, int x, int y, uint64_t set, int value) {
+	while (set != 0) {
+		int b = __builtin_ctzll(set);
+		markKnown(solver, cellIndex(solver->board, x + b % 7 - 3, y + b / 7 - 3), value);
+		set &= set - 1;
+	}
+}
+
+/* stores the unknown neighbors of the number at (x, y) in set, as a window
+   centered (ox, oy) squares to the left and above it, and returns how many of
+   them are mines, or -1 if that doesn't add up */
+static int constraint(const Solver *solver, int x, int y, int ox, int oy, uint64_t *set) {
+	const Board *board = solver->board;
+	int remaining = (CELL(*board, x, y) & MASK_CHAR) - '0';
+	int h, k;
+
+	*set = 0;
+	for (k = -1; k <= 1; k++) {
+		for (h = -1; h <= 1; h++) {
+			long j = cellIndex(board, x + h, y + k);
+			unsigned char c = board->array[j] & MASK_CHAR;
+
+			/* a flag is only the player's guess, so a flagged square counts
+			   as covered; the border is marked safe, so it never ends up in
+			   the set */
+			if (c != '+' && c != 'P')
+				continue;
+			if (solver->known[j] == SOLVER_MINE)
+				remaining--;
+			else if (solver->known[j] == SOLVER_UNKNOWN)
+				*set |= WINDOW_BIT(ox + h, oy + k);
+		}
+	}
+
+	if (remaining < 0 || remaining > POPCOUNT(*set))
+		return -1;
+	return remaining;
+}
+
+/* checks the number on the cell at index i on its own and against every number
+   that shares squares with it */
+static void checkNumber(Solver *solver, long i) {
+	const Board *board = solver->board;
+	const long stride = board->width + 2;
+	int x = i % stride, y = i / stride;
+	uint64_t a, b, diff;
+	int ra, rb, rd;
+	int ox, oy;
+
+	if (!isNumber(board->array[i] & MASK_CHAR))
+		return;
+	ra = constraint(solver, x, y, 0, 0, &a);
+	if (ra < 0 || a == 0)
+		return;
+
+	/* all of the unknown neighbors are safe, or all of them are mines */
+	if (ra == 0) {
+		markWindow(solver, x, y, a, SOLVER_SAFE);
+		return;
+	}
+	if (ra == POPCOUNT(a)) {
+		markWindow(solver, x, y, a, SOLVER_MINE);
+		return;
+	}
+
+	/* When the unknown neighbors of one number are a subset of the unknown
+	   neighbors of another, the squares only the second one touches hold the
+	   difference between their mines. */
+	for (oy = -2; oy <= 2; oy++) {
+		for (ox = -2; ox <= 2; ox++) {
+			int bx = x + ox, by = y + oy;
+
+			if ((ox == 0 && oy == 0) || bx < 1 || board->width < bx || by < 1 || board->height < by)
+				continue;
+			if (!isNumber(CELL(*board, bx, by) & MASK_CHAR))
+				continue;
+			rb = constraint(solver, bx, by, ox, oy, &b);
+			if (rb < 0 || b == 0 || a == b)
+				continue;
+
+			if ((a & ~b) == 0) {
+				/* a is a subset of b; the squares being marked aren't next to
+				   this number, so a stays valid */
+				diff = b & ~a;
+				rd = rb - ra;
+				if (rd == 0)
+					markWindow(solver, x, y, diff, SOLVER_SAFE);
+				else if (rd == POPCOUNT(diff))
+					markWindow(solver, x, y, diff, SOLVER_MINE);
+			} else if ((b & ~a) == 0) {
+				/* b is a subset of a; marking squares of a queues this number
+				   again, so stop here rather than go on with a stale set */
+				diff = a & ~b;
+				rd = ra - rb;
+				if (rd == 0) {
+					markWindow(solver, x, y, diff, SOLVER_SAFE);
+					return;
+				} else if (rd == POPCOUNT(diff)) {
+					markWindow(solver, x, y, diff, SOLVER_MINE);
+					return;
+				}
+			}
+		}
+	}
+}
+
+int initSolver(Solver *solver, Board *board) {
+	solver->board = board;
+	solver->cells = (long) (board->width + 2) * (board->height + 2);
+
+	/* every cell is queued and listed at most once at a time, which bounds
+	   the lists */
+	solver->known = (unsigned char *) malloc(solver->cells);
+	solver->seen = (unsigned char *) malloc(solver->cells);
+	solver->queued = (unsigned char *) malloc(solver->cells);
+	solver->queue = (long *) malloc(solver->cells * sizeof(long));
+	solver->safe = (long *) malloc(solver->cells * sizeof(long));
+	solver->mines = (long *) malloc(solver->cells * sizeof(long));
+	solver->listed = (unsigned char *) malloc(solver->cells);
+	if (solver->known == NULL || solver->seen == NULL || solver->queued == NULL
+			|| solver->queue == NULL || solver->safe == NULL || solver->mines == NULL
+			|| solver->listed == NULL) {
+		freeSolver(solver);
+		return -1;
+	}
+
+	return resetSolver(solver);
+}
+
+int freeSolver(Solver *solver) {
+	free(solver->known);
+	free(solver->seen);
+	free(solver->queued);
+	free(solver->queue);
+	free(solver->safe);
+	free(solver->mines);
+	free(solver->listed);
+	solver->known = solver->seen = solver->queued = solver->listed = NULL;
+	solver->queue = solver->safe = solver->mines = NULL;
+	return 0;
+}
+
+int resetSolver(Solver *solver) {
+	const Board *board = solver->board;
+	int x, y;
+
+	/* the border is never opened, so treating it as known to be safe keeps it
+	   out of every set without bounds checks */
+	memset(solver->known, SOLVER_SAFE, solver->cells);
+	memset(solver->queued, 0, solver->cells);
+	memset(solver->listed, 0, solver->cells);
+	solver->queueCount = 0;
+	solver->safeCount = 0;
+	solver->mineCount = 0;
+
+	for (y = 0; y <= board->height + 1; y++) {
+		for (x = 0; x <= board->width + 1; x++) {
+			long i = cellIndex(board, x, y);
+			solver->seen[i] = board->array[i] & MASK_CHAR;
+			if (1 <= x && x <= board->width && 1 <= y && y <= board->height)
+				solver->known[i] = SOLVER_UNKNOWN;
+			if (isNumber(solver->seen[i]))
+				enqueue(solver, i);
+		}
+	}
+	return 0;
+}
+
+/* queues the numbers around the cell at index i if it changed since the last
+   time it was looked at */
+static void updateCell(Solver *solver, long i) {
+	const long stride = solver->board->width + 2;
+	int x = i % stride, y = i / stride;
+	unsigned char c = solver->board->array[i] & MASK_CHAR;
+
+	if (c == solver->seen[i])
+		return;
+	solver->seen[i] = c;
+	enqueueAround(solver, i);
+
+	/* a known square dropped from its list while it was flagged goes back on
+	   it once the flag is removed */
+	if (c == '+' && solver->known[i] != SOLVER_UNKNOWN && !solver->listed[i]
+			&& 1 <= x && x <= solver->board->width && 1 <= y && y <= solver->board->height) {
+		solver->listed[i] = 1;
+		if (solver->known[i] == SOLVER_SAFE)
+			solver->safe[solver->safeCount++] = i;
+		else
+			solver->mines[solver->mineCount++] = i;
+	}
+}
+
+void solverUpdate(Solver *solver, int x, int y) {
+	if (x < 0 || solver->board->width + 1 < x || y < 0 || solver->board->height + 1 < y)
+		return;
+	updateCell(solver, cellIndex(solver->board, x, y));
+}
+
+int solverSyncDirty(Solver *solver) {
+	const Board *board = solver->board;
+	long i;
+
+	if (board->allChanged)
+		return resetSolver(solver);
+
+	for (i = 0; i < board->dirtyCount; i++)
+		updateCell(solver, board->dirty[i]);
+	return 0;
+}
+
+long solverRun(Solver *solver) {
+	long found = solver->safeCount + solver->mineCount;
+
+	while (solver->queueCount > 0) {
+		long i = solver->queue[--solver->queueCount];
+		solver->queued[i] = 0;
+		checkNumber(solver, i);
+	}
+
+	return solver->safeCount + solver->mineCount - found;
+}
+
+/* returns the last cell in list that is still covered, dropping the ones after
+   it that aren't, or -1 if there is none */
+static long lastCovered(Solver *solver, const long *list, long *count) {
+	while (*count > 0) {
+		long i = list[*count - 1];
+		if ((solver->board->array[i] & MASK_CHAR) == '+')
+			return i;
+		solver->listed[i] = 0;
+		(*count)--;
+	}
+	return -1;
+}
+
+bool solverNextSafe(Solver *solver, int *x, int *y) {
+	const long stride = solver->board->width + 2;
+	long i = lastCovered(solver, solver->safe, &solver->safeCount);
+
+	if (i == -1)
+		return false;
+	*x = i % stride;
+	*y = i / stride;
+	return true;
+}
+
+bool solverNextMine(Solver *solver, int *x, int *y) {
+	const long stride = solver->board->width + 2;
+	long i = lastCovered(solver, solver->mines, &solver->mineCount);
+
+	if (i == -1)
+		return false;
+	*x = i % stride;
+	*y = i / stride;
+	return true;
+}
+
+int solverKnown(const Solver *solver, int x, int y) {
+	if (x < 1 || solver->board->width < x || y < 1 || solver->board->height < y)
+		return SOLVER_UNKNOWN;
+	return solver->known[cellIndex(solver->board, x, y)];
+}
@@ -0,0 +1,77 @@
+/*
+ * solver.h
+ *
+ * Contains declarations of the Solver struct, which finds squares that are
+ * certainly safe or certainly mines from what is visible on a Board, and of the
+ * functions to keep it up to date as the board changes. The solver only looks
+ * at the numbers and covered squares, never at the mine bits, so its answers
+ * are the ones a player could work out. Flags are taken for covered squares,
+ * since they may be wrong, so placing or removing one never changes what the
+ * solver knows.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "board.h"
+
+#ifndef SOLVER_H
+#define SOLVER_H
+
+/* what the solver knows about a square */
+#define SOLVER_UNKNOWN	0
+#define SOLVER_SAFE		1
+#define SOLVER_MINE		2
+
+typedef struct {
+	Board *board;			/* the board being solved */
+	long cells;				/* size of the board's array, including the border */
+	unsigned char *known;	/* SOLVER_ value of every cell */
+	unsigned char *seen;	/* character of every cell the last time it was looked at */
+	unsigned char *queued;	/* the number on the cell is in the work queue */
+	long *queue;			/* numbers that have to be checked again */
+	long queueCount;
+	long *safe;				/* cells found to be safe, in the order they were found */
+	long safeCount;
+	long *mines;			/* cells found to be mines, in the order they were found */
+	long mineCount;
+	unsigned char *listed;	/* the cell is in safe or mines */
+} Solver;
+
+/* set up a solver for board, which has to stay allocated as long as the solver
+   is used; returns -1 if the memory can't be allocated */
+int initSolver(Solver *solver, Board *board);
+
+/* free the memory allocated for the solver */
+int freeSolver(Solver *solver);
+
+/* forget everything that was worked out and look at the whole board again */
+int resetSolver(Solver *solver);
+
+/* tells the solver that the square at (x, y) may have changed */
+void solverUpdate(Solver *solver, int x, int y);
+
+/* tells the solver about every square in the board's list of changed squares,
+   or starts over if squares changed without being listed; redrawing the whole
+   board doesn't count as a change. The list is left as it is, so this has to
+   be called before the board is redrawn; callers that never redraw the board
+   have to clear the list themselves with clearDirty. */
+int solverSyncDirty(Solver *solver);
+
+/* works out everything that follows from the changes seen so far; returns the
+   number of squares newly found to be safe or mines */
+long solverRun(Solver *solver);
+
+/* stores the coordinates of a covered square that is known to be safe in x and
+   y, and returns true, or returns false if there is none. The same square is
+   returned until it is opened. */
+bool solverNextSafe(Solver *solver, int *x, int *y);
+
+/* like solverNextSafe, for covered squares without a flag that are known to be
+   mines */
+bool solverNextMine(Solver *solver, int *x, int *y);
+
+/* returns what the solver knows about the square at (x, y) */
+int solverKnown(const Solver *solver, int x, int y);
+
+#endif /* SOLVER_H */
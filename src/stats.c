@@ -0,0 +1,479 @@
+/*
+ * stats.c
+ *
+ * Defines functions for logging the results of games, and for keeping the
+ * totals worked out from the log
+ */
+
+#include <stdio.h>
+#include <stdlib.h>	/* getenv */
+#include <string.h>	/* memcpy, memcmp, memmove, memset, strcpy, strcat */
+#include <limits.h>	/* NAME_MAX */
+#include <time.h>	/* time */
+#include <fcntl.h>	/* open */
+#include <unistd.h>	/* read, write, lseek, ftruncate, fsync, close */
+#include <sys/file.h>	/* flock */
+#include <sys/stat.h>	/* fstat */
+
+#include "stats.h"
+#include "savegame.h"	/* crc32 */
+
+/* the lock held while the log is appended to and the totals are replaced */
+#define STATS_LOCK_FILE	"results.lock"
+
+/* the most board sizes the totals are read with, against damaged files */
+#define STATS_MAX_ENTRIES	(1 << 20)
+
+/* records read from the log at a time */
+#define STATS_READ_RECORDS	1024
+
+/* the full name of a file in ~/.cminesweeper */
+static void statsPath(char *longname, const char *filename) {
+	memset(longname, 0, NAME_MAX + 1);
+	strcpy(longname, getenv("HOME"));
+	strcat(longname, "/.cminesweeper/");
+	strcat(longname, filename);
+}
+
+static void putLittleEndian(unsigned char *p, uint64_t value, int bytes) {
+	int i;
+	for (i = 0; i < bytes; i++)
+		p[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static uint64_t getLittleEndian(const unsigned char *p, int bytes) {
+	uint64_t value = 0;
+	int i;
+	for (i = bytes - 1; i >= 0; i--)
+		value = (value << 8) | p[i];
+	return value;
+}
+
+/* takes the exclusive lock on the log and the totals; returns the file
+   descriptor to release it with, or -1 */
+static int lockStats(void) {
+	char longname[NAME_MAX + 1];
+	int fd;
+
+	statsPath(longname, STATS_LOCK_FILE);
+	fd = open(longname, O_RDWR | O_CREAT, 0644);
+	if (fd != -1 && flock(fd, LOCK_EX) == -1) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void unlockStats(int fd) {
+	if (fd != -1)
+		close(fd);
+}
+
+/* the bucket of the time histogram that a duration in microseconds falls in */
+static int timeBucket(int64_t duration) {
+	uint64_t ms = (duration > 0) ? duration / 1000 : 0;
+	int doubling = 0;
+
+	if (ms < STATS_STEPS)
+		return ms;
+	while ((ms >> doubling) >= 2 * STATS_STEPS)
+		doubling++;
+	/* past the last doubling everything goes in the last bucket */
+	if (doubling >= STATS_BUCKETS / STATS_STEPS - 1)
+		return STATS_BUCKETS - 1;
+	return STATS_STEPS * (doubling + 1) + (ms >> doubling) - STATS_STEPS;
+}
+
+/* the middle of a bucket of the time histogram, in milliseconds */
+static double bucketTime(int bucket) {
+	int doubling;
+
+	if (bucket < STATS_STEPS)
+		return bucket + 0.5;
+	doubling = bucket / STATS_STEPS - 1;
+	return (double) ((uint64_t) (STATS_STEPS + bucket % STATS_STEPS) << doubling)
+		+ (double) (1ULL << doubling) / 2;
+}
+
+static void encodeRecord(unsigned char *p, const GameResult *result) {
+	memset(p, 0, RESULTS_RECORD_SIZE);
+	putLittleEndian(p, result->width, 4);
+	putLittleEndian(p + 4, result->height, 4);
+	putLittleEndian(p + 8, result->qtyMines, 4);
+	p[12] = result->won;
+	p[13] = result->noGuess;
+	putLittleEndian(p + 16, result->duration, 8);
+	putLittleEndian(p + 24, result->finished, 8);
+	putLittleEndian(p + 32, crc32(0, p, 32), 4);
+}
+
+/* reads a record of the log; returns -1 if it is damaged */
+static int decodeRecord(const unsigned char *p, GameResult *result) {
+	if (crc32(0, p, 32) != getLittleEndian(p + 32, 4))
+		return -1;
+	result->width = getLittleEndian(p, 4);
+	result->height = getLittleEndian(p + 4, 4);
+	result->qtyMines = getLittleEndian(p + 8, 4);
+	result->won = p[12] != 0;
+	result->noGuess = p[13] != 0;
+	result->duration = getLittleEndian(p + 16, 8);
+	result->finished = getLittleEndian(p + 24, 8);
+	return 0;
+}
+
+/* orders board sizes by number of squares, then by mines */
+static int compareSize(const StatsEntry *entry, const GameResult *result) {
+	int64_t area = (int64_t) entry->width * entry->height;
+	int64_t resultArea = (int64_t) result->width * result->height;
+
+	if (area != resultArea)
+		return (area < resultArea) ? -1 : 1;
+	if (entry->qtyMines != result->qtyMines)
+		return (entry->qtyMines < result->qtyMines) ? -1 : 1;
+	if (entry->width != result->width)
+		return (entry->width < result->width) ? -1 : 1;
+	return 0;
+}
+
+/* adds result to the totals of its board size; returns -1 if memory runs out */
+static int addResult(Stats *stats, const GameResult *result) {
+	StatsEntry *entry;
+	int lo = 0, hi = stats->count;
+
+	/* the entries are in order, so the board size is found by bisection */
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (compareSize(&stats->entries[mid], result) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == stats->count || compareSize(&stats->entries[lo], result) != 0) {
+		StatsEntry *entries;
+		if (stats->count == STATS_MAX_ENTRIES)
+			return -1;
+		entries = (StatsEntry *) realloc(stats->entries, (stats->count + 1) * sizeof(StatsEntry));
+		if (entries == NULL)
+			return -1;
+		stats->entries = entries;
+		memmove(&entries[lo + 1], &entries[lo], (stats->count - lo) * sizeof(StatsEntry));
+		memset(&entries[lo], 0, sizeof(StatsEntry));
+		entries[lo].width = result->width;
+		entries[lo].height = result->height;
+		entries[lo].qtyMines = result->qtyMines;
+		stats->count++;
+	}
+
+	entry = &stats->entries[lo];
+	entry->games++;
+	if (result->won) {
+		entry->wins++;
+		entry->wonTime += result->duration;
+		if (entry->best == 0 || result->duration < entry->best)
+			entry->best = result->duration;
+		entry->times[timeBucket(result->duration)]++;
+	}
+	return 0;
+}
+
+/* reads the header of the log open in fd; returns -1 if it isn't a log */
+static int readLogHeader(int fd, int64_t *created) {
+	unsigned char header[RESULTS_HEADER_SIZE];
+
+	if (pread(fd, header, RESULTS_HEADER_SIZE, 0) != RESULTS_HEADER_SIZE
+			|| memcmp(header, RESULTS_MAGIC, 4) != 0
+			|| getLittleEndian(header + 4, 2) != RESULTS_VERSION
+			|| getLittleEndian(header + 6, 2) != RESULTS_RECORD_SIZE)
+		return -1;
+	*created = getLittleEndian(header + 8, 8);
+	return 0;
+}
+
+/* adds the records of the log open in fd from stats->logSize up to the last
+   whole one to the totals; returns -1 if the log can't be read or memory runs
+   out */
+static int addRecords(Stats *stats, int fd, int64_t fileSize) {
+	unsigned char *buffer;
+	int64_t end = fileSize - (fileSize - RESULTS_HEADER_SIZE) % RESULTS_RECORD_SIZE;
+
+	buffer = (unsigned char *) malloc(STATS_READ_RECORDS * RESULTS_RECORD_SIZE);
+	if (buffer == NULL)
+		return -1;
+
+	while (stats->logSize < end) {
+		size_t size = STATS_READ_RECORDS * RESULTS_RECORD_SIZE;
+		unsigned char *p;
+		if ((int64_t) size > end - stats->logSize)
+			size = end - stats->logSize;
+		if (pread(fd, buffer, size, stats->logSize) != (ssize_t) size) {
+			free(buffer);
+			return -1;
+		}
+		for (p = buffer; p < buffer + size; p += RESULTS_RECORD_SIZE) {
+			GameResult result;
+			if (decodeRecord(p, &result) == -1)
+				continue;
+			if (addResult(stats, &result) == -1) {
+				free(buffer);
+				return -1;
+			}
+		}
+		stats->logSize += size;
+	}
+
+	free(buffer);
+	return 0;
+}
+
+/* reads the totals file; returns -1 if it is missing or damaged, or if memory
+   runs out */
+static int readTotals(Stats *stats) {
+	char longname[NAME_MAX + 1];
+	unsigned char header[STATS_HEADER_SIZE], *entries, *p;
+	uint32_t count, crc;
+	FILE *file;
+	int i, j;
+
+	stats->entries = NULL;
+	stats->count = 0;
+
+	statsPath(longname, STATS_FILE);
+	file = fopen(longname, "rb");
+	if (file == NULL)
+		return -1;
+	if (fread(header, STATS_HEADER_SIZE, 1, file) != 1
+			|| memcmp(header, STATS_MAGIC, 4) != 0
+			|| getLittleEndian(header + 4, 2) != STATS_VERSION
+			|| getLittleEndian(header + 6, 2) != STATS_ENTRY_SIZE
+			|| (count = getLittleEndian(header + 8, 4)) > STATS_MAX_ENTRIES) {
+		fclose(file);
+		return -1;
+	}
+
+	entries = (unsigned char *) malloc((size_t) count * STATS_ENTRY_SIZE + 1);
+	stats->entries = (StatsEntry *) malloc(count * sizeof(StatsEntry) + 1);
+	if (entries == NULL || stats->entries == NULL
+			|| (count > 0 && fread(entries, (size_t) count * STATS_ENTRY_SIZE, 1, file) != 1)
+			|| fgetc(file) != EOF) {
+		free(entries);
+		freeStats(stats);
+		fclose(file);
+		return -1;
+	}
+	fclose(file);
+
+	crc = crc32(0, header, 32);
+	crc = crc32(crc, entries, (size_t) count * STATS_ENTRY_SIZE);
+	if (crc != getLittleEndian(header + 32, 4)) {
+		free(entries);
+		freeStats(stats);
+		return -1;
+	}
+
+	for (i = 0, p = entries; i < (int) count; i++, p += STATS_ENTRY_SIZE) {
+		StatsEntry *entry = &stats->entries[i];
+		entry->width = getLittleEndian(p, 4);
+		entry->height = getLittleEndian(p + 4, 4);
+		entry->qtyMines = getLittleEndian(p + 8, 4);
+		entry->games = getLittleEndian(p + 16, 8);
+		entry->wins = getLittleEndian(p + 24, 8);
+		entry->best = getLittleEndian(p + 32, 8);
+		entry->wonTime = getLittleEndian(p + 40, 8);
+		for (j = 0; j < STATS_BUCKETS; j++)
+			entry->times[j] = getLittleEndian(p + 48 + 4 * j, 4);
+	}
+	stats->count = count;
+	stats->created = getLittleEndian(header + 16, 8);
+	stats->logSize = getLittleEndian(header + 24, 8);
+	free(entries);
+	return 0;
+}
+
+/* replaces the totals file with stats; the new file is written and synced
+   under another name first, so the old one stays whole until it is renamed
+   over. Returns -1 if it can't be written. */
+static int writeTotals(const Stats *stats) {
+	char longname[NAME_MAX + 1], tempname[NAME_MAX + 1];
+	size_t size = STATS_HEADER_SIZE + (size_t) stats->count * STATS_ENTRY_SIZE;
+	unsigned char *contents, *p;
+	ssize_t written;
+	int fd, i, j;
+
+	contents = (unsigned char *) calloc(size, 1);
+	if (contents == NULL)
+		return -1;
+	for (i = 0, p = contents + STATS_HEADER_SIZE; i < stats->count; i++, p += STATS_ENTRY_SIZE) {
+		const StatsEntry *entry = &stats->entries[i];
+		putLittleEndian(p, entry->width, 4);
+		putLittleEndian(p + 4, entry->height, 4);
+		putLittleEndian(p + 8, entry->qtyMines, 4);
+		putLittleEndian(p + 16, entry->games, 8);
+		putLittleEndian(p + 24, entry->wins, 8);
+		putLittleEndian(p + 32, entry->best, 8);
+		putLittleEndian(p + 40, entry->wonTime, 8);
+		for (j = 0; j < STATS_BUCKETS; j++)
+			putLittleEndian(p + 48 + 4 * j, entry->times[j], 4);
+	}
+	memcpy(contents, STATS_MAGIC, 4);
+	putLittleEndian(contents + 4, STATS_VERSION, 2);
+	putLittleEndian(contents + 6, STATS_ENTRY_SIZE, 2);
+	putLittleEndian(contents + 8, stats->count, 4);
+	putLittleEndian(contents + 16, stats->created, 8);
+	putLittleEndian(contents + 24, stats->logSize, 8);
+	putLittleEndian(contents + 32, crc32(crc32(0, contents, 32),
+		contents + STATS_HEADER_SIZE, size - STATS_HEADER_SIZE), 4);
+
+	statsPath(longname, STATS_FILE);
+	statsPath(tempname, STATS_FILE ".tmp");
+	fd = open(tempname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		free(contents);
+		return -1;
+	}
+	written = write(fd, contents, size);
+	free(contents);
+	if (written != (ssize_t) size || fsync(fd) == -1) {
+		close(fd);
+		remove(tempname);
+		return -1;
+	}
+	if (close(fd) == -1 || rename(tempname, longname) == -1) {
+		remove(tempname);
+		return -1;
+	}
+	return 0;
+}
+
+/* brings the totals up to date with the log, with the lock held; with
+   rebuild, or if the totals can't be used, they are worked out from the whole
+   log again. Returns -1 if memory runs out. */
+static int updateTotals(Stats *stats, bool rebuild) {
+	char longname[NAME_MAX + 1];
+	struct stat info;
+	int64_t created, logSize;
+	int fd, status;
+
+	stats->entries = NULL;
+	stats->count = 0;
+	stats->created = 0;
+	stats->logSize = RESULTS_HEADER_SIZE;
+
+	/* without a log there is nothing to count */
+	statsPath(longname, RESULTS_LOG_FILE);
+	fd = open(longname, O_RDONLY);
+	if (fd == -1)
+		return 0;
+	if (fstat(fd, &info) == -1 || readLogHeader(fd, &created) == -1) {
+		close(fd);
+		return 0;
+	}
+
+	/* totals of another log, or of more of the log than there is, are of no
+	   use */
+	if (rebuild || readTotals(stats) == -1
+			|| stats->created != created
+			|| stats->logSize < RESULTS_HEADER_SIZE
+			|| stats->logSize > info.st_size
+			|| (stats->logSize - RESULTS_HEADER_SIZE) % RESULTS_RECORD_SIZE != 0) {
+		freeStats(stats);
+		stats->created = created;
+		stats->logSize = RESULTS_HEADER_SIZE;
+		rebuild = true;
+	}
+
+	logSize = stats->logSize;
+	status = addRecords(stats, fd, info.st_size);
+	close(fd);
+	if (status == -1) {
+		freeStats(stats);
+		return -1;
+	}
+	if (rebuild || stats->logSize != logSize)
+		writeTotals(stats);
+	return 0;
+}
+
+int recordResult(const GameResult *result) {
+	char longname[NAME_MAX + 1];
+	unsigned char record[RESULTS_RECORD_SIZE];
+	struct stat info;
+	int64_t created;
+	Stats stats;
+	int fd, lock, status = 0;
+
+	lock = lockStats();
+	statsPath(longname, RESULTS_LOG_FILE);
+	fd = open(longname, O_RDWR | O_CREAT | O_APPEND, 0644);
+	if (fd == -1 || fstat(fd, &info) == -1) {
+		if (fd != -1)
+			close(fd);
+		unlockStats(lock);
+		return -1;
+	}
+
+	if (info.st_size < RESULTS_HEADER_SIZE) {
+		/* a new log, or one whose header never made it to disk */
+		unsigned char header[RESULTS_HEADER_SIZE];
+		memcpy(header, RESULTS_MAGIC, 4);
+		putLittleEndian(header + 4, RESULTS_VERSION, 2);
+		putLittleEndian(header + 6, RESULTS_RECORD_SIZE, 2);
+		putLittleEndian(header + 8, time(NULL), 8);
+		if (ftruncate(fd, 0) == -1 || write(fd, header, RESULTS_HEADER_SIZE) != RESULTS_HEADER_SIZE)
+			status = -1;
+	} else if (readLogHeader(fd, &created) == -1) {
+		/* not a log this version knows; it is left alone */
+		status = -1;
+	} else if ((info.st_size - RESULTS_HEADER_SIZE) % RESULTS_RECORD_SIZE != 0) {
+		/* drop the part of a record that was being written when the game
+		   was cut off, so the new one lines up */
+		if (ftruncate(fd, info.st_size - (info.st_size - RESULTS_HEADER_SIZE) % RESULTS_RECORD_SIZE) == -1)
+			status = -1;
+	}
+
+	if (status == 0) {
+		encodeRecord(record, result);
+		if (write(fd, record, RESULTS_RECORD_SIZE) != RESULTS_RECORD_SIZE || fsync(fd) == -1)
+			status = -1;
+	}
+	close(fd);
+
+	if (status == 0 && updateTotals(&stats, false) == 0)
+		freeStats(&stats);
+	unlockStats(lock);
+	return status;
+}
+
+int loadStats(Stats *stats) {
+	int lock = lockStats();
+	int status = updateTotals(stats, false);
+	unlockStats(lock);
+	return status;
+}
+
+int rebuildStats(Stats *stats) {
+	int lock = lockStats();
+	int status = updateTotals(stats, true);
+	unlockStats(lock);
+	return status;
+}
+
+int freeStats(Stats *stats) {
+	free(stats->entries);
+	stats->entries = NULL;
+	stats->count = 0;
+	return 0;
+}
+
+double statsPercentile(const StatsEntry *entry, double p) {
+	int64_t seen = 0;
+	int bucket;
+
+	if (entry->wins == 0)
+		return 0.0;
+	for (bucket = 0; bucket < STATS_BUCKETS - 1; bucket++) {
+		seen += entry->times[bucket];
+		if (seen >= p * entry->wins)
+			break;
+	}
+	return bucketTime(bucket) / 1000;
+}
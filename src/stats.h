@@ -0,0 +1,133 @@
+/*
+ * stats.h
+ *
+ * Contains declarations of the functions that keep the results of every game
+ * played, and of the statistics worked out from them. Every result is added
+ * to an append-only log, and the totals for each board size are kept up to date
+ * in a small file next to it, so they can be shown without reading the log.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef STATS_H
+#define STATS_H
+
+/* The log, "results.log" in ~/.cminesweeper, starts with a header of
+   little-endian fields:
+
+	offset	size	field
+	0		4		magic, "CMSL"
+	4		2		format version, RESULTS_VERSION
+	6		2		size of a record, RESULTS_RECORD_SIZE
+	8		8		time the log was started, in seconds since the epoch
+
+   followed by one record per game, in the order they ended:
+
+	0		4		width
+	4		4		height
+	8		4		qtyMines
+	12		1		1 if the game was won, 0 if it was lost
+	13		1		1 if the board was generated without guesses
+	14		2		zero
+	16		8		duration of the game in microseconds
+	24		8		time the game ended, in seconds since the epoch
+	32		4		CRC-32 of the record up to here
+	36		4		zero
+
+   A record that was cut short or doesn't match its CRC is skipped. */
+#define RESULTS_LOG_FILE		"results.log"
+#define RESULTS_MAGIC			"CMSL"
+#define RESULTS_VERSION			1
+#define RESULTS_HEADER_SIZE		16
+#define RESULTS_RECORD_SIZE		40
+
+/* The totals, "results.stats", start with a header:
+
+	0		4		magic, "CMSA"
+	4		2		format version, STATS_VERSION
+	6		2		size of an entry, STATS_ENTRY_SIZE
+	8		4		number of entries
+	12		4		zero
+	16		8		time the log was started, as in its header
+	24		8		bytes of the log that have been added to the totals
+	32		4		CRC-32 of the header up to here followed by the entries
+	36		4		zero
+
+   followed by one entry per board size, as in StatsEntry:
+
+	0		4		width
+	4		4		height
+	8		4		qtyMines
+	12		4		zero
+	16		8		games
+	24		8		wins
+	32		8		best time in microseconds, 0 if there are no wins
+	40		8		sum of the times of the wins in microseconds
+	48		4 * STATS_BUCKETS	the time histogram
+
+   Only the records after the bytes already added are read to bring the totals
+   up to date. If the file is missing, damaged or belongs to another log, it is
+   built again from the whole log. */
+#define STATS_FILE			"results.stats"
+#define STATS_MAGIC			"CMSA"
+#define STATS_VERSION		1
+#define STATS_HEADER_SIZE	40
+
+/* the times of the wins are counted in a histogram of milliseconds: times
+   under 16 ms have a bucket each, and every doubling above that is split into
+   STATS_STEPS equal buckets, so a percentile read from it is off by under
+   3.2%. The last bucket also holds every time over 2^30 ms, about 12 days. */
+#define STATS_STEPS			16
+#define STATS_BUCKETS		(27 * STATS_STEPS)
+#define STATS_ENTRY_SIZE	(48 + 4 * STATS_BUCKETS)
+
+/* the result of a game */
+typedef struct {
+	int32_t width, height;
+	int32_t qtyMines;
+	bool won;
+	bool noGuess;
+	int64_t duration;	/* in microseconds */
+	int64_t finished;	/* in seconds since the epoch */
+} GameResult;
+
+/* the totals for one board size */
+typedef struct {
+	int32_t width, height;
+	int32_t qtyMines;
+	int64_t games, wins;
+	int64_t best;		/* fastest win in microseconds, 0 if there is none */
+	int64_t wonTime;	/* sum of the times of the wins in microseconds */
+	uint32_t times[STATS_BUCKETS];	/* wins by time, see STATS_STEPS */
+} StatsEntry;
+
+typedef struct {
+	StatsEntry *entries;	/* from the smallest board to the largest */
+	int count;
+	int64_t created;		/* when the log was started */
+	int64_t logSize;		/* bytes of the log added to the totals */
+} Stats;
+
+/* appends result to the log and adds it to the totals; returns -1 if it can't
+   be written */
+int recordResult(const GameResult *result);
+
+/* reads the totals, adding the records that are missing from them, or building
+   them from the log if they have to be; returns -1 if memory runs out.
+   REMEMBER TO CALL freeStats */
+int loadStats(Stats *stats);
+
+/* builds the totals from the whole log again, and writes them; returns -1 if
+   memory runs out.
+   REMEMBER TO CALL freeStats */
+int rebuildStats(Stats *stats);
+
+/* free the memory allocated for the totals */
+int freeStats(Stats *stats);
+
+/* returns the time below which the fraction p of the wins in entry fall, in
+   seconds, or 0 if there are none */
+double statsPercentile(const StatsEntry *entry, double p);
+
+#endif /* STATS_H */
@@ -3,9 +3,6 @@
  * 
  * Contains definitions of  */
 
-/* TODO:
-   Remove refresh statement from end of printBoard function */
-
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -17,6 +14,7 @@
 
 #include "util.h"
 #include "board.h"
+#include "perf.h"
 
 int tutorial() {
 	int x, y;
@@ -33,7 +31,7 @@ int tutorial() {
 
 	/* write mine data to board struct */
 	for(x = 0; x < 10; x++) {
-		vMem.array[xm[x]][ym[x]] |= MASK_MINE;
+		setMine(&vMem, xm[x], ym[x], true);
 	}
 
 	clear();
@@ -52,7 +50,6 @@ int tutorial() {
 
 	mvaddstr(16, 0, "Uncovering a square will make it display a number representing the number of mines in the 8 squares adjacent to it.\n\n\nPress any key to continue...\n");
 	move(1, 0);
-	vMem.array[2][4] = '0' + numMines(vMem, 2, 4);\
 	openSquares(&vMem, 2, 4);
 	printBoard(vMem);
 	move(20, 0);
@@ -61,7 +58,6 @@ int tutorial() {
 
 	mvaddstr(16, 0, "If you uncover a square surrounded by 0 mines, the game will automatically open squares until all of the adjacent blank squares are open.\n\nPress any key to continue...\n");
 	move(1, 0);
-	vMem.array[4][7] = '0' + numMines(vMem, 4, 7);
 	openSquares(&vMem, 4, 7);
 	printBoard(vMem);
 	move(20, 0);
@@ -70,10 +66,10 @@ int tutorial() {
 
 	mvaddstr(16, 0, "Once you are certain that a square contains a mine, you can flag it to avoid accidentally opening it.\n\n\nPress any key to continue...\n");
 	move(1, 0);
-	vMem.array[1][6] = 'P' | MASK_MINE;
-	vMem.array[6][7] = 'P' | MASK_MINE;
-	vMem.array[6][8] = 'P' | MASK_MINE;
-	vMem.array[6][9] = 'P' | MASK_MINE;
+	CELL(vMem, 1, 6) = 'P' | MASK_MINE;
+	CELL(vMem, 6, 7) = 'P' | MASK_MINE;
+	CELL(vMem, 6, 8) = 'P' | MASK_MINE;
+	CELL(vMem, 6, 9) = 'P' | MASK_MINE;
 	printBoard(vMem);
 	move(20, 0);
 	refresh();
@@ -82,15 +78,15 @@ int tutorial() {
 	mvaddstr(16, 0, "The game will end when you either uncover all mine-free squares, or as soon as you uncover a mine.\nGood luck, and SWEEP THOSE MINES!\n\nPress any key to continue...\n");
 	for (y = 1; y <= 10; y++) {
 		for (x = 1; x <= 10; x++) {
-			vMem.array[x][y] &= ~MASK_CHAR;
-			vMem.array[x][y] |= '0' + numMines(vMem, x, y);
-			if ((vMem.array[x][y] & MASK_CHAR) == '0') {
-				vMem.array[x][y] &= ~MASK_CHAR;
-				vMem.array[x][y] |= ' ';
+			CELL(vMem, x, y) &= ~MASK_CHAR;
+			CELL(vMem, x, y) |= '0' + numMines(vMem, x, y);
+			if ((CELL(vMem, x, y) & MASK_CHAR) == '0') {
+				CELL(vMem, x, y) &= ~MASK_CHAR;
+				CELL(vMem, x, y) |= ' ';
 			}
-			if (vMem.array[x][y] & MASK_MINE) {
-				vMem.array[x][y] &= ~MASK_CHAR;
-				vMem.array[x][y] |= 'F';
+			if (CELL(vMem, x, y) & MASK_MINE) {
+				CELL(vMem, x, y) &= ~MASK_CHAR;
+				CELL(vMem, x, y) |= 'F';
 			}
 		}
 	}
@@ -105,6 +101,35 @@ int tutorial() {
 	return 0;
 }
 
+/* returns the number of board columns that fit on the terminal next to the
+   controls box */
+static int screenColumns(void) {
+	int termWidth, termHeight;
+	getmaxyx(stdscr, termHeight, termWidth);
+	(void) termHeight;
+	return (termWidth - 41) / 2;
+}
+
+int fitViewToScreen(Board *board) {
+	int termWidth, termHeight;
+	getmaxyx(stdscr, termHeight, termWidth);
+	(void) termWidth;
+	return setViewSize(board, screenColumns(), termHeight - 2);
+}
+
+int hudOffsetFor(int boardWidth) {
+	int width = screenColumns();
+	int hudOffset;
+
+	/* match the clamping done by setViewSize */
+	if (width > boardWidth) width = boardWidth;
+	if (width < 1) width = 1;
+
+	hudOffset = 2 * width + 3;
+	if (hudOffset < 18) hudOffset = 18;
+	return hudOffset;
+}
+
 int printCtrlsyx(int y, int x) {
 	int cy, cx;
 	getyx(stdscr, cy, cx);
@@ -120,6 +145,78 @@ int printCtrlsyx(int y, int x) {
 	return 0;
 }
 
+#ifdef CMINESWEEPER_PERF
+/* prints one line of the performance box, clipped to its width */
+static void printPerfLine(int y, int x, const char *format, ...) {
+	char line[64];
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+	mvprintw(y, x, "| %-34.34s |", line);
+}
+
+/* average time of a call to a counter in microseconds */
+static double perfAverage(int counter) {
+	const PerfCounter *c = &perfCounters[counter];
+	return (c->calls > 0) ? c->nanoseconds / 1e3 / c->calls : 0.0;
+}
+
+int printPerfyx(int y, int x) {
+	uint64_t most = 0;
+	int first = -1, last = -1;
+	int bucket, i;
+	int cy, cx;
+	getyx(stdscr, cy, cx);
+
+	mvaddstr(y++, x, "+=========== Performance ============+");
+	printPerfLine(y++, x, "frames  %llu  p50<%.0fus p99<%.0fus",
+		(unsigned long long) perfCounters[PERF_FRAME].calls,
+		perfPercentile(0.50), perfPercentile(0.99));
+	printPerfLine(y++, x, "draw    %9.1f us %10llu ch", perfAverage(PERF_DRAW),
+		(unsigned long long) perfCounters[PERF_DRAW].items);
+	printPerfLine(y++, x, "refresh %9.1f us", perfAverage(PERF_REFRESH));
+	printPerfLine(y++, x, "open    %9.1f us %10llu cl", perfAverage(PERF_OPEN),
+		(unsigned long long) perfCounters[PERF_OPEN].items);
+	printPerfLine(y++, x, "save    %9.1f us %10llu B", perfAverage(PERF_SAVE),
+		(unsigned long long) perfCounters[PERF_SAVE].items);
+	printPerfLine(y++, x, "load    %9.1f us %10llu B", perfAverage(PERF_LOAD),
+		(unsigned long long) perfCounters[PERF_LOAD].items);
+
+	/* the histogram, from the fastest bucket that holds a frame to the
+	   slowest one, of which the slowest 8 are shown if there are more */
+	for (bucket = 0; bucket < PERF_BUCKETS; bucket++) {
+		if (perfFrames[bucket] == 0)
+			continue;
+		if (first == -1)
+			first = bucket;
+		last = bucket;
+		if (perfFrames[bucket] > most)
+			most = perfFrames[bucket];
+	}
+	if (last - first >= 8)
+		first = last - 7;
+	for (bucket = first; first != -1 && bucket <= last; bucket++) {
+		char bar[16];
+		int length = (int) (15 * perfFrames[bucket] / most);
+		for (i = 0; i < length; i++)
+			bar[i] = '#';
+		bar[length] = '\0';
+		if (bucket < PERF_BUCKETS - 1)
+			printPerfLine(y++, x, "<%7lluus %7llu %s", 2ULL << bucket,
+				(unsigned long long) perfFrames[bucket], bar);
+		else
+			printPerfLine(y++, x, " slower  %7llu %s",
+				(unsigned long long) perfFrames[bucket], bar);
+	}
+	mvaddstr(y++, x, "+====================================+");
+	move(cy, cx);
+
+	return 0;
+}
+#endif
+
 int printCtrls() {
     return printCtrlsyx(3, 29);
 }
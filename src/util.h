@@ -10,6 +10,8 @@
 #include <curses.h> 
 
 #include "board.h"
+#include "engine.h"
+#include "render.h"
 #include "savegame.h"
 
 /* play the game tutorial */
@@ -21,6 +23,20 @@ int printCtrlsyx(int y, int x);
 /* printCtrls using default location at (3, 29) */
 int printCtrls();
 
+#ifdef CMINESWEEPER_PERF
+/* print the performance counters and the frame time histogram with the top
+   left corner at (y, x) */
+int printPerfyx(int y, int x);
+#endif
+
+/* sizes the viewport of board to the largest area that fits on the terminal
+   next to the controls box */
+int fitViewToScreen(Board *board);
+
+/* returns the column where the HUD starts for a board of the given width,
+   once its viewport has been fitted to the terminal */
+int hudOffsetFor(int boardWidth);
+
 /* macros for game return codes */
 #define GAME_FAILURE	0
 #define GAME_SUCCESS	1
@@ -34,16 +50,4 @@ int printCtrls();
 #define MENU_EXIT_GAME	3
 #define MENU_TUTORIAL	4
 
-/* macros for game actions */
-#define ACTION_NONE		0	/* no action */
-#define ACTION_OPEN		1	/* open the current square */
-#define ACTION_FLAG		2	/* place a flag on the current square */
-#define ACTION_AUTO		3	/* automatically open adjacent squares */
-#define ACTION_ESCAPE	4	/* open the pause menu */
-#define ACTION_SAVE		5	
-
-/* masks for accessing mine data */
-#define MASK_MINE	0x80
-#define MASK_CHAR	0x7F
-
 #endif /* GAMEFUNCTIONS_H */
\ No newline at end of file